@@ -0,0 +1,111 @@
+#include "SDL.h"
+#include "SDL_vulkan.h"
+#include "toy2d/toy2d.hpp"
+#include "toy2d/descriptor_manager.hpp"
+#include "toy2d/shader.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// cpu time of recording texture binds into a command buffer. the set 1 layout is made for push
+// descriptors or for sets at Init, so one run measures one mode:
+//   bind_bench push [binds]	Texture::Bind with VK_KHR_push_descriptor
+//   bind_bench sets [binds]	Texture::Bind with the pooled image sets, and a transient set per bind
+// the textures are the ones in resources/, run it from the repo root
+
+namespace {
+
+	// best of a few recordings of `binds` binds, in ns per bind
+	template <typename F>
+	double nanosecondsPerBind(vk::CommandBuffer cmd, int binds, F&& bind) {
+		double best = 1e30;
+		for (int i = 0; i < 7; i++) {
+			cmd.reset();
+			cmd.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+			auto start = std::chrono::steady_clock::now();
+			for (int b = 0; b < binds; b++) {
+				bind(cmd, b);
+			}
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			cmd.end();
+			best = std::min(best, elapsed.count());
+		}
+		return best * 1e9 / binds;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	bool push = argc > 1 && std::strcmp(argv[1], "push") == 0;
+	int binds = argc > 2 ? std::atoi(argv[2]) : 100000;
+
+	SDL_Init(SDL_INIT_VIDEO);
+	SDL_Window* window = SDL_CreateWindow("bind_bench", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+		256, 256, SDL_WINDOW_HIDDEN | SDL_WINDOW_VULKAN);
+	if (!window) {
+		SDL_Log("create window failed");
+		return 2;
+	}
+	uint32_t count;
+	SDL_Vulkan_GetInstanceExtensions(window, &count, nullptr);
+	std::vector<const char*> extensions(count);
+	SDL_Vulkan_GetInstanceExtensions(window, &count, extensions.data());
+	toy2d::Init(extensions, [&](vk::Instance instance) {
+		VkSurfaceKHR surface;
+		SDL_Vulkan_CreateSurface(window, instance, &surface);
+		return surface;
+	}, 256, 256, push);
+
+	auto& ctx = toy2d::Context::GetInstance();
+	if (push && !ctx.usePushDescriptors) {
+		std::printf("the device has no VK_KHR_push_descriptor\n");
+		toy2d::Quit();
+		SDL_DestroyWindow(window);
+		SDL_Quit();
+		return 1;
+	}
+
+	// a bind only changes something when the texture does, so cycle through a few
+	std::vector<toy2d::Texture*> textures;
+	for (const char* file : { "resources/nahida.png", "resources/furina.jpg", "resources/fu2.png" }) {
+		textures.push_back(toy2d::LoadTexture(file));
+	}
+	auto layout = ctx.renderProcess->layout;
+	auto cmd = ctx.commandManager->CreateOneCommandBuffer();
+
+	std::printf("%d binds over %zu textures\n", binds, textures.size());
+	double textureBind = nanosecondsPerBind(cmd, binds, [&](vk::CommandBuffer cmd, int b) {
+		textures[b % textures.size()]->Bind(cmd, layout);
+	});
+	std::printf("%s: Texture::Bind %6.1f ns/bind\n", push ? "push descriptors" : "pooled sets", textureBind);
+
+	if (!push) {
+		// what a per draw set costs: allocate, write and bind every time, reset once per recording
+		auto setLayout = toy2d::Shader::GetInstance().GetDescriptorSetLayouts()[1];
+		double transient = nanosecondsPerBind(cmd, binds, [&](vk::CommandBuffer cmd, int b) {
+			if (b == 0) toy2d::DescriptorSetManager::Instance().BeginFrame(0);
+			auto set = toy2d::DescriptorSetManager::Instance().AllocTransientSet(setLayout);
+			toy2d::Shader::DescriptorData data;
+			data.image = VkDescriptorImageInfo{
+				static_cast<VkSampler>(ctx.sampler),
+				static_cast<VkImageView>(textures[b % textures.size()]->imageView),
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+			toy2d::Shader::GetInstance().UpdateDescriptorSet(set, 1, &data);
+			cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 1, set, {});
+		});
+		std::printf("transient sets: allocate, write and bind %6.1f ns/bind\n", transient);
+	}
+
+	ctx.commandManager->freeCmds(cmd);
+	for (auto texture : textures) {
+		toy2d::DestroyTexture(texture);
+	}
+	toy2d::Quit();
+	SDL_DestroyWindow(window);
+	SDL_Quit();
+	return 0;
+}
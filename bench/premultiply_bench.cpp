@@ -0,0 +1,73 @@
+#include "toy2d/premultiply.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// MB/s of PremultiplyAlpha against a plain per channel loop, for both modes, into a second
+// buffer and in place. usage: premultiply_bench [megapixels]
+
+namespace {
+
+	// what the loader did per pixel before the kernels
+	void referencePremultiply(const std::uint8_t* src, std::uint8_t* dst, size_t pixelCount, toy2d::PremultiplyMode mode) {
+		for (size_t i = 0; i < pixelCount; i++) {
+			const std::uint8_t* s = src + i * 4;
+			std::uint8_t* d = dst + i * 4;
+			float alpha = s[3] / 255.0f;
+			for (int c = 0; c < 3; c++) {
+				float v = s[c] / 255.0f;
+				if (mode == toy2d::PremultiplyMode::Srgb) {
+					v = v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+					v *= alpha;
+					v = v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+				} else {
+					v *= alpha;
+				}
+				d[c] = static_cast<std::uint8_t>(std::lround(std::clamp(v, 0.0f, 1.0f) * 255.0f));
+			}
+			d[3] = s[3];
+		}
+	}
+
+	// best of a few runs, the first one also faults the pages in
+	template <typename F>
+	double megabytesPerSecond(size_t bytes, F&& run) {
+		double best = 1e30;
+		for (int i = 0; i < 5; i++) {
+			auto start = std::chrono::steady_clock::now();
+			run();
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			best = std::min(best, elapsed.count());
+		}
+		return bytes / best / 1e6;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	size_t pixels = size_t(argc > 1 ? std::atof(argv[1]) : 4.0) * 1024 * 1024;
+	size_t bytes = pixels * 4;
+
+	std::mt19937 rng(1);
+	std::vector<std::uint8_t> src(bytes), dst(bytes), inPlace(bytes);
+	for (auto& b : src) b = static_cast<std::uint8_t>(rng());
+
+	std::printf("%zu pixels, %.1f MB\n", pixels, bytes / 1e6);
+	for (auto mode : { toy2d::PremultiplyMode::Srgb, toy2d::PremultiplyMode::Fast }) {
+		const char* name = mode == toy2d::PremultiplyMode::Srgb ? "srgb" : "fast";
+		double reference = megabytesPerSecond(bytes, [&] { referencePremultiply(src.data(), dst.data(), pixels, mode); });
+		double kernel = megabytesPerSecond(bytes, [&] { toy2d::PremultiplyAlpha(src.data(), dst.data(), pixels, mode); });
+		// the source is copied back first, that copy is timed too
+		double kernelInPlace = megabytesPerSecond(bytes, [&] {
+			std::copy(src.begin(), src.end(), inPlace.begin());
+			toy2d::PremultiplyAlpha(inPlace.data(), inPlace.data(), pixels, mode);
+		});
+		std::printf("%s: reference %8.0f MB/s, kernel %8.0f MB/s, in place with copy %8.0f MB/s\n",
+			name, reference, kernel, kernelInPlace);
+	}
+	return 0;
+}
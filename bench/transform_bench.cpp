@@ -0,0 +1,63 @@
+#include "toy2d/transform2d.hpp"
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// sprites/s of TransformBatch in both modes against the glm translate * scale * rotate mat4 that
+// Renderer::DrawTexture built per sprite before it. usage: transform_bench [sprites]
+
+namespace {
+
+	// best of a few runs, the first one also faults the pages in
+	template <typename F>
+	double spritesPerSecond(size_t count, F&& run) {
+		double best = 1e30;
+		for (int i = 0; i < 7; i++) {
+			auto start = std::chrono::steady_clock::now();
+			run();
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			best = std::min(best, elapsed.count());
+		}
+		return count / best;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	size_t count = argc > 1 ? size_t(std::atol(argv[1])) : size_t(1) << 20;
+
+	std::mt19937 rng(2);
+	std::uniform_real_distribution<float> position(-5000.0f, 5000.0f), angle(-50.0f, 50.0f), scale(1.0f, 500.0f);
+	toy2d::TransformList transforms;
+	for (size_t i = 0; i < count; i++) {
+		transforms.Push(position(rng), position(rng), angle(rng), scale(rng), scale(rng));
+	}
+	std::vector<toy2d::Affine2D> affines(count);
+	std::vector<glm::mat4x4> matrices(count);
+
+	double mat4 = spritesPerSecond(count, [&] {
+		for (size_t i = 0; i < count; i++) {
+			glm::mat4x4 model(1.0f);
+			model = glm::translate(model, { transforms.x[i], transforms.y[i], 0 });
+			model = glm::scale(model, { transforms.scaleX[i], transforms.scaleY[i], 1 });
+			model = glm::rotate(model, transforms.rotation[i], { 0, 0, 1 });
+			matrices[i] = model;
+		}
+	});
+	double precise = spritesPerSecond(count, [&] { toy2d::TransformBatch(transforms, affines.data(), toy2d::SinCosMode::Precise); });
+	double fast = spritesPerSecond(count, [&] { toy2d::TransformBatch(transforms, affines.data(), toy2d::SinCosMode::Fast); });
+
+	std::printf("%zu sprites\n", count);
+	std::printf("glm mat4: %8.1f M sprites/s\n", mat4 / 1e6);
+	std::printf("precise:  %8.1f M sprites/s (%.1fx)\n", precise / 1e6, precise / mat4);
+	std::printf("fast:     %8.1f M sprites/s (%.1fx)\n", fast / 1e6, fast / mat4);
+	// keeps the mat4 loop from being optimized away
+	volatile float sink = matrices[count / 2][0][0];
+	(void)sink;
+	return 0;
+}
@@ -0,0 +1,9 @@
+#version 450
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+    // blended additively, the target ends up with the fragment count of every pixel
+    outColor = vec4(1.0, 0.0, 0.0, 0.0);
+}
@@ -0,0 +1,50 @@
+#version 450
+
+layout(location = 0) in vec2 Position;
+layout(location = 1) in vec2 inTexcoord;
+
+layout(location = 0) out vec2 outTexcoord;
+layout(location = 1) out vec4 outTint;
+
+layout(set = 0, binding = 0) uniform UniformBuffer {
+    mat4 project;
+    mat4 view;
+} ubo;
+
+// matches ParticleSystem::Particle
+struct Particle {
+    vec2 position;
+    vec2 velocity;
+    float age;
+    float lifetime;
+    float rotation;
+    float spin;
+};
+
+// the buffer the last simulation wrote, one instance per live particle
+layout(std430, set = 2, binding = 0) readonly buffer Particles {
+    Particle particles[];
+};
+
+// matches ParticleSystem::DrawParams
+layout(push_constant) uniform Params {
+    uint startColor;
+    uint endColor;
+    float startSize;
+    float endSize;
+    float depth;
+} params;
+
+void main()
+{
+    Particle p = particles[gl_InstanceIndex];
+    float t = clamp(p.age / p.lifetime, 0.0, 1.0);
+    float size = mix(params.startSize, params.endSize, t);
+    float c = cos(p.rotation);
+    float s = sin(p.rotation);
+    vec2 world = p.position + mat2(c, s, -s, c) * Position * size;
+    gl_Position = ubo.project * ubo.view * vec4(world, 0.0, 1.0);
+    gl_Position.z = params.depth * gl_Position.w;
+    outTexcoord = inTexcoord;
+    outTint = mix(unpackUnorm4x8(params.startColor), unpackUnorm4x8(params.endColor), t);
+}
@@ -0,0 +1,24 @@
+#version 450
+
+layout(location = 0) in vec2 Local;
+layout(location = 1) flat in vec2 Half;
+layout(location = 2) flat in float Radius;
+layout(location = 3) flat in float Outline;
+layout(location = 4) in vec4 Color;
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+    // rounded box distance, negative inside
+    vec2 q = abs(Local) - Half;
+    float dist = length(max(q, 0.0)) + min(max(q.x, q.y), 0.0) - Radius;
+    if (Outline > 0.0) {
+        dist = abs(dist) - Outline;
+    }
+    float coverage = clamp(0.5 - dist / max(fwidth(dist), 1e-5), 0.0, 1.0);
+    if (coverage <= 0.0) discard;
+    // premultiplied like everything else
+    float alpha = Color.a * coverage;
+    outColor = vec4(Color.rgb * alpha, alpha);
+}
@@ -0,0 +1,79 @@
+#version 450
+
+layout(location = 0) in vec2 Position;
+layout(location = 1) in vec2 inTexcoord;
+// per primitive, see PrimitiveInstance
+layout(location = 2) in vec4 inPoints;
+layout(location = 3) in float inWidth;
+layout(location = 4) in vec4 inColor;
+layout(location = 5) in uint inKind;
+layout(location = 6) in float inDepth;
+
+// position in the shape's own frame, centered on it
+layout(location = 0) out vec2 outLocal;
+layout(location = 1) flat out vec2 outHalf;
+layout(location = 2) flat out float outRadius;
+layout(location = 3) flat out float outOutline;
+layout(location = 4) out vec4 outColor;
+
+layout(set = 0, binding = 0) uniform UniformBuffer {
+    mat4 project;
+    mat4 view;
+} ubo;
+
+// world units per pixel, the quads get a pixel of margin for the antialiased edge
+layout(push_constant) uniform Params {
+    vec2 pixel;
+} params;
+
+const uint Line = 0u;
+const uint Rect = 1u;
+const uint Circle = 2u;
+
+void main()
+{
+    vec2 a = inPoints.xy;
+    vec2 b = inPoints.zw;
+    float pixel = max(params.pixel.x, params.pixel.y);
+
+    // every shape is a box with rounded corners: a line is a zero height box rounded by half its
+    // width, a circle a zero size box rounded by its radius
+    vec2 center;
+    vec2 axis = vec2(1.0, 0.0);
+    vec2 halfSize;
+    float radius;
+    float outline = 0.0;
+    if (inKind == Line) {
+        vec2 d = b - a;
+        float len = length(d);
+        center = (a + b) * 0.5;
+        axis = len > 0.0 ? d / len : vec2(1.0, 0.0);
+        halfSize = vec2(len * 0.5, 0.0);
+        // thinner lines are drawn a pixel wide and faded instead of breaking up
+        radius = max(inWidth, pixel) * 0.5;
+    } else if (inKind == Rect) {
+        center = (a + b) * 0.5;
+        halfSize = abs(b - a) * 0.5;
+        radius = 0.0;
+        outline = inWidth * 0.5;
+    } else {
+        center = a;
+        halfSize = vec2(0.0);
+        radius = b.x;
+        outline = inWidth * 0.5;
+    }
+
+    vec2 extent = halfSize + radius + outline + pixel;
+    vec2 local = Position * 2.0 * extent;
+    vec2 world = center + axis * local.x + vec2(-axis.y, axis.x) * local.y;
+    gl_Position = ubo.project * ubo.view * vec4(world, 0.0, 1.0);
+    gl_Position.z = inDepth * gl_Position.w;
+
+    outLocal = local;
+    outHalf = halfSize;
+    outRadius = radius;
+    outOutline = outline;
+    // width 0 is a hairline, lines thinner than a pixel fade out instead
+    float fade = inKind == Line && inWidth > 0.0 ? min(inWidth / pixel, 1.0) : 1.0;
+    outColor = vec4(inColor.rgb, inColor.a * fade);
+}
@@ -0,0 +1,35 @@
+#version 450
+
+layout(location = 0) in vec2 Position;
+layout(location = 1) in vec2 inTexcoord;
+// index of this sprite's record in the scene buffer
+layout(location = 2) in uint slot;
+
+layout(location = 0) out vec2 outTexcoord;
+layout(location = 1) out vec4 outTint;
+
+layout(set = 0, binding = 0) uniform UniformBuffer {
+    mat4 project;
+    mat4 view;
+} ubo;
+
+// matches Scene::Record
+struct Record {
+    vec4 affine;
+    vec2 translation;
+    uint tint;
+    uint group;
+};
+
+layout(std430, set = 2, binding = 0) readonly buffer SceneRecords {
+    Record records[];
+};
+
+void main()
+{
+    Record record = records[slot];
+    vec2 world = record.affine.xy * Position.x + record.affine.zw * Position.y + record.translation;
+    gl_Position = ubo.project * ubo.view * vec4(world, 0.0, 1.0);
+    outTexcoord = inTexcoord;
+    outTint = unpackUnorm4x8(record.tint);
+}
@@ -2,6 +2,7 @@
 
 layout(location = 0) out vec4 outColor;
 layout(location = 0) in vec2 Texcoord;
+layout(location = 1) in vec4 Tint;
 
 layout(set = 0, binding = 1) uniform UniformBuffer {
     vec3 color;
@@ -11,5 +12,6 @@ layout(set = 1, binding = 0) uniform sampler2D Sampler;
 
 void main()
 {
-    outColor =  texture(Sampler, Texcoord);
+    // textures are premultiplied, so the tint is premultiplied too
+    outColor =  texture(Sampler, Texcoord) * vec4(Tint.rgb * Tint.a, Tint.a);
 }
\ No newline at end of file
@@ -2,21 +2,27 @@
 
 layout(location = 0) in vec2 Position;
 layout(location = 1) in vec2 inTexcoord;
+// per instance 2x3 affine and tint, see SpriteInstance. xy is the first column, zw the translation
+layout(location = 2) in vec4 inAffine;
+layout(location = 3) in float inScaleRatio;
+layout(location = 4) in vec4 inTint;
+// greater is in front, only tested when the render pass has a depth buffer
+layout(location = 5) in float inDepth;
 
 layout(location = 0) out vec2 outTexcoord;
+layout(location = 1) out vec4 outTint;
 
 layout(set = 0, binding = 0) uniform UniformBuffer {
     mat4 project;
     mat4 view;
 } ubo;
 
-layout(push_constant) uniform PushConstant {
-    mat4 model;
-} pc;
-
 void main()
 {
-    gl_Position =  ubo.project * ubo.view * pc.model * vec4(Position, 0.0, 1.0);
+    vec2 secondColumn = inScaleRatio * vec2(-inAffine.y, inAffine.x);
+    vec2 world = inAffine.xy * Position.x + secondColumn * Position.y + inAffine.zw;
+    gl_Position =  ubo.project * ubo.view * vec4(world, 0.0, 1.0);
+    gl_Position.z = inDepth * gl_Position.w;
     outTexcoord = inTexcoord;
-  //  gl_Position =  pc.model * vec4(Position, 0.0, 1.0);
-}
\ No newline at end of file
+    outTint = inTint;
+}
@@ -0,0 +1,17 @@
+#version 450
+
+layout(location = 0) out vec4 outColor;
+layout(location = 0) in vec2 Texcoord;
+layout(location = 1) in vec4 Color;
+
+// signed distance fields, 0.5 is the glyph edge
+layout(set = 1, binding = 0) uniform sampler2D Atlas;
+
+void main()
+{
+    float distance = texture(Atlas, Texcoord).r;
+    // about one screen pixel of antialiasing at any scale
+    float width = max(fwidth(distance) * 0.5, 1e-4);
+    float coverage = smoothstep(0.5 - width, 0.5 + width, distance);
+    outColor = vec4(Color.rgb * Color.a, Color.a) * coverage;
+}
@@ -0,0 +1,28 @@
+#version 450
+
+layout(location = 0) in vec2 Position;
+layout(location = 1) in vec2 inTexcoord;
+// per glyph, see GlyphInstance
+layout(location = 2) in vec4 inRect;    // x, y, w, h, x, y is the top left corner
+layout(location = 3) in vec4 inCell;    // u0, v0, u1, v1 in the atlas
+layout(location = 4) in vec4 inColor;
+layout(location = 5) in float inDepth;
+
+layout(location = 0) out vec2 outTexcoord;
+layout(location = 1) out vec4 outColor;
+
+layout(set = 0, binding = 0) uniform UniformBuffer {
+    mat4 project;
+    mat4 view;
+} ubo;
+
+void main()
+{
+    // the unit quad spans [-0.5, 0.5]
+    vec2 corner = Position + 0.5;
+    vec2 world = inRect.xy + corner * inRect.zw;
+    gl_Position = ubo.project * ubo.view * vec4(world, 0.0, 1.0);
+    gl_Position.z = inDepth * gl_Position.w;
+    outTexcoord = mix(inCell.xy, inCell.zw, corner);
+    outColor = inColor;
+}
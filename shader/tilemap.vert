@@ -0,0 +1,28 @@
+#version 450
+
+// chunk vertices are already in map space
+layout(location = 0) in vec2 Position;
+layout(location = 1) in vec2 inTexcoord;
+
+layout(location = 0) out vec2 outTexcoord;
+layout(location = 1) out vec4 outTint;
+
+layout(set = 0, binding = 0) uniform UniformBuffer {
+    mat4 project;
+    mat4 view;
+} ubo;
+
+// matches Tilemap::DrawParams
+layout(push_constant) uniform Params {
+    vec2 origin;
+    uint tint;
+    float depth;
+} params;
+
+void main()
+{
+    gl_Position = ubo.project * ubo.view * vec4(Position + params.origin, 0.0, 1.0);
+    gl_Position.z = params.depth * gl_Position.w;
+    outTexcoord = inTexcoord;
+    outTint = unpackUnorm4x8(params.tint);
+}
@@ -0,0 +1,33 @@
+#version 450
+
+layout(location = 0) out vec4 outColor;
+layout(location = 0) in vec2 Texcoord;
+
+// physical pages, cacheSize x cacheSize texels
+layout(set = 1, binding = 0) uniform sampler2D PageCache;
+// one texel per level 0 page: xy = physical page, z = level of the resident page, w = valid
+layout(set = 1, binding = 1) uniform usampler2D PageTable;
+
+layout(push_constant) uniform PushConstant {
+    layout(offset = 64) vec2 levelZeroPages;   // image size / page size, not rounded
+    float pageSize;
+    float cacheSize;
+} pc;
+
+void main()
+{
+    ivec2 tableSize = textureSize(PageTable, 0);
+    ivec2 tableCoord = clamp(ivec2(Texcoord * pc.levelZeroPages), ivec2(0), tableSize - 1);
+    uvec4 entry = texelFetch(PageTable, tableCoord, 0);
+    if (entry.w == 0u) {
+        outColor = vec4(0.0);
+        return;
+    }
+
+    // a page of level L covers 2^L level 0 pages
+    vec2 pageCoord = Texcoord * pc.levelZeroPages / exp2(float(entry.z));
+    float halfTexel = 0.5 / pc.pageSize;
+    vec2 inPage = clamp(fract(pageCoord), vec2(halfTexel), vec2(1.0 - halfTexel));
+    vec2 cacheCoord = (vec2(entry.xy) + inPage) * pc.pageSize / pc.cacheSize;
+    outColor = textureLod(PageCache, cacheCoord, 0.0);
+}
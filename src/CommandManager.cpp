@@ -22,12 +22,12 @@ namespace toy2d {
 		return ctx.device.createCommandPool(cmdPoolInfo);
 	}
 
-	std::vector<vk::CommandBuffer> CommandManager::CreateCommandBuffers(std::uint32_t count) {
+	std::vector<vk::CommandBuffer> CommandManager::CreateCommandBuffers(std::uint32_t count, vk::CommandBufferLevel level) {
 		auto& device = Context::GetInstance().device;
 		vk::CommandBufferAllocateInfo cmdBufInfo;
 		cmdBufInfo.setCommandBufferCount(count)
 			.setCommandPool(commandPool)
-			.setLevel(vk::CommandBufferLevel::ePrimary);
+			.setLevel(level);
 		return device.allocateCommandBuffers(cmdBufInfo);
 	}
 
@@ -72,7 +72,7 @@ void Context::createInstance(const std::vector<const char*>& extensions, CreateS
     createInfo.setPEnabledLayerNames(layers)
         .setPEnabledExtensionNames(extensions);
 
-    appInfo.setApiVersion(VK_VERSION_1_3)
+    appInfo.setApiVersion(VK_API_VERSION_1_3)
             .setPEngineName("SDL");
     createInfo.setPApplicationInfo(&appInfo);
 
@@ -99,7 +99,32 @@ void Context::pickupPhysicalDevice() {
 }
 
 void Context::createDevice() {
-    std::array extensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+    std::vector<const char*> extensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+    // optional extensions, only enabled when the device has them
+    if (isDeviceExtensionSupported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) &&
+        physicaldevice.getProperties().apiVersion >= VK_API_VERSION_1_1) {
+        extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        memoryBudgetSupported = true;
+    }
+    if (isDeviceExtensionSupported(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME)) {
+        extensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+        pushDescriptorSupported = true;
+    }
+    // only for the overdraw diagnostics, the queries stay active across executeCommands
+    vk::PhysicalDeviceFeatures features;
+    auto supported = physicaldevice.getFeatures();
+    if (supported.pipelineStatisticsQuery && supported.inheritedQueries) {
+        features.setPipelineStatisticsQuery(true)
+            .setInheritedQueries(true);
+        pipelineStatisticsSupported = true;
+    }
+    // core since 1.3, the feature still has to be turned on
+    vk::PhysicalDeviceDynamicRenderingFeatures dynamicRendering;
+    if (physicaldevice.getProperties().apiVersion >= VK_API_VERSION_1_3) {
+        auto chain = physicaldevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan13Features>();
+        dynamicRenderingSupported = chain.get<vk::PhysicalDeviceVulkan13Features>().dynamicRendering;
+        dynamicRendering.setDynamicRendering(dynamicRenderingSupported);
+    }
     vk::DeviceCreateInfo createinfo;
     std::vector<vk::DeviceQueueCreateInfo> queue_create_infos;
     float priorities = 1.0;
@@ -122,8 +147,26 @@ void Context::createDevice() {
         queue_create_infos.push_back(queue_create_info);
     }
     createinfo.setQueueCreateInfos(queue_create_infos)
-        .setPEnabledExtensionNames(extensions);
+        .setPEnabledExtensionNames(extensions)
+        .setPEnabledFeatures(&features);
+    if (dynamicRenderingSupported) {
+        createinfo.setPNext(&dynamicRendering);
+    }
     device = physicaldevice.createDevice(createinfo);
+
+    // extension commands are not exported by the loader
+    if (pushDescriptorSupported) {
+        cmdPushDescriptorSet = reinterpret_cast<PFN_vkCmdPushDescriptorSetKHR>(device.getProcAddr("vkCmdPushDescriptorSetKHR"));
+        pushDescriptorSupported = cmdPushDescriptorSet != nullptr;
+    }
+}
+
+bool Context::isDeviceExtensionSupported(const char* name) const {
+    auto properties = physicaldevice.enumerateDeviceExtensionProperties();
+    return std::find_if(properties.begin(), properties.end(),
+                        [&](const vk::ExtensionProperties& prop) {
+                            return std::strcmp(prop.extensionName, name) == 0;
+                        }) != properties.end();
 }
 
 void Context::initSampler() {
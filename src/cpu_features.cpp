@@ -0,0 +1,38 @@
+#include "toy2d/cpu_features.hpp"
+
+#if defined(TOY2D_SIMD_X64) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace toy2d {
+
+	namespace {
+#ifdef TOY2D_SIMD_X64
+		bool queryAvx2() {
+#if defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7) return false;
+			__cpuid(info, 1);
+			bool osxsave = (info[2] & (1 << 27)) != 0;
+			bool avx = (info[2] & (1 << 28)) != 0;
+			if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) return false;
+			__cpuidex(info, 7, 0);
+			return (info[1] & (1 << 5)) != 0;
+#else
+			return __builtin_cpu_supports("avx2");
+#endif
+		}
+#endif
+	}
+
+	bool CpuHasAvx2() {
+#ifdef TOY2D_SIMD_X64
+		static const bool supported = queryAvx2();
+		return supported;
+#else
+		return false;
+#endif
+	}
+
+}
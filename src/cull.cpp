@@ -0,0 +1,78 @@
+#include "toy2d/cull.hpp"
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TOY2D_CULL_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define TOY2D_CULL_NEON
+#include <arm_neon.h>
+#endif
+
+namespace toy2d {
+
+	Rect RotatedBounds(float cx, float cy, float w, float h, float radians) {
+		float c = std::abs(std::cos(radians));
+		float s = std::abs(std::sin(radians));
+		float hx = 0.5f * (w * c + h * s);
+		float hy = 0.5f * (w * s + h * c);
+		return Rect{ cx - hx, cy - hy, cx + hx, cy + hy };
+	}
+
+	size_t CullBounds(const BoundsList& bounds, const Rect& view, std::vector<uint32_t>& visible) {
+		size_t n = bounds.Size();
+		size_t base = visible.size();
+		visible.resize(base + n);
+		uint32_t* out = visible.data() + base;
+		size_t count = 0;
+
+		const float* minX = bounds.minX.data();
+		const float* minY = bounds.minY.data();
+		const float* maxX = bounds.maxX.data();
+		const float* maxY = bounds.maxY.data();
+
+		size_t i = 0;
+#if defined(TOY2D_CULL_SSE2)
+		__m128 viewMinX = _mm_set1_ps(view.minX);
+		__m128 viewMinY = _mm_set1_ps(view.minY);
+		__m128 viewMaxX = _mm_set1_ps(view.maxX);
+		__m128 viewMaxY = _mm_set1_ps(view.maxY);
+		for (; i + 4 <= n; i += 4) {
+			__m128 x = _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(minX + i), viewMaxX),
+				_mm_cmpge_ps(_mm_loadu_ps(maxX + i), viewMinX));
+			__m128 y = _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(minY + i), viewMaxY),
+				_mm_cmpge_ps(_mm_loadu_ps(maxY + i), viewMinY));
+			int mask = _mm_movemask_ps(_mm_and_ps(x, y));
+			// branch free compaction, out has room for every box
+			out[count] = uint32_t(i);		count += mask & 1;
+			out[count] = uint32_t(i + 1);	count += (mask >> 1) & 1;
+			out[count] = uint32_t(i + 2);	count += (mask >> 2) & 1;
+			out[count] = uint32_t(i + 3);	count += (mask >> 3) & 1;
+		}
+#elif defined(TOY2D_CULL_NEON)
+		float32x4_t viewMinX = vdupq_n_f32(view.minX);
+		float32x4_t viewMinY = vdupq_n_f32(view.minY);
+		float32x4_t viewMaxX = vdupq_n_f32(view.maxX);
+		float32x4_t viewMaxY = vdupq_n_f32(view.maxY);
+		for (; i + 4 <= n; i += 4) {
+			uint32x4_t x = vandq_u32(vcleq_f32(vld1q_f32(minX + i), viewMaxX),
+				vcgeq_f32(vld1q_f32(maxX + i), viewMinX));
+			uint32x4_t y = vandq_u32(vcleq_f32(vld1q_f32(minY + i), viewMaxY),
+				vcgeq_f32(vld1q_f32(maxY + i), viewMinY));
+			uint32x4_t hit = vshrq_n_u32(vandq_u32(x, y), 31);
+			out[count] = uint32_t(i);		count += vgetq_lane_u32(hit, 0);
+			out[count] = uint32_t(i + 1);	count += vgetq_lane_u32(hit, 1);
+			out[count] = uint32_t(i + 2);	count += vgetq_lane_u32(hit, 2);
+			out[count] = uint32_t(i + 3);	count += vgetq_lane_u32(hit, 3);
+		}
+#endif
+		for (; i < n; i++) {
+			out[count] = uint32_t(i);
+			count += minX[i] <= view.maxX && view.minX <= maxX[i] && minY[i] <= view.maxY && view.minY <= maxY[i];
+		}
+
+		visible.resize(base + count);
+		return count;
+	}
+
+}
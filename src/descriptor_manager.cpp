@@ -1,32 +1,42 @@
 #include "toy2d/descriptor_manager.hpp"
 #include "toy2d/context.hpp"
 #include "toy2d/shader.hpp"
+#include <algorithm>
+#include <array>
 
 namespace toy2d {
 
     std::unique_ptr<DescriptorSetManager> DescriptorSetManager::instance_ = nullptr;
 
     DescriptorSetManager::DescriptorSetManager(uint32_t maxFlight) : maxFlight_(maxFlight) {
+        // the renderer takes one set per frame slot, the rest is room for other per frame buffers
+        constexpr uint32_t BufferSetsPerFlight = 4;
+
+        uint32_t maxSets = BufferSetsPerFlight * maxFlight;
         vk::DescriptorPoolSize size;
         size.setType(vk::DescriptorType::eUniformBuffer)
-            .setDescriptorCount(2 * maxFlight);
+            .setDescriptorCount(2 * maxSets);
         vk::DescriptorPoolCreateInfo createInfo;
-        createInfo.setMaxSets(maxFlight)
+        createInfo.setMaxSets(maxSets)
             .setPoolSizes(size);
         auto pool = Context::GetInstance().device.createDescriptorPool(createInfo);
         bufferSetPool_.pool_ = pool;
-        bufferSetPool_.remainNum_ = maxFlight;
+        bufferSetPool_.remainNum_ = maxSets;
+
+        transientFrames_.resize(maxFlight);
     }
 
     DescriptorSetManager::~DescriptorSetManager() {
         auto& device = Context::GetInstance().device;
 
         device.destroyDescriptorPool(bufferSetPool_.pool_);
-        for (auto pool : fulledImageSetPool_) {
+        for (auto pool : imageSetPools_) {
             device.destroyDescriptorPool(pool.pool_);
         }
-        for (auto pool : avalibleImageSetPool_) {
-            device.destroyDescriptorPool(pool.pool_);
+        for (auto& frame : transientFrames_) {
+            for (auto pool : frame.pools_) {
+                device.destroyDescriptorPool(pool);
+            }
         }
     }
 
@@ -41,11 +51,15 @@ namespace toy2d {
             .setPoolSizes(size)
             .setFlags(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet);
         auto pool = Context::GetInstance().device.createDescriptorPool(createInfo);
-        avalibleImageSetPool_.push_back({ pool, MaxSetNum });
+        avalibleImageSetPools_.push_back(static_cast<uint32_t>(imageSetPools_.size()));
+        imageSetPools_.push_back({ pool, MaxSetNum });
     }
 
     std::vector<DescriptorSetManager::SetInfo> DescriptorSetManager::AllocBufferSets(uint32_t num) {
-        std::vector<vk::DescriptorSetLayout> layouts(maxFlight_, Shader::GetInstance().GetDescriptorSetLayouts()[0]);
+        if (num > bufferSetPool_.remainNum_) {
+            throw std::runtime_error("Buffer descriptor set pool exhausted!");
+        }
+        std::vector<vk::DescriptorSetLayout> layouts(num, Shader::GetInstance().GetDescriptorSetLayouts()[0]);
         vk::DescriptorSetAllocateInfo allocInfo;
         allocInfo.setDescriptorPool(bufferSetPool_.pool_)
             .setDescriptorSetCount(num)
@@ -58,6 +72,7 @@ namespace toy2d {
             result[i].set = sets[i];
             result[i].pool = bufferSetPool_.pool_;
         }
+        bufferSetPool_.remainNum_ -= num;
 
         return result;
     }
@@ -65,7 +80,8 @@ namespace toy2d {
     DescriptorSetManager::SetInfo DescriptorSetManager::AllocImageSet() {
         std::vector<vk::DescriptorSetLayout> layouts{ Shader::GetInstance().GetDescriptorSetLayouts()[1]};
         vk::DescriptorSetAllocateInfo allocInfo;
-        auto& poolInfo = getAvaliableImagePoolInfo();
+        uint32_t poolIndex = getAvaliableImagePool();
+        auto& poolInfo = imageSetPools_[poolIndex];
         allocInfo.setDescriptorPool(poolInfo.pool_)
             .setDescriptorSetCount(1)
             .setSetLayouts(layouts);
@@ -74,45 +90,84 @@ namespace toy2d {
         SetInfo result;
         result.pool = poolInfo.pool_;
         result.set = sets[0];
+        result.poolIndex = poolIndex;
 
-        poolInfo.remainNum_ = std::max<int>(static_cast<int>(poolInfo.remainNum_) - sets.size(), 0);
-        if (poolInfo.remainNum_ == 0) {
-            fulledImageSetPool_.push_back(poolInfo);
-            avalibleImageSetPool_.pop_back();
+        // the pool leaves the list when its last set is taken, it is always the back
+        if (--poolInfo.remainNum_ == 0) {
+            avalibleImageSetPools_.pop_back();
         }
 
         return result;
     }
 
     void DescriptorSetManager::FreeImageSet(const SetInfo& info) {
-        auto it = std::find_if(fulledImageSetPool_.begin(), fulledImageSetPool_.end(),
-            [&](const PoolInfo& poolInfo) {
-                return poolInfo.pool_ == info.pool;
-            });
-        if (it != fulledImageSetPool_.end()) {
-            it->remainNum_++;
-            avalibleImageSetPool_.push_back(*it);
-            fulledImageSetPool_.erase(it);
-            return;
+        auto& poolInfo = imageSetPools_[info.poolIndex];
+        Context::GetInstance().device.freeDescriptorSets(poolInfo.pool_, info.set);
+
+        // a full pool has room again
+        if (poolInfo.remainNum_++ == 0) {
+            avalibleImageSetPools_.push_back(info.poolIndex);
+        }
+    }
+
+    vk::DescriptorPool DescriptorSetManager::createTransientPool() {
+        constexpr uint32_t MaxSetNum = 256;
+
+        // no eFreeDescriptorSet, the pool is only ever reset as a whole
+        std::array<vk::DescriptorPoolSize, 4> sizes;
+        sizes[0].setType(vk::DescriptorType::eUniformBuffer).setDescriptorCount(MaxSetNum);
+        sizes[1].setType(vk::DescriptorType::eCombinedImageSampler).setDescriptorCount(MaxSetNum);
+        sizes[2].setType(vk::DescriptorType::eStorageBuffer).setDescriptorCount(MaxSetNum);
+        sizes[3].setType(vk::DescriptorType::eStorageImage).setDescriptorCount(MaxSetNum / 4);
+        vk::DescriptorPoolCreateInfo createInfo;
+        createInfo.setMaxSets(MaxSetNum)
+            .setPoolSizes(sizes);
+        return Context::GetInstance().device.createDescriptorPool(createInfo);
+    }
+
+    vk::DescriptorSet DescriptorSetManager::AllocTransientSet(vk::DescriptorSetLayout layout) {
+        auto& device = Context::GetInstance().device;
+        auto& frame = transientFrames_[transientFrame_];
+
+        vk::DescriptorSetAllocateInfo allocInfo;
+        allocInfo.setDescriptorSetCount(1)
+            .setSetLayouts(layout);
+        vk::DescriptorSet set;
+        // a full pool moves on to the next one, pools only grow until the frames stop needing more
+        while (true) {
+            bool created = frame.current_ == frame.pools_.size();
+            if (created) {
+                frame.pools_.push_back(createTransientPool());
+            }
+            allocInfo.setDescriptorPool(frame.pools_[frame.current_]);
+            auto result = device.allocateDescriptorSets(&allocInfo, &set);
+            if (result == vk::Result::eSuccess) {
+                return set;
+            }
+            if (created || (result != vk::Result::eErrorOutOfPoolMemory && result != vk::Result::eErrorFragmentedPool)) {
+                throw std::runtime_error("Allocate transient descriptor set failed!");
+            }
+            frame.current_++;
         }
+    }
 
-        it = std::find_if(avalibleImageSetPool_.begin(), avalibleImageSetPool_.end(),
-            [&](const PoolInfo& poolInfo) {
-                return poolInfo.pool_ == info.pool;
-            });
-        if (it != avalibleImageSetPool_.end()) {
-            it->remainNum_++;
-            return;
+    void DescriptorSetManager::BeginFrame(uint32_t frameIndex) {
+        auto& device = Context::GetInstance().device;
+        transientFrame_ = frameIndex;
+        auto& frame = transientFrames_[frameIndex];
+        // pools behind current_ were filled, current_ itself may hold a few sets
+        uint32_t used = std::min<uint32_t>(frame.current_ + 1, (uint32_t)frame.pools_.size());
+        for (uint32_t i = 0; i < used; i++) {
+            device.resetDescriptorPool(frame.pools_[i]);
         }
-        Context::GetInstance().device.freeDescriptorSets(info.pool, info.set);
+        frame.current_ = 0;
     }
 
-    DescriptorSetManager::PoolInfo& DescriptorSetManager::getAvaliableImagePoolInfo() {
-        if (avalibleImageSetPool_.empty()) {
+    uint32_t DescriptorSetManager::getAvaliableImagePool() {
+        if (avalibleImageSetPools_.empty()) {
             addImageSetPool();
-            return avalibleImageSetPool_.back();
         }
-        return avalibleImageSetPool_.back();
+        return avalibleImageSetPools_.back();
     }
 
 }
@@ -0,0 +1,492 @@
+#include "toy2d/font.hpp"
+#include "toy2d/context.hpp"
+#include "toy2d/shader.hpp"
+#include "toy2d/stb_image.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace toy2d {
+
+	namespace {
+		constexpr float Far = 1e20f;
+
+		// one dimensional squared distance transform of f (Felzenszwalb and Huttenlocher), the
+		// lower envelope of the parabolas rooted at every sample
+		void distance1D(const float* f, float* d, int n, int* v, float* z) {
+			int k = 0;
+			v[0] = 0;
+			z[0] = -Far;
+			z[1] = Far;
+			for (int q = 1; q < n; q++) {
+				float s;
+				for (;;) {
+					int p = v[k];
+					s = ((f[q] + float(q * q)) - (f[p] + float(p * p))) / float(2 * q - 2 * p);
+					if (s > z[k] || k == 0) break;
+					k--;
+				}
+				k++;
+				v[k] = q;
+				z[k] = s;
+				z[k + 1] = Far;
+			}
+			k = 0;
+			for (int q = 0; q < n; q++) {
+				while (z[k + 1] < float(q)) k++;
+				float dq = float(q - v[k]);
+				d[q] = dq * dq + f[v[k]];
+			}
+		}
+
+		// squared distance of every sample to the nearest zero sample, in place
+		void distance2D(std::vector<float>& grid, int size) {
+			std::vector<float> f(size), d(size), z(size + 1);
+			std::vector<int> v(size);
+			for (int x = 0; x < size; x++) {
+				for (int y = 0; y < size; y++) f[y] = grid[y * size + x];
+				distance1D(f.data(), d.data(), size, v.data(), z.data());
+				for (int y = 0; y < size; y++) grid[y * size + x] = d[y];
+			}
+			for (int y = 0; y < size; y++) {
+				float* row = grid.data() + y * size;
+				std::copy(row, row + size, f.begin());
+				distance1D(f.data(), row, size, v.data(), z.data());
+			}
+		}
+
+		// malformed sequences come out as U+FFFD
+		uint32_t nextCodepoint(std::string_view s, size_t& i) {
+			auto byte = [&](size_t at) { return uint32_t(static_cast<unsigned char>(s[at])); };
+			uint32_t c = byte(i++);
+			if (c < 0x80) return c;
+			int extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : -1;
+			if (extra < 0) return 0xFFFD;
+			uint32_t cp = c & (0x3F >> extra);
+			for (int n = 0; n < extra; n++) {
+				if (i >= s.size() || (byte(i) & 0xC0) != 0x80) return 0xFFFD;
+				cp = (cp << 6) | (byte(i++) & 0x3F);
+			}
+			return cp;
+		}
+	}
+
+	GridFontSource::GridFontSource(const std::string& filename, uint32_t columns, uint32_t rows, uint32_t firstCodepoint)
+		: columns_(columns), count_(columns * rows), firstCodepoint_(firstCodepoint) {
+		int w, h, channel;
+		stbi_uc* pixels = stbi_load(filename.c_str(), &w, &h, &channel, STBI_rgb_alpha);
+		if (!pixels || w <= 0 || h <= 0 || columns == 0 || rows == 0) {
+			throw std::runtime_error("Load font image failed!");
+		}
+		width_ = uint32_t(w);
+		cellWidth_ = uint32_t(w) / columns;
+		cellHeight_ = uint32_t(h) / rows;
+
+		bool hasAlpha = channel == 2 || channel == 4;
+		coverage_.resize(size_t(w) * h);
+		for (size_t i = 0; i < coverage_.size(); i++) {
+			coverage_[i] = hasAlpha ? pixels[i * 4 + 3] : pixels[i * 4];
+		}
+		stbi_image_free(pixels);
+	}
+
+	bool GridFontSource::Rasterize(uint32_t codepoint, GlyphBitmap& out) {
+		if (codepoint < firstCodepoint_ || codepoint - firstCodepoint_ >= count_) {
+			return false;
+		}
+		uint32_t index = codepoint - firstCodepoint_;
+		uint32_t left = index % columns_ * cellWidth_;
+		uint32_t top = index / columns_ * cellHeight_;
+
+		out.advance = float(cellWidth_);
+		out.bearingX = 0;
+		out.bearingY = float(cellHeight_);
+		out.width = cellWidth_;
+		out.height = cellHeight_;
+		out.coverage.resize(size_t(cellWidth_) * cellHeight_);
+		bool empty = true;
+		for (uint32_t y = 0; y < cellHeight_; y++) {
+			const std::uint8_t* src = coverage_.data() + size_t(top + y) * width_ + left;
+			std::memcpy(out.coverage.data() + size_t(y) * cellWidth_, src, cellWidth_);
+			empty = empty && std::all_of(src, src + cellWidth_, [](std::uint8_t c) { return c == 0; });
+		}
+		if (empty) {
+			// a space, nothing to put in the atlas
+			out.width = out.height = 0;
+			out.coverage.clear();
+		}
+		return true;
+	}
+
+	uint32_t Font::nextId_ = 1;
+
+	Font::Font(std::unique_ptr<GlyphSource> source, int maxFlightCount, uint32_t atlasSize)
+		: source_(std::move(source)), maxFlightCount_(maxFlightCount), id_(nextId_++), atlasSize_(atlasSize) {
+		auto& ctx = Context::GetInstance();
+
+		cellSize_ = uint32_t(std::ceil(source_->RasterSize())) + Spread * 2;
+		cellsPerSide_ = atlasSize_ / cellSize_;
+		if (cellsPerSide_ == 0) {
+			throw std::runtime_error("Font atlas is smaller than one glyph!");
+		}
+		cells_.resize(size_t(cellsPerSide_) * cellsPerSide_);
+		for (uint32_t i = uint32_t(cells_.size()); i > 0; i--) {
+			freeCells_.push_back(i - 1);
+		}
+		stats_.cells = uint32_t(cells_.size());
+
+		createAtlas();
+		createPipelineState();
+
+		uploadCmds_ = ctx.commandManager->CreateCommandBuffers(maxFlightCount_);
+		stagingBuffers_.resize(maxFlightCount_);
+		for (auto& buffer : stagingBuffers_) {
+			buffer.reset(new Buffer(size_t(MaxUploadsPerFrame) * cellSize_ * cellSize_,
+				vk::BufferUsageFlagBits::eTransferSrc,
+				vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+		}
+
+		// queued now, so it is usually compiled before the first DrawText
+		pipeline();
+	}
+
+	Font::~Font() {
+		auto& ctx = Context::GetInstance();
+		auto& device = ctx.device;
+		device.waitIdle();
+
+		for (auto cmd : uploadCmds_) {
+			ctx.commandManager->freeCmds(cmd);
+		}
+		stagingBuffers_.clear();
+		if (set_.set) {
+			DescriptorSetManager::Instance().FreeImageSet(set_);
+		}
+		device.destroyShaderModule(vertModule_);
+		device.destroyShaderModule(fragModule_);
+		device.destroyImageView(view_);
+		device.destroyImage(image_);
+		device.freeMemory(memory_);
+	}
+
+	void Font::createAtlas() {
+		auto& ctx = Context::GetInstance();
+		auto& device = ctx.device;
+
+		vk::ImageCreateInfo imageInfo;
+		imageInfo.setImageType(vk::ImageType::e2D)
+			.setArrayLayers(1)
+			.setMipLevels(1)
+			.setExtent({ atlasSize_, atlasSize_, 1 })
+			.setFormat(vk::Format::eR8Unorm)
+			.setTiling(vk::ImageTiling::eOptimal)
+			.setInitialLayout(vk::ImageLayout::eUndefined)
+			.setUsage(vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled)
+			.setSamples(vk::SampleCountFlagBits::e1);
+		image_ = device.createImage(imageInfo);
+
+		auto requirements = device.getImageMemoryRequirements(image_);
+		vk::MemoryAllocateInfo allocInfo;
+		allocInfo.setAllocationSize(requirements.size)
+			.setMemoryTypeIndex(QueryBufferMemTypeIndex(requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal));
+		memory_ = device.allocateMemory(allocInfo);
+		device.bindImageMemory(image_, memory_, 0);
+
+		vk::ImageSubresourceRange range;
+		range.setAspectMask(vk::ImageAspectFlagBits::eColor)
+			.setBaseMipLevel(0)
+			.setLevelCount(1)
+			.setBaseArrayLayer(0)
+			.setLayerCount(1);
+		vk::ImageViewCreateInfo viewInfo;
+		viewInfo.setImage(image_)
+			.setViewType(vk::ImageViewType::e2D)
+			.setFormat(vk::Format::eR8Unorm)
+			.setSubresourceRange(range);
+		view_ = device.createImageView(viewInfo);
+
+		// cleared to "far outside", so filtering across a cell border reads nothing
+		ctx.commandManager->ExecuteCmd(ctx.graphics_queue,
+			[&](vk::CommandBuffer cmdBuf) {
+				vk::ImageMemoryBarrier barrier;
+				barrier.setImage(image_)
+					.setOldLayout(vk::ImageLayout::eUndefined)
+					.setNewLayout(vk::ImageLayout::eTransferDstOptimal)
+					.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+					.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+					.setDstAccessMask(vk::AccessFlagBits::eTransferWrite)
+					.setSubresourceRange(range);
+				cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
+					{}, {}, nullptr, barrier);
+				cmdBuf.clearColorImage(image_, vk::ImageLayout::eTransferDstOptimal,
+					vk::ClearColorValue(std::array<float, 4>{ 0, 0, 0, 0 }), range);
+				barrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+					.setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+					.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+					.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+				cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader,
+					{}, {}, nullptr, barrier);
+			});
+
+		if (!ctx.usePushDescriptors) {
+			set_ = DescriptorSetManager::Instance().AllocImageSet();
+			Shader::DescriptorData data;
+			data.image = VkDescriptorImageInfo{
+				static_cast<VkSampler>(ctx.sampler),
+				static_cast<VkImageView>(view_),
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+			Shader::GetInstance().UpdateDescriptorSet(set_.set, 1, &data);
+		}
+	}
+
+	void Font::createPipelineState() {
+		// the sprite pipeline layout, the atlas takes the place of the texture in set 1
+		vertModule_ = Shader::CreateModule(ReadWholeFile(GetShaderPath("text_vert.spv")));
+		fragModule_ = Shader::CreateModule(ReadWholeFile(GetShaderPath("text_frag.spv")));
+		input_.bindings = { Vertex::GetBinding(), GlyphInstance::GetBinding() };
+		input_.attributes = Vertex::GetAttribute();
+		auto instanceAttr = GlyphInstance::GetAttribute();
+		input_.attributes.insert(input_.attributes.end(), instanceAttr.begin(), instanceAttr.end());
+	}
+
+	vk::Pipeline Font::pipeline() {
+		auto& renderProcess = Context::GetInstance().renderProcess;
+		PipelineKey key;
+		key.layout = renderProcess->layout;
+		key.vertex = vertModule_;
+		key.fragment = fragModule_;
+		key.input = &input_;
+		if (renderProcess->HasDepth()) {
+			key.depth = DepthMode::Test;
+		}
+		return renderProcess->pipelines.TryGet(key);
+	}
+
+	void Font::bind(vk::CommandBuffer cmd, vk::PipelineLayout layout) const {
+		auto& ctx = Context::GetInstance();
+		if (!ctx.usePushDescriptors) {
+			cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 1, set_.set, {});
+			return;
+		}
+
+		vk::DescriptorImageInfo imageInfo;
+		imageInfo.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+			.setImageView(view_)
+			.setSampler(ctx.sampler);
+		vk::WriteDescriptorSet writer;
+		writer.setImageInfo(imageInfo)
+			.setDstBinding(0)
+			.setDstArrayElement(0)
+			.setDescriptorCount(1)
+			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+		ctx.cmdPushDescriptorSet(static_cast<VkCommandBuffer>(cmd), VK_PIPELINE_BIND_POINT_GRAPHICS,
+			static_cast<VkPipelineLayout>(layout), 1, 1, reinterpret_cast<const VkWriteDescriptorSet*>(&writer));
+	}
+
+	void Font::beginFrame(uint64_t frame, int flightIndex) {
+		// the fence of this frame slot was waited, its staging buffer is idle
+		frame_ = frame;
+		flightIndex_ = flightIndex;
+		uploads_.clear();
+	}
+
+	const Font::Glyph* Font::acquire(uint32_t codepoint) {
+		auto it = glyphs_.find(codepoint);
+		if (it != glyphs_.end()) {
+			uint32_t cell = it->second.cell;
+			if (cell != NoCell && cells_[cell].lastUsedFrame != frame_) {
+				cells_[cell].lastUsedFrame = frame_;
+				lru_.splice(lru_.end(), lru_, cells_[cell].lruIt);
+			}
+			return &it->second;
+		}
+
+		if (uploads_.size() >= MaxUploadsPerFrame) {
+			stats_.dropped++;
+			return nullptr;
+		}
+		Glyph glyph;
+		if (!rasterize(codepoint, glyph)) {
+			stats_.dropped++;
+			return nullptr;
+		}
+		return &(glyphs_[codepoint] = glyph);
+	}
+
+	uint32_t Font::acquireCell() {
+		if (!freeCells_.empty()) {
+			uint32_t cell = freeCells_.back();
+			freeCells_.pop_back();
+			return cell;
+		}
+		if (lru_.empty()) return NoCell;
+
+		// frames in flight may still sample the least recently used cell
+		uint32_t cell = lru_.front();
+		if (cells_[cell].lastUsedFrame + maxFlightCount_ > frame_) return NoCell;
+		glyphs_.erase(cells_[cell].codepoint);
+		lru_.pop_front();
+		stats_.evictions++;
+		stats_.residentGlyphs--;
+		return cell;
+	}
+
+	bool Font::rasterize(uint32_t codepoint, Glyph& glyph) {
+		GlyphBitmap bitmap;
+		if (!source_->Rasterize(codepoint, bitmap)) {
+			// cached as empty, so a missing glyph is looked up only once
+			glyph.advance = source_->RasterSize() * 0.5f;
+			return true;
+		}
+		glyph.advance = bitmap.advance;
+		uint32_t maxSize = cellSize_ - Spread * 2;
+		uint32_t w = std::min(bitmap.width, maxSize);
+		uint32_t h = std::min(bitmap.height, maxSize);
+		if (w == 0 || h == 0) {
+			return true;
+		}
+
+		uint32_t cell = acquireCell();
+		if (cell == NoCell) {
+			return false;
+		}
+		cells_[cell].codepoint = codepoint;
+		cells_[cell].lastUsedFrame = frame_;
+		cells_[cell].lruIt = lru_.insert(lru_.end(), cell);
+		stats_.residentGlyphs++;
+		stats_.rasterized++;
+
+		// the field covers the whole cell, the bitmap sits Spread pixels in from the top left
+		glyph.cell = cell;
+		glyph.x0 = bitmap.bearingX - float(Spread);
+		glyph.y0 = -bitmap.bearingY - float(Spread);
+		glyph.x1 = glyph.x0 + float(cellSize_);
+		glyph.y1 = glyph.y0 + float(cellSize_);
+
+		int size = int(cellSize_);
+		std::vector<float> outside(size_t(size) * size, Far);
+		std::vector<float> inside(size_t(size) * size, 0.0f);
+		for (uint32_t y = 0; y < h; y++) {
+			for (uint32_t x = 0; x < w; x++) {
+				if (bitmap.coverage[size_t(y) * bitmap.width + x] < 128) continue;
+				size_t at = size_t(y + Spread) * size + x + Spread;
+				outside[at] = 0.0f;
+				inside[at] = Far;
+			}
+		}
+		distance2D(outside, size);
+		distance2D(inside, size);
+
+		// 0.5 is the edge, 1 is Spread pixels inside, 0 Spread pixels outside
+		size_t offset = uploads_.size() * cellSize_ * cellSize_;
+		auto* dst = static_cast<std::uint8_t*>(stagingBuffers_[flightIndex_]->map) + offset;
+		for (size_t i = 0; i < outside.size(); i++) {
+			float distance = std::sqrt(outside[i]) - std::sqrt(inside[i]);
+			float value = std::clamp(0.5f - distance / float(Spread * 2), 0.0f, 1.0f);
+			dst[i] = std::uint8_t(value * 255.0f + 0.5f);
+		}
+
+		vk::ImageSubresourceLayers subsource;
+		subsource.setAspectMask(vk::ImageAspectFlagBits::eColor)
+			.setBaseArrayLayer(0)
+			.setMipLevel(0)
+			.setLayerCount(1);
+		vk::BufferImageCopy region;
+		region.setBufferOffset(offset)
+			.setBufferRowLength(0)
+			.setBufferImageHeight(0)
+			.setImageOffset({ int32_t(cell % cellsPerSide_ * cellSize_), int32_t(cell / cellsPerSide_ * cellSize_), 0 })
+			.setImageExtent({ cellSize_, cellSize_, 1 })
+			.setImageSubresource(subsource);
+		uploads_.push_back(region);
+		return true;
+	}
+
+	void Font::layout(std::string_view utf8, float x, float y, float size, PackedColor color, float depth,
+		std::vector<GlyphInstance>& out, Rect& bounds) {
+		float scale = size / source_->RasterSize();
+		float texel = 1.0f / float(atlasSize_);
+		float cellUv = float(cellSize_) * texel;
+		float penX = x;
+		float penY = y;
+		bounds = Rect{ x, y, x, y };
+
+		size_t i = 0;
+		while (i < utf8.size()) {
+			uint32_t codepoint = nextCodepoint(utf8, i);
+			if (codepoint == '\n') {
+				penX = x;
+				penY += source_->LineHeight() * scale;
+				continue;
+			}
+			const Glyph* glyph = acquire(codepoint);
+			if (!glyph) continue;
+
+			if (glyph->cell != NoCell) {
+				GlyphInstance instance;
+				instance.x = penX + glyph->x0 * scale;
+				instance.y = penY + glyph->y0 * scale;
+				instance.w = (glyph->x1 - glyph->x0) * scale;
+				instance.h = (glyph->y1 - glyph->y0) * scale;
+				instance.u0 = float(glyph->cell % cellsPerSide_) * cellUv;
+				instance.v0 = float(glyph->cell / cellsPerSide_) * cellUv;
+				instance.u1 = instance.u0 + cellUv;
+				instance.v1 = instance.v0 + cellUv;
+				instance.color = color;
+				instance.depth = depth;
+				out.push_back(instance);
+
+				bounds.minX = std::min(bounds.minX, instance.x);
+				bounds.minY = std::min(bounds.minY, instance.y);
+				bounds.maxX = std::max(bounds.maxX, instance.x + instance.w);
+				bounds.maxY = std::max(bounds.maxY, instance.y + instance.h);
+			}
+			penX += glyph->advance * scale;
+		}
+	}
+
+	void Font::flush() {
+		if (uploads_.empty()) return;
+
+		// submitted ahead of the frame's command buffer on the same queue like the virtual
+		// texture pages, the frame fence covers this submit as well
+		auto& ctx = Context::GetInstance();
+		auto cmd = uploadCmds_[flightIndex_];
+		cmd.reset();
+		vk::CommandBufferBeginInfo beginInfo;
+		beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+		cmd.begin(beginInfo);
+
+		vk::ImageSubresourceRange range;
+		range.setAspectMask(vk::ImageAspectFlagBits::eColor)
+			.setBaseMipLevel(0)
+			.setLevelCount(1)
+			.setBaseArrayLayer(0)
+			.setLayerCount(1);
+		// cells being written were last used by frames that already finished
+		vk::ImageMemoryBarrier barrier;
+		barrier.setImage(image_)
+			.setOldLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+			.setNewLayout(vk::ImageLayout::eTransferDstOptimal)
+			.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+			.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+			.setDstAccessMask(vk::AccessFlagBits::eTransferWrite)
+			.setSubresourceRange(range);
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader, vk::PipelineStageFlagBits::eTransfer,
+			{}, {}, nullptr, barrier);
+		cmd.copyBufferToImage(stagingBuffers_[flightIndex_]->buffer, image_, vk::ImageLayout::eTransferDstOptimal, uploads_);
+		barrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+			.setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+			.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader,
+			{}, {}, nullptr, barrier);
+		cmd.end();
+
+		vk::SubmitInfo submitInfo;
+		submitInfo.setCommandBuffers(cmd);
+		ctx.graphics_queue.submit(submitInfo);
+		uploads_.clear();
+	}
+
+}
@@ -0,0 +1,712 @@
+#include "toy2d/frame_graph.hpp"
+#include "toy2d/buffer.hpp"
+#include "toy2d/context.hpp"
+#include "toy2d/descriptor_manager.hpp"
+#include "toy2d/shader.hpp"
+#include <algorithm>
+
+namespace toy2d {
+
+	namespace {
+		struct AccessInfo {
+			vk::ImageLayout layout;
+			vk::PipelineStageFlags stages;
+			vk::AccessFlags access;
+			vk::ImageUsageFlags usage;
+			bool write;
+		};
+
+		AccessInfo accessInfo(ImageAccess access) {
+			using Stage = vk::PipelineStageFlagBits;
+			using Access = vk::AccessFlagBits;
+			using Usage = vk::ImageUsageFlagBits;
+			switch (access) {
+			case ImageAccess::ColorAttachment:
+				return { vk::ImageLayout::eColorAttachmentOptimal, Stage::eColorAttachmentOutput,
+					Access::eColorAttachmentRead | Access::eColorAttachmentWrite, Usage::eColorAttachment, true };
+			case ImageAccess::DepthAttachment:
+				return { vk::ImageLayout::eDepthStencilAttachmentOptimal, Stage::eEarlyFragmentTests | Stage::eLateFragmentTests,
+					Access::eDepthStencilAttachmentRead | Access::eDepthStencilAttachmentWrite, Usage::eDepthStencilAttachment, true };
+			case ImageAccess::Sampled:
+				return { vk::ImageLayout::eShaderReadOnlyOptimal, Stage::eFragmentShader | Stage::eComputeShader,
+					Access::eShaderRead, Usage::eSampled, false };
+			case ImageAccess::StorageRead:
+				return { vk::ImageLayout::eGeneral, Stage::eComputeShader, Access::eShaderRead, Usage::eStorage, false };
+			case ImageAccess::StorageWrite:
+				return { vk::ImageLayout::eGeneral, Stage::eComputeShader, Access::eShaderWrite, Usage::eStorage, true };
+			case ImageAccess::TransferSrc:
+				return { vk::ImageLayout::eTransferSrcOptimal, Stage::eTransfer, Access::eTransferRead, Usage::eTransferSrc, false };
+			case ImageAccess::TransferDst:
+			default:
+				return { vk::ImageLayout::eTransferDstOptimal, Stage::eTransfer, Access::eTransferWrite, Usage::eTransferDst, true };
+			}
+		}
+
+		bool isAttachment(ImageAccess access) {
+			return access == ImageAccess::ColorAttachment || access == ImageAccess::DepthAttachment;
+		}
+	}
+
+	void FrameGraph::Builder::Read(Handle image, ImageAccess access) {
+		if (accessInfo(access).write) {
+			throw std::runtime_error("Frame graph read with a write access");
+		}
+		graph_.addAccess(pass_, image, access);
+	}
+
+	void FrameGraph::Builder::Write(Handle image, ImageAccess access) {
+		if (!accessInfo(access).write) {
+			throw std::runtime_error("Frame graph write with a read access");
+		}
+		graph_.addAccess(pass_, image, access);
+	}
+
+	void FrameGraph::Builder::Clear(Handle image, const std::array<float, 4>& clear) {
+		auto& pass = graph_.passes_[pass_];
+		for (auto& access : pass.accesses) {
+			if (access.image != image) continue;
+			if (!isAttachment(access.access)) break;
+			access.clear = true;
+			if (access.access == ImageAccess::ColorAttachment) {
+				pass.clearColor = clear;
+			}
+			return;
+		}
+		throw std::runtime_error("Frame graph pass " + pass.name + " clears an image it doesn't render into");
+	}
+
+	void FrameGraph::Builder::SideEffect() {
+		graph_.passes_[pass_].sideEffect = true;
+	}
+
+	FrameGraph::FrameGraph(RenderTargetPool& pool, int maxFlightCount) : pool_(pool), slots_(maxFlightCount) {}
+
+	FrameGraph::~FrameGraph() {
+		auto& device = Context::GetInstance().device;
+		device.waitIdle();
+
+		for (auto& slot : slots_) {
+			destroySlot(slot);
+		}
+		for (auto& fb : framebuffers_) {
+			device.destroyFramebuffer(fb.framebuffer);
+		}
+		for (auto& pass : renderPasses_) {
+			device.destroyRenderPass(pass.renderPass);
+		}
+	}
+
+	FrameGraph::Handle FrameGraph::CreateImage(std::string name, vk::Extent2D extent, vk::Format format) {
+		if (extent.width == 0 || extent.height == 0) {
+			throw std::runtime_error("Frame graph image " + name + " is empty");
+		}
+		Resource resource;
+		resource.name = std::move(name);
+		resource.desc = RenderTargetDesc{ extent, format, {} };
+		resources_.push_back(std::move(resource));
+		return Handle(resources_.size() - 1);
+	}
+
+	FrameGraph::Handle FrameGraph::Import(std::string name, RenderTarget& target) {
+		Resource resource;
+		resource.name = std::move(name);
+		resource.desc = target.GetDesc();
+		resource.imported = &target;
+		resource.image = target.GetImage();
+		resource.view = target.GetView();
+		resources_.push_back(std::move(resource));
+		return Handle(resources_.size() - 1);
+	}
+
+	void FrameGraph::AddPass(std::string name, SetupFunc setup, ExecuteFunc execute) {
+		Pass pass;
+		pass.name = std::move(name);
+		pass.execute = std::move(execute);
+		passes_.push_back(std::move(pass));
+		Builder builder(*this, uint32_t(passes_.size() - 1));
+		setup(builder);
+
+		// one render pass per graph pass, laid out like the ones of RenderTargetPool
+		auto& added = passes_.back();
+		uint32_t colors = 0, depths = 0;
+		vk::Extent2D extent;
+		for (auto& access : added.accesses) {
+			if (!isAttachment(access.access)) continue;
+			auto& desc = resources_[access.image].desc;
+			bool depth = access.access == ImageAccess::DepthAttachment;
+			if (depth != IsDepthFormat(desc.format) || (colors + depths > 0 && !(extent == desc.extent))) {
+				throw std::runtime_error("Frame graph pass " + added.name + " has mismatched attachments");
+			}
+			extent = desc.extent;
+			(depth ? depths : colors)++;
+		}
+		if (colors > 1 || depths > 1 || (depths == 1 && colors == 0)) {
+			throw std::runtime_error("Frame graph pass " + added.name + " needs one color and at most one depth attachment");
+		}
+	}
+
+	void FrameGraph::addAccess(uint32_t pass, Handle image, ImageAccess access) {
+		auto& p = passes_[pass];
+		if (image >= resources_.size()) {
+			throw std::runtime_error("Frame graph pass " + p.name + " uses an unknown image");
+		}
+		for (auto& a : p.accesses) {
+			if (a.image == image) {
+				throw std::runtime_error("Frame graph pass " + p.name + " uses " + resources_[image].name + " twice");
+			}
+		}
+		p.accesses.push_back(Access{ image, access });
+	}
+
+	vk::Image FrameGraph::GetImage(Handle image) const {
+		return resources_[image].image;
+	}
+
+	vk::ImageView FrameGraph::GetView(Handle image) const {
+		return resources_[image].view;
+	}
+
+	vk::Extent2D FrameGraph::GetExtent(Handle image) const {
+		return resources_[image].desc.extent;
+	}
+
+	void FrameGraph::Bind(vk::CommandBuffer cmd, Handle image, vk::PipelineLayout layout, uint32_t setIndex) const {
+		auto& ctx = Context::GetInstance();
+		vk::DescriptorImageInfo imageInfo;
+		imageInfo.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+			.setImageView(resources_[image].view)
+			.setSampler(ctx.sampler);
+		if (!ctx.usePushDescriptors) {
+			// the views of transient images change with the graph, a set per bind is the simplest
+			auto set = DescriptorSetManager::Instance().AllocTransientSet(Shader::GetInstance().GetDescriptorSetLayouts()[1]);
+			Shader::DescriptorData data;
+			data.image = imageInfo;
+			Shader::GetInstance().UpdateDescriptorSet(set, 1, &data);
+			cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, setIndex, set, {});
+			return;
+		}
+
+		vk::WriteDescriptorSet writer;
+		writer.setImageInfo(imageInfo)
+			.setDstBinding(0)
+			.setDstArrayElement(0)
+			.setDescriptorCount(1)
+			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+		ctx.cmdPushDescriptorSet(static_cast<VkCommandBuffer>(cmd), VK_PIPELINE_BIND_POINT_GRAPHICS,
+			static_cast<VkPipelineLayout>(layout), setIndex, 1, reinterpret_cast<const VkWriteDescriptorSet*>(&writer));
+	}
+
+	void FrameGraph::beginFrame(int slot, uint64_t frame) {
+		slot_ = slot;
+		frame_ = frame;
+		resources_.clear();
+		passes_.clear();
+		order_.clear();
+
+		auto& device = Context::GetInstance().device;
+		for (size_t i = 0; i < framebuffers_.size();) {
+			if (framebuffers_[i].lastUsedFrame + MaxFramebufferIdleFrames <= frame_) {
+				device.destroyFramebuffer(framebuffers_[i].framebuffer);
+				framebuffers_[i] = framebuffers_.back();
+				framebuffers_.pop_back();
+			} else {
+				i++;
+			}
+		}
+	}
+
+	void FrameGraph::record(vk::CommandBuffer cmd) {
+		stats_ = Stats{};
+		if (passes_.empty()) return;
+
+		cull();
+		schedule();
+		allocate();
+		for (uint32_t i = 0; i < order_.size(); i++) {
+			recordPass(cmd, i);
+		}
+		stats_.passes = uint32_t(order_.size());
+
+		// imported targets are left for the frame's render pass to sample
+		std::vector<vk::ImageMemoryBarrier> barriers;
+		vk::PipelineStageFlags srcStages, dstStages;
+		for (Handle h = 0; h < resources_.size(); h++) {
+			auto& resource = resources_[h];
+			if (!resource.imported || resource.first == None) continue;
+			if (resource.desc.usage & vk::ImageUsageFlagBits::eSampled) {
+				transition(h, ImageAccess::Sampled, barriers, srcStages, dstStages);
+			}
+			pool_.Touch(*resource.imported);
+		}
+		if (!barriers.empty()) {
+			cmd.pipelineBarrier(srcStages ? srcStages : vk::PipelineStageFlagBits::eTopOfPipe, dstStages,
+				{}, {}, {}, barriers);
+			stats_.barriers += uint32_t(barriers.size());
+			stats_.barrierBatches++;
+		}
+	}
+
+	void FrameGraph::cull() {
+		// which pass wrote each image last and who read it since, in declaration order
+		std::vector<uint32_t> lastWriter(resources_.size(), None);
+		std::vector<std::vector<uint32_t>> readers(resources_.size());
+		for (uint32_t p = 0; p < passes_.size(); p++) {
+			auto& pass = passes_[p];
+			for (auto& access : pass.accesses) {
+				auto& resource = resources_[access.image];
+				uint32_t writer = lastWriter[access.image];
+				if (!accessInfo(access.access).write) {
+					if (writer == None && !resource.imported) {
+						throw std::runtime_error("Frame graph pass " + pass.name + " reads " + resource.name + " before anything wrote it");
+					}
+					if (writer != None) {
+						pass.dataDeps.push_back(writer);
+						pass.orderDeps.push_back(writer);
+					}
+					readers[access.image].push_back(p);
+					continue;
+				}
+
+				if (writer != None) {
+					// an attachment that isn't cleared, storage and transfer writes keep what was there
+					if (!access.clear) pass.dataDeps.push_back(writer);
+					pass.orderDeps.push_back(writer);
+				}
+				for (uint32_t reader : readers[access.image]) {
+					if (reader != p) pass.orderDeps.push_back(reader);
+				}
+				readers[access.image].clear();
+				lastWriter[access.image] = p;
+			}
+		}
+
+		// what imported targets end up holding and passes with side effects is all that's needed
+		std::vector<uint32_t> stack;
+		for (uint32_t p = 0; p < passes_.size(); p++) {
+			auto& pass = passes_[p];
+			bool root = pass.sideEffect;
+			for (auto& access : pass.accesses) {
+				root |= resources_[access.image].imported && accessInfo(access.access).write;
+			}
+			if (root) {
+				pass.kept = true;
+				stack.push_back(p);
+			}
+		}
+		while (!stack.empty()) {
+			uint32_t p = stack.back();
+			stack.pop_back();
+			for (uint32_t dep : passes_[p].dataDeps) {
+				if (!passes_[dep].kept) {
+					passes_[dep].kept = true;
+					stack.push_back(dep);
+				}
+			}
+		}
+		for (auto& pass : passes_) {
+			if (!pass.kept) stats_.culled++;
+		}
+	}
+
+	void FrameGraph::schedule() {
+		// topological order over the kept passes. among the ready ones the pass using the most
+		// recently recorded results goes first, which keeps transient lifetimes short and lets
+		// more of them share memory. ties keep declaration order
+		std::vector<uint32_t> pending(passes_.size(), 0);
+		std::vector<uint32_t> position(passes_.size(), None);
+		std::vector<uint32_t> ready;
+		for (uint32_t p = 0; p < passes_.size(); p++) {
+			auto& pass = passes_[p];
+			if (!pass.kept) continue;
+			auto& deps = pass.orderDeps;
+			deps.erase(std::remove_if(deps.begin(), deps.end(), [&](uint32_t d) { return !passes_[d].kept; }), deps.end());
+			std::sort(deps.begin(), deps.end());
+			deps.erase(std::unique(deps.begin(), deps.end()), deps.end());
+			pending[p] = uint32_t(deps.size());
+			if (deps.empty()) ready.push_back(p);
+		}
+
+		while (!ready.empty()) {
+			size_t best = 0;
+			int64_t bestScore = -1;
+			for (size_t i = 0; i < ready.size(); i++) {
+				int64_t score = -1;
+				for (uint32_t dep : passes_[ready[i]].orderDeps) {
+					score = std::max<int64_t>(score, position[dep]);
+				}
+				if (score > bestScore || (score == bestScore && ready[i] < ready[best])) {
+					best = i;
+					bestScore = score;
+				}
+			}
+			uint32_t p = ready[best];
+			ready.erase(ready.begin() + best);
+			position[p] = uint32_t(order_.size());
+			order_.push_back(p);
+
+			for (uint32_t q = 0; q < passes_.size(); q++) {
+				if (!passes_[q].kept || position[q] != None) continue;
+				auto& deps = passes_[q].orderDeps;
+				if (std::find(deps.begin(), deps.end(), p) != deps.end() && --pending[q] == 0) {
+					ready.push_back(q);
+				}
+			}
+		}
+	}
+
+	void FrameGraph::allocate() {
+		for (uint32_t i = 0; i < order_.size(); i++) {
+			for (auto& access : passes_[order_[i]].accesses) {
+				auto& resource = resources_[access.image];
+				if (resource.first == None) resource.first = i;
+				resource.last = i;
+				auto usage = accessInfo(access.access).usage;
+				if (!resource.imported) {
+					resource.desc.usage |= usage;
+				} else if (!(resource.desc.usage & usage)) {
+					throw std::runtime_error("Frame graph target " + resource.name + " lacks the usage a pass needs");
+				}
+			}
+		}
+
+		std::vector<Handle> transients;
+		std::vector<Lifetime> lifetimes;
+		for (Handle h = 0; h < resources_.size(); h++) {
+			auto& resource = resources_[h];
+			if (resource.first == None) continue;
+			if (resource.imported) {
+				// frames still in flight may sample the target, the first write or layout change
+				// waits for that like the external dependency of RenderTargetPool's render passes
+				resource.state.readStages = vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader;
+				// DrawToTarget and graphs of earlier frames leave sampled targets shader readable
+				auto& first = passes_[order_[resource.first]];
+				for (auto& access : first.accesses) {
+					if (access.image == h && !accessInfo(access.access).write) {
+						resource.state.layout = vk::ImageLayout::eShaderReadOnlyOptimal;
+					}
+				}
+				continue;
+			}
+			transients.push_back(h);
+			lifetimes.push_back(Lifetime{ resource.desc, resource.first, resource.last });
+		}
+
+		auto& slot = slots_[slot_];
+		if (!(slot.lifetimes == lifetimes)) {
+			// the fence of the slot was waited, nothing uses its images anymore
+			destroySlot(slot);
+			slot.lifetimes = lifetimes;
+
+			auto& ctx = Context::GetInstance();
+			auto& device = ctx.device;
+			std::vector<vk::MemoryRequirements> requirements(lifetimes.size());
+			for (size_t i = 0; i < lifetimes.size(); i++) {
+				auto& desc = lifetimes[i].desc;
+				vk::ImageCreateInfo imageInfo;
+				imageInfo.setImageType(vk::ImageType::e2D)
+					.setArrayLayers(1)
+					.setMipLevels(1)
+					.setExtent({ desc.extent.width, desc.extent.height, 1 })
+					.setFormat(desc.format)
+					.setTiling(vk::ImageTiling::eOptimal)
+					.setInitialLayout(vk::ImageLayout::eUndefined)
+					.setUsage(desc.usage)
+					.setSamples(vk::SampleCountFlagBits::e1);
+				Transient image;
+				image.image = device.createImage(imageInfo);
+				requirements[i] = device.getImageMemoryRequirements(image.image);
+				image.size = requirements[i].size;
+				image.block = None;
+				image.aliasOf = None;
+				slot.images.push_back(image);
+			}
+
+			// greedy by first use: an image takes over the block whose last user is done before it
+			// starts, the smallest one that fits or else the biggest, which then grows
+			struct Candidate {
+				vk::DeviceSize size = 0;
+				uint32_t typeBits;
+				uint32_t freeAfter;
+				uint32_t occupant;
+			};
+			std::vector<Candidate> candidates;
+			std::vector<uint32_t> byFirst(lifetimes.size());
+			for (uint32_t i = 0; i < byFirst.size(); i++) byFirst[i] = i;
+			std::stable_sort(byFirst.begin(), byFirst.end(),
+				[&](uint32_t a, uint32_t b) { return lifetimes[a].first < lifetimes[b].first; });
+			for (uint32_t i : byFirst) {
+				auto& req = requirements[i];
+				uint32_t best = None;
+				for (uint32_t b = 0; b < candidates.size(); b++) {
+					auto& c = candidates[b];
+					if (c.freeAfter >= lifetimes[i].first || !(c.typeBits & req.memoryTypeBits)) continue;
+					if (best == None) {
+						best = b;
+						continue;
+					}
+					auto& current = candidates[best];
+					bool fits = c.size >= req.size, currentFits = current.size >= req.size;
+					if ((fits && (!currentFits || c.size < current.size)) || (!fits && !currentFits && c.size > current.size)) {
+						best = b;
+					}
+				}
+				if (best == None) {
+					candidates.push_back(Candidate{ 0, ~0u, 0, None });
+					best = uint32_t(candidates.size() - 1);
+				}
+				auto& c = candidates[best];
+				c.size = std::max(c.size, req.size);
+				c.typeBits &= req.memoryTypeBits;
+				c.freeAfter = lifetimes[i].last;
+				slot.images[i].block = best;
+				slot.images[i].aliasOf = c.occupant;
+				c.occupant = i;
+			}
+
+			for (auto& c : candidates) {
+				vk::MemoryAllocateInfo allocInfo;
+				allocInfo.setAllocationSize(c.size)
+					.setMemoryTypeIndex(QueryBufferMemTypeIndex(c.typeBits, vk::MemoryPropertyFlagBits::eDeviceLocal));
+				slot.blocks.push_back(Block{ device.allocateMemory(allocInfo), c.size });
+			}
+			for (size_t i = 0; i < slot.images.size(); i++) {
+				auto& image = slot.images[i];
+				auto& desc = lifetimes[i].desc;
+				device.bindImageMemory(image.image, slot.blocks[image.block].memory, 0);
+
+				vk::ImageSubresourceRange range;
+				range.setAspectMask(IsDepthFormat(desc.format) ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor)
+					.setBaseMipLevel(0)
+					.setLevelCount(1)
+					.setBaseArrayLayer(0)
+					.setLayerCount(1);
+				vk::ImageViewCreateInfo viewInfo;
+				viewInfo.setImage(image.image)
+					.setViewType(vk::ImageViewType::e2D)
+					.setFormat(desc.format)
+					.setSubresourceRange(range);
+				image.view = device.createImageView(viewInfo);
+			}
+		}
+
+		for (size_t i = 0; i < transients.size(); i++) {
+			auto& resource = resources_[transients[i]];
+			auto& image = slot.images[i];
+			resource.image = image.image;
+			resource.view = image.view;
+			resource.aliasOf = image.aliasOf == None ? None : transients[image.aliasOf];
+			stats_.unaliasedMemory += image.size;
+		}
+		stats_.transientImages = uint32_t(transients.size());
+		stats_.memoryBlocks = uint32_t(slot.blocks.size());
+		for (auto& block : slot.blocks) {
+			stats_.transientMemory += block.size;
+		}
+	}
+
+	void FrameGraph::destroySlot(Slot& slot) {
+		auto& device = Context::GetInstance().device;
+		for (auto& image : slot.images) {
+			for (size_t i = 0; i < framebuffers_.size();) {
+				if (framebuffers_[i].color == image.view || framebuffers_[i].depth == image.view) {
+					device.destroyFramebuffer(framebuffers_[i].framebuffer);
+					framebuffers_[i] = framebuffers_.back();
+					framebuffers_.pop_back();
+				} else {
+					i++;
+				}
+			}
+			device.destroyImageView(image.view);
+			device.destroyImage(image.image);
+		}
+		for (auto& block : slot.blocks) {
+			device.freeMemory(block.memory);
+		}
+		slot.lifetimes.clear();
+		slot.images.clear();
+		slot.blocks.clear();
+	}
+
+	void FrameGraph::transition(Handle image, ImageAccess access, std::vector<vk::ImageMemoryBarrier>& barriers,
+		vk::PipelineStageFlags& srcStages, vk::PipelineStageFlags& dstStages) {
+		auto& resource = resources_[image];
+		auto& state = resource.state;
+		auto info = accessInfo(access);
+		bool layoutChange = state.layout != info.layout;
+		// readers in the same layout only wait once for the write before them
+		if (!info.write && !layoutChange && (state.visibleStages & info.stages) == info.stages) {
+			state.readStages |= info.stages;
+			return;
+		}
+
+		vk::PipelineStageFlags src = state.writeStages;
+		vk::AccessFlags srcAccess = state.writeAccess;
+		if (info.write || layoutChange) {
+			// write after read, a layout transition counts as a write
+			src |= state.readStages;
+		}
+		if (state.layout == vk::ImageLayout::eUndefined && resource.aliasOf != None) {
+			// the memory was someone else's, their last use has to finish first
+			auto& previous = resources_[resource.aliasOf].state;
+			src |= previous.writeStages | previous.readStages;
+			srcAccess |= previous.writeAccess;
+		}
+
+		vk::ImageSubresourceRange range;
+		range.setAspectMask(IsDepthFormat(resource.desc.format) ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor)
+			.setBaseMipLevel(0)
+			.setLevelCount(1)
+			.setBaseArrayLayer(0)
+			.setLayerCount(1);
+		vk::ImageMemoryBarrier barrier;
+		barrier.setImage(resource.image)
+			.setOldLayout(state.layout)
+			.setNewLayout(info.layout)
+			.setSrcAccessMask(srcAccess)
+			.setDstAccessMask(info.access)
+			.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+			.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+			.setSubresourceRange(range);
+		barriers.push_back(barrier);
+		srcStages |= src;
+		dstStages |= info.stages;
+
+		if (info.write) {
+			state.writeStages = info.stages;
+			state.writeAccess = info.access;
+			state.readStages = {};
+			state.visibleStages = {};
+		} else {
+			state.readStages |= info.stages;
+			state.visibleStages = layoutChange ? info.stages : state.visibleStages | info.stages;
+		}
+		state.layout = info.layout;
+	}
+
+	void FrameGraph::recordPass(vk::CommandBuffer cmd, uint32_t position) {
+		auto& pass = passes_[order_[position]];
+
+		// load and store ops follow from what the graph knows about the attachments
+		RenderPassKey key{ vk::Format::eUndefined, vk::Format::eUndefined,
+			vk::AttachmentLoadOp::eDontCare, vk::AttachmentLoadOp::eDontCare,
+			vk::AttachmentStoreOp::eDontCare, vk::AttachmentStoreOp::eDontCare };
+		Handle color = None, depth = None;
+		for (auto& access : pass.accesses) {
+			if (!isAttachment(access.access)) continue;
+			auto& resource = resources_[access.image];
+			auto load = access.clear ? vk::AttachmentLoadOp::eClear :
+				resource.state.layout == vk::ImageLayout::eUndefined ? vk::AttachmentLoadOp::eDontCare : vk::AttachmentLoadOp::eLoad;
+			auto store = resource.imported || resource.last > position ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare;
+			if (access.access == ImageAccess::ColorAttachment) {
+				color = access.image;
+				key.color = resource.desc.format;
+				key.colorLoad = load;
+				key.colorStore = store;
+			} else {
+				depth = access.image;
+				key.depth = resource.desc.format;
+				key.depthLoad = load;
+				key.depthStore = store;
+			}
+		}
+
+		// every image the pass touches in one barrier
+		std::vector<vk::ImageMemoryBarrier> barriers;
+		vk::PipelineStageFlags srcStages, dstStages;
+		for (auto& access : pass.accesses) {
+			transition(access.image, access.access, barriers, srcStages, dstStages);
+		}
+		if (!barriers.empty()) {
+			cmd.pipelineBarrier(srcStages ? srcStages : vk::PipelineStageFlagBits::eTopOfPipe, dstStages,
+				{}, {}, {}, barriers);
+			stats_.barriers += uint32_t(barriers.size());
+			stats_.barrierBatches++;
+		}
+
+		if (color == None) {
+			pass.execute(cmd, *this);
+			return;
+		}
+
+		auto extent = resources_[color].desc.extent;
+		auto renderPass = this->renderPass(key);
+		std::array<vk::ClearValue, 2> clearValues;
+		clearValues[0].setColor(vk::ClearColorValue(pass.clearColor));
+		clearValues[1].setDepthStencil(vk::ClearDepthStencilValue(0.0f, 0));
+		vk::RenderPassBeginInfo passBeginInfo;
+		passBeginInfo.setRenderPass(renderPass)
+			.setFramebuffer(framebuffer(renderPass, resources_[color].view, depth == None ? nullptr : resources_[depth].view, extent))
+			.setRenderArea(vk::Rect2D({ 0, 0 }, extent))
+			.setClearValueCount(depth == None ? 1 : 2)
+			.setPClearValues(clearValues.data());
+		cmd.beginRenderPass(passBeginInfo, vk::SubpassContents::eInline);
+		cmd.setViewport(0, vk::Viewport(0, 0, float(extent.width), float(extent.height), 0, 1));
+		cmd.setScissor(0, vk::Rect2D({ 0, 0 }, extent));
+		pass.execute(cmd, *this);
+		cmd.endRenderPass();
+	}
+
+	vk::RenderPass FrameGraph::renderPass(const RenderPassKey& key) {
+		for (auto& pass : renderPasses_) {
+			if (pass.key == key) return pass.renderPass;
+		}
+
+		// the graph's barriers do the layout transitions, the pass keeps the attachment layouts
+		std::vector<vk::AttachmentDescription> attachments(1);
+		attachments[0].setFormat(key.color)
+			.setInitialLayout(vk::ImageLayout::eColorAttachmentOptimal)
+			.setFinalLayout(vk::ImageLayout::eColorAttachmentOptimal)
+			.setLoadOp(key.colorLoad)
+			.setStoreOp(key.colorStore)
+			.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+			.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
+			.setSamples(vk::SampleCountFlagBits::e1);
+		vk::AttachmentReference colorReference(0, vk::ImageLayout::eColorAttachmentOptimal);
+		vk::AttachmentReference depthReference(1, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+		vk::SubpassDescription subpass;
+		subpass.setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
+			.setColorAttachments(colorReference);
+		if (key.depth != vk::Format::eUndefined) {
+			vk::AttachmentDescription depthDesc;
+			depthDesc.setFormat(key.depth)
+				.setInitialLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
+				.setFinalLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
+				.setLoadOp(key.depthLoad)
+				.setStoreOp(key.depthStore)
+				.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+				.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
+				.setSamples(vk::SampleCountFlagBits::e1);
+			attachments.push_back(depthDesc);
+			subpass.setPDepthStencilAttachment(&depthReference);
+		}
+
+		vk::RenderPassCreateInfo passInfo;
+		passInfo.setAttachments(attachments)
+			.setSubpasses(subpass);
+		auto pass = Context::GetInstance().device.createRenderPass(passInfo);
+		renderPasses_.push_back(CachedPass{ key, pass });
+		return pass;
+	}
+
+	vk::Framebuffer FrameGraph::framebuffer(vk::RenderPass pass, vk::ImageView color, vk::ImageView depth, vk::Extent2D extent) {
+		for (auto& fb : framebuffers_) {
+			if (fb.renderPass == pass && fb.color == color && fb.depth == depth) {
+				fb.lastUsedFrame = frame_;
+				return fb.framebuffer;
+			}
+		}
+
+		std::vector<vk::ImageView> views = { color };
+		if (depth) views.push_back(depth);
+		vk::FramebufferCreateInfo createInfo;
+		createInfo.setRenderPass(pass)
+			.setAttachments(views)
+			.setWidth(extent.width)
+			.setHeight(extent.height)
+			.setLayers(1);
+		auto framebuffer = Context::GetInstance().device.createFramebuffer(createInfo);
+		framebuffers_.push_back(CachedFramebuffer{ pass, color, depth, framebuffer, frame_ });
+		return framebuffer;
+	}
+
+}
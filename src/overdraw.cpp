@@ -0,0 +1,341 @@
+#include "toy2d/overdraw.hpp"
+#include "toy2d/context.hpp"
+#include "toy2d/shader.hpp"
+#include <array>
+
+namespace toy2d {
+
+	namespace {
+		// blends on every device, counts stay exact up to 2048
+		constexpr vk::Format HeatFormat = vk::Format::eR16Sfloat;
+		constexpr uint32_t ReduceGroupSize = 16;
+	}
+
+	OverdrawMeter::OverdrawMeter(int maxFlightCount) : maxFlightCount_(maxFlightCount) {
+		auto& ctx = Context::GetInstance();
+
+		createRenderPass();
+		createDescriptors();
+		createReducePipeline();
+		fragModule_ = Shader::CreateModule(ReadWholeFile(GetShaderPath("overdraw_frag.spv")));
+
+		frames_.resize(maxFlightCount_);
+		for (auto& frame : frames_) {
+			frame.result.reset(new Buffer(sizeof(Result),
+				vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+				vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+		}
+		createTarget();
+
+		if (ctx.pipelineStatisticsSupported) {
+			vk::QueryPoolCreateInfo queryInfo;
+			queryInfo.setQueryType(vk::QueryType::ePipelineStatistics)
+				.setQueryCount(maxFlightCount_)
+				.setPipelineStatistics(vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations);
+			queryPool_ = ctx.device.createQueryPool(queryInfo);
+		}
+	}
+
+	OverdrawMeter::~OverdrawMeter() {
+		auto& device = Context::GetInstance().device;
+		device.waitIdle();
+
+		pipelines_.Clear();
+		destroyTarget();
+		frames_.clear();
+		if (queryPool_) {
+			device.destroyQueryPool(queryPool_);
+		}
+		device.destroyPipeline(reducePipeline_);
+		device.destroyPipelineLayout(reduceLayout_);
+		device.destroyShaderModule(reduceModule_);
+		device.destroyShaderModule(fragModule_);
+		device.destroyDescriptorPool(descriptorPool_);
+		device.destroyDescriptorSetLayout(setLayout_);
+		device.destroyRenderPass(renderPass_);
+	}
+
+	void OverdrawMeter::createRenderPass() {
+		vk::AttachmentDescription attachDesc;
+		attachDesc.setFormat(HeatFormat)
+			.setInitialLayout(vk::ImageLayout::eUndefined)
+			.setFinalLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+			.setLoadOp(vk::AttachmentLoadOp::eClear)
+			.setStoreOp(vk::AttachmentStoreOp::eStore)
+			.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+			.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
+			.setSamples(vk::SampleCountFlagBits::e1);
+
+		vk::AttachmentReference reference;
+		reference.setLayout(vk::ImageLayout::eColorAttachmentOptimal)
+			.setAttachment(0);
+		vk::SubpassDescription passDesc;
+		passDesc.setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
+			.setColorAttachments(reference);
+
+		// the clear waits for the previous frame's reduce, the reduce for this pass
+		std::array<vk::SubpassDependency, 2> dependencies;
+		dependencies[0].setSrcSubpass(VK_SUBPASS_EXTERNAL)
+			.setDstSubpass(0)
+			.setSrcStageMask(vk::PipelineStageFlagBits::eComputeShader)
+			.setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
+			.setDstAccessMask(vk::AccessFlagBits::eColorAttachmentWrite);
+		dependencies[1].setSrcSubpass(0)
+			.setDstSubpass(VK_SUBPASS_EXTERNAL)
+			.setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
+			.setDstStageMask(vk::PipelineStageFlagBits::eComputeShader)
+			.setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+
+		vk::RenderPassCreateInfo passInfo;
+		passInfo.setAttachments(attachDesc)
+			.setSubpasses(passDesc)
+			.setDependencies(dependencies);
+		renderPass_ = Context::GetInstance().device.createRenderPass(passInfo);
+	}
+
+	void OverdrawMeter::createDescriptors() {
+		auto& device = Context::GetInstance().device;
+
+		std::array<vk::DescriptorSetLayoutBinding, 2> bindings;
+		bindings[0].setBinding(0)
+			.setDescriptorCount(1)
+			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+			.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+		bindings[1].setBinding(1)
+			.setDescriptorCount(1)
+			.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+			.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+		vk::DescriptorSetLayoutCreateInfo layoutInfo;
+		layoutInfo.setBindings(bindings);
+		setLayout_ = device.createDescriptorSetLayout(layoutInfo);
+
+		std::array<vk::DescriptorPoolSize, 2> sizes;
+		sizes[0].setType(vk::DescriptorType::eCombinedImageSampler)
+			.setDescriptorCount(maxFlightCount_);
+		sizes[1].setType(vk::DescriptorType::eStorageBuffer)
+			.setDescriptorCount(maxFlightCount_);
+		vk::DescriptorPoolCreateInfo poolInfo;
+		poolInfo.setMaxSets(maxFlightCount_)
+			.setPoolSizes(sizes);
+		descriptorPool_ = device.createDescriptorPool(poolInfo);
+	}
+
+	void OverdrawMeter::createReducePipeline() {
+		auto& device = Context::GetInstance().device;
+
+		vk::PushConstantRange range;
+		range.setOffset(0)
+			.setSize(sizeof(uint32_t) * 2)
+			.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+		vk::PipelineLayoutCreateInfo layoutInfo;
+		layoutInfo.setSetLayouts(setLayout_)
+			.setPushConstantRanges(range);
+		reduceLayout_ = device.createPipelineLayout(layoutInfo);
+
+		reduceModule_ = Shader::CreateModule(ReadWholeFile(GetShaderPath("overdraw_reduce_comp.spv")));
+		vk::PipelineShaderStageCreateInfo stage;
+		stage.setStage(vk::ShaderStageFlagBits::eCompute)
+			.setModule(reduceModule_)
+			.setPName("main");
+		vk::ComputePipelineCreateInfo createInfo;
+		createInfo.setStage(stage)
+			.setLayout(reduceLayout_);
+		auto result = device.createComputePipeline(nullptr, createInfo);
+		if (result.result != vk::Result::eSuccess) {
+			throw std::runtime_error("Create overdraw reduce pipeline failed!");
+		}
+		reducePipeline_ = result.value;
+	}
+
+	void OverdrawMeter::createTarget() {
+		auto& ctx = Context::GetInstance();
+		auto& device = ctx.device;
+		extent_ = ctx.swapchain->info.imageExtent;
+
+		vk::ImageCreateInfo imageInfo;
+		imageInfo.setImageType(vk::ImageType::e2D)
+			.setArrayLayers(1)
+			.setMipLevels(1)
+			.setExtent({ extent_.width, extent_.height, 1 })
+			.setFormat(HeatFormat)
+			.setTiling(vk::ImageTiling::eOptimal)
+			.setInitialLayout(vk::ImageLayout::eUndefined)
+			.setUsage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled)
+			.setSamples(vk::SampleCountFlagBits::e1);
+		image_ = device.createImage(imageInfo);
+
+		auto requirements = device.getImageMemoryRequirements(image_);
+		vk::MemoryAllocateInfo allocInfo;
+		allocInfo.setAllocationSize(requirements.size)
+			.setMemoryTypeIndex(QueryBufferMemTypeIndex(requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal));
+		memory_ = device.allocateMemory(allocInfo);
+		device.bindImageMemory(image_, memory_, 0);
+
+		vk::ImageSubresourceRange range;
+		range.setAspectMask(vk::ImageAspectFlagBits::eColor)
+			.setBaseMipLevel(0)
+			.setLevelCount(1)
+			.setBaseArrayLayer(0)
+			.setLayerCount(1);
+		vk::ImageViewCreateInfo viewInfo;
+		viewInfo.setImage(image_)
+			.setViewType(vk::ImageViewType::e2D)
+			.setFormat(HeatFormat)
+			.setSubresourceRange(range);
+		view_ = device.createImageView(viewInfo);
+
+		vk::FramebufferCreateInfo framebufferInfo;
+		framebufferInfo.setAttachments(view_)
+			.setWidth(extent_.width).setHeight(extent_.height)
+			.setRenderPass(renderPass_)
+			.setLayers(1);
+		framebuffer_ = device.createFramebuffer(framebufferInfo);
+
+		writeSets();
+	}
+
+	void OverdrawMeter::destroyTarget() {
+		auto& device = Context::GetInstance().device;
+		device.destroyFramebuffer(framebuffer_);
+		device.destroyImageView(view_);
+		device.destroyImage(image_);
+		device.freeMemory(memory_);
+	}
+
+	void OverdrawMeter::writeSets() {
+		auto& ctx = Context::GetInstance();
+
+		for (auto& frame : frames_) {
+			if (!frame.set) {
+				vk::DescriptorSetAllocateInfo allocInfo;
+				allocInfo.setDescriptorPool(descriptorPool_)
+					.setSetLayouts(setLayout_);
+				frame.set = ctx.device.allocateDescriptorSets(allocInfo)[0];
+			}
+
+			// texelFetch ignores the filtering of the shared sampler
+			vk::DescriptorImageInfo imageInfo;
+			imageInfo.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+				.setImageView(view_)
+				.setSampler(ctx.sampler);
+			vk::DescriptorBufferInfo bufferInfo;
+			bufferInfo.setBuffer(frame.result->buffer)
+				.setOffset(0)
+				.setRange(VK_WHOLE_SIZE);
+			std::array<vk::WriteDescriptorSet, 2> writers;
+			writers[0].setImageInfo(imageInfo)
+				.setDstBinding(0)
+				.setDstArrayElement(0)
+				.setDstSet(frame.set)
+				.setDescriptorCount(1)
+				.setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+			writers[1].setBufferInfo(bufferInfo)
+				.setDstBinding(1)
+				.setDstArrayElement(0)
+				.setDstSet(frame.set)
+				.setDescriptorCount(1)
+				.setDescriptorType(vk::DescriptorType::eStorageBuffer);
+			ctx.device.updateDescriptorSets(writers, {});
+		}
+	}
+
+	bool OverdrawMeter::ReadResults(int slot, OverdrawStats& stats) {
+		auto& frame = frames_[slot];
+		if (frame.frame == 0) return false;
+
+		auto result = (const Result*)frame.result->map;
+		stats.frame = frame.frame;
+		stats.averageOverdraw = float(result->sum) / float(uint64_t(extent_.width) * extent_.height);
+		stats.maxOverdraw = result->maxCount;
+		stats.fragmentInvocations = 0;
+		if (frame.queried) {
+			uint64_t invocations = 0;
+			auto status = Context::GetInstance().device.getQueryPoolResults(queryPool_, slot, 1, sizeof(invocations), &invocations,
+				sizeof(invocations), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+			if (status == vk::Result::eSuccess) {
+				stats.fragmentInvocations = invocations;
+			}
+		}
+		return true;
+	}
+
+	void OverdrawMeter::BeginStatistics(vk::CommandBuffer cmd, int slot, uint64_t frame) {
+		auto& f = frames_[slot];
+		f.frame = frame;
+		f.queried = bool(queryPool_);
+		if (!queryPool_) return;
+		cmd.resetQueryPool(queryPool_, slot, 1);
+		cmd.beginQuery(queryPool_, slot, {});
+	}
+
+	void OverdrawMeter::EndStatistics(vk::CommandBuffer cmd, int slot) {
+		if (!queryPool_) return;
+		cmd.endQuery(queryPool_, slot);
+	}
+
+	void OverdrawMeter::BeginHeatPass(vk::CommandBuffer cmd) {
+		auto& ctx = Context::GetInstance();
+		auto extent = ctx.swapchain->info.imageExtent;
+		if (extent.width != extent_.width || extent.height != extent_.height) {
+			// frames in flight may still read the old target, a resize is rare enough to wait
+			ctx.device.waitIdle();
+			pipelines_.Clear();
+			destroyTarget();
+			createTarget();
+		}
+
+		vk::ClearValue clearValue;
+		clearValue.setColor(vk::ClearColorValue(std::array<float, 4>{ 0.0f, 0.0f, 0.0f, 0.0f }));
+		vk::RenderPassBeginInfo passBeginInfo;
+		passBeginInfo.setRenderPass(renderPass_)
+			.setRenderArea(vk::Rect2D({ 0, 0 }, extent_))
+			.setFramebuffer(framebuffer_)
+			.setClearValues(clearValue);
+		cmd.beginRenderPass(passBeginInfo, vk::SubpassContents::eInline);
+		// the heat pipelines are made for renderPass_, their viewport and scissor are dynamic
+		cmd.setViewport(0, vk::Viewport(0, 0, float(extent_.width), float(extent_.height), 0, 1));
+		cmd.setScissor(0, vk::Rect2D({ 0, 0 }, extent_));
+	}
+
+	void OverdrawMeter::EndHeatPass(vk::CommandBuffer cmd, int slot) {
+		cmd.endRenderPass();
+
+		auto& frame = frames_[slot];
+		cmd.fillBuffer(frame.result->buffer, 0, sizeof(Result), 0);
+		vk::BufferMemoryBarrier barrier;
+		barrier.setBuffer(frame.result->buffer)
+			.setOffset(0)
+			.setSize(VK_WHOLE_SIZE)
+			.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite)
+			.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+			.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader,
+			{}, {}, barrier, {});
+
+		std::array<uint32_t, 2> extent = { extent_.width, extent_.height };
+		cmd.bindPipeline(vk::PipelineBindPoint::eCompute, reducePipeline_);
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, reduceLayout_, 0, frame.set, {});
+		cmd.pushConstants(reduceLayout_, vk::ShaderStageFlagBits::eCompute, 0, sizeof(extent), extent.data());
+		cmd.dispatch((extent_.width + ReduceGroupSize - 1) / ReduceGroupSize, (extent_.height + ReduceGroupSize - 1) / ReduceGroupSize, 1);
+
+		// read on the host after the frame's fence
+		barrier.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eHostRead);
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eHost,
+			{}, {}, barrier, {});
+	}
+
+	vk::Pipeline OverdrawMeter::GetHeatPipeline(vk::PipelineLayout layout, vk::ShaderModule vertex, const VertexInput& input) {
+		PipelineKey key;
+		key.layout = layout;
+		key.vertex = vertex;
+		key.fragment = fragModule_;
+		key.input = &input;
+		key.blend = BlendMode::Additive;
+		key.renderPass = renderPass_;
+		return pipelines_.Get(key);
+	}
+
+}
@@ -0,0 +1,302 @@
+#include "toy2d/particles.hpp"
+#include "toy2d/context.hpp"
+#include "toy2d/shader.hpp"
+#include "toy2d/vertex.hpp"
+#include "glm/glm.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+
+namespace toy2d {
+
+	namespace {
+		constexpr uint32_t GroupSize = 64;
+
+		// matches the push constants of shader/particles.comp
+		struct ComputeParams {
+			uint32_t stage;
+			uint32_t capacity;
+			uint32_t emitCount;
+			uint32_t seed;
+			uint32_t source;	// buffer the live particles are read from
+			float dt;
+			float x, y;
+			float radius;
+			float direction, spread;	// radians
+			float minSpeed, maxSpeed;
+			float minLifetime, maxLifetime;
+			float pad0;	// std430 aligns the shader's vec2 gravity to 8 bytes
+			float gravityX, gravityY;
+			float drag;
+		};
+		static_assert(offsetof(ComputeParams, x) == 24 && offsetof(ComputeParams, gravityX) == 64 &&
+			offsetof(ComputeParams, drag) == 72 && sizeof(ComputeParams) == 76, "ComputeParams must match the std430 layout");
+	}
+
+	ParticleSystem::ParticleSystem(Texture& texture, uint32_t capacity, int maxFlightCount)
+		: texture_(&texture), capacity_(std::max(capacity, 1u)), maxFlightCount_(maxFlightCount) {
+		createBuffers();
+		createDescriptors();
+		createPipelines();
+	}
+
+	ParticleSystem::~ParticleSystem() {
+		auto& device = Context::GetInstance().device;
+		device.waitIdle();
+
+		particles_[0].reset();
+		particles_[1].reset();
+		state_.reset();
+		readbacks_.clear();
+
+		device.destroyPipeline(computePipeline_);
+		device.destroyPipelineLayout(computeLayout_);
+		device.destroyShaderModule(computeModule_);
+		device.destroyPipelineLayout(pipelineLayout_);
+		device.destroyShaderModule(vertModule_);
+		device.destroyDescriptorPool(descriptorPool_);
+		device.destroyDescriptorSetLayout(computeSetLayout_);
+		device.destroyDescriptorSetLayout(drawSetLayout_);
+	}
+
+	void ParticleSystem::createBuffers() {
+		auto& ctx = Context::GetInstance();
+
+		for (auto& buffer : particles_) {
+			buffer.reset(new Buffer(sizeof(Particle) * capacity_,
+				vk::BufferUsageFlagBits::eStorageBuffer,
+				vk::MemoryPropertyFlagBits::eDeviceLocal));
+		}
+		state_.reset(new Buffer(sizeof(State),
+			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer |
+			vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
+			vk::MemoryPropertyFlagBits::eDeviceLocal));
+		readbacks_.resize(maxFlightCount_);
+		for (auto& buffer : readbacks_) {
+			buffer.reset(new Buffer(sizeof(uint32_t),
+				vk::BufferUsageFlagBits::eTransferDst,
+				vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+		}
+		readbackValid_.assign(maxFlightCount_, false);
+
+		// no particles and an empty dispatch to start with
+		ctx.commandManager->ExecuteCmd(ctx.graphics_queue, [&](vk::CommandBuffer& cmd) {
+			cmd.fillBuffer(state_->buffer, 0, sizeof(State), 0);
+		});
+	}
+
+	void ParticleSystem::createDescriptors() {
+		auto& device = Context::GetInstance().device;
+
+		// source particles, target particles and the state
+		std::array<vk::DescriptorSetLayoutBinding, 3> computeBindings;
+		for (uint32_t i = 0; i < computeBindings.size(); i++) {
+			computeBindings[i].setBinding(i)
+				.setDescriptorCount(1)
+				.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+				.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+		}
+		vk::DescriptorSetLayoutCreateInfo layoutInfo;
+		layoutInfo.setBindings(computeBindings);
+		computeSetLayout_ = device.createDescriptorSetLayout(layoutInfo);
+
+		vk::DescriptorSetLayoutBinding drawBinding;
+		drawBinding.setBinding(0)
+			.setDescriptorCount(1)
+			.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+			.setStageFlags(vk::ShaderStageFlagBits::eVertex);
+		layoutInfo.setBindings(drawBinding);
+		drawSetLayout_ = device.createDescriptorSetLayout(layoutInfo);
+
+		// one compute and one draw set per direction, they never change
+		vk::DescriptorPoolSize size;
+		size.setType(vk::DescriptorType::eStorageBuffer)
+			.setDescriptorCount(2 * ((uint32_t)computeBindings.size() + 1));
+		vk::DescriptorPoolCreateInfo poolInfo;
+		poolInfo.setMaxSets(4)
+			.setPoolSizes(size);
+		descriptorPool_ = device.createDescriptorPool(poolInfo);
+
+		std::array<vk::DescriptorSetLayout, 4> setLayouts = { computeSetLayout_, computeSetLayout_, drawSetLayout_, drawSetLayout_ };
+		vk::DescriptorSetAllocateInfo allocInfo;
+		allocInfo.setDescriptorPool(descriptorPool_)
+			.setSetLayouts(setLayouts);
+		auto sets = device.allocateDescriptorSets(allocInfo);
+
+		std::array<vk::DescriptorBufferInfo, 8> bufferInfos;
+		std::array<vk::WriteDescriptorSet, 8> writers;
+		for (uint32_t source = 0; source < 2; source++) {
+			computeSets_[source] = sets[source];
+			drawSets_[source] = sets[2 + source];
+
+			vk::DescriptorBufferInfo* infos = &bufferInfos[source * 4];
+			infos[0].setBuffer(particles_[source]->buffer).setOffset(0).setRange(VK_WHOLE_SIZE);
+			infos[1].setBuffer(particles_[1 - source]->buffer).setOffset(0).setRange(VK_WHOLE_SIZE);
+			infos[2].setBuffer(state_->buffer).setOffset(0).setRange(VK_WHOLE_SIZE);
+			infos[3].setBuffer(particles_[source]->buffer).setOffset(0).setRange(VK_WHOLE_SIZE);
+			for (uint32_t i = 0; i < 4; i++) {
+				writers[source * 4 + i].setBufferInfo(infos[i])
+					.setDstBinding(i < 3 ? i : 0)
+					.setDstArrayElement(0)
+					.setDstSet(i < 3 ? computeSets_[source] : drawSets_[source])
+					.setDescriptorCount(1)
+					.setDescriptorType(vk::DescriptorType::eStorageBuffer);
+			}
+		}
+		device.updateDescriptorSets(writers, {});
+	}
+
+	void ParticleSystem::createPipelines() {
+		auto& device = Context::GetInstance().device;
+		auto& shader = Shader::GetInstance();
+
+		vk::PushConstantRange computeRange;
+		computeRange.setOffset(0)
+			.setSize(sizeof(ComputeParams))
+			.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+		vk::PipelineLayoutCreateInfo layoutInfo;
+		layoutInfo.setSetLayouts(computeSetLayout_)
+			.setPushConstantRanges(computeRange);
+		computeLayout_ = device.createPipelineLayout(layoutInfo);
+
+		computeModule_ = Shader::CreateModule(ReadWholeFile(GetShaderPath("particles_comp.spv")));
+		vk::PipelineShaderStageCreateInfo stage;
+		stage.setStage(vk::ShaderStageFlagBits::eCompute)
+			.setModule(computeModule_)
+			.setPName("main");
+		vk::ComputePipelineCreateInfo createInfo;
+		createInfo.setStage(stage)
+			.setLayout(computeLayout_);
+		auto result = device.createComputePipeline(nullptr, createInfo);
+		if (result.result != vk::Result::eSuccess) {
+			throw std::runtime_error("Create particle pipeline failed!");
+		}
+		computePipeline_ = result.value;
+
+		// like Scene: the sprite sets, the particles in set 2, and the look in push constants
+		std::array<vk::DescriptorSetLayout, 3> setLayouts = {
+			shader.GetDescriptorSetLayouts()[0], shader.GetDescriptorSetLayouts()[1], drawSetLayout_ };
+		vk::PushConstantRange drawRange;
+		drawRange.setOffset(0)
+			.setSize(sizeof(DrawParams))
+			.setStageFlags(vk::ShaderStageFlagBits::eVertex);
+		layoutInfo.setSetLayouts(setLayouts)
+			.setPushConstantRanges(drawRange);
+		pipelineLayout_ = device.createPipelineLayout(layoutInfo);
+
+		// only the unit quad comes through vertex input, gl_InstanceIndex picks the particle
+		vertModule_ = Shader::CreateModule(ReadWholeFile(GetShaderPath("particles_vert.spv")));
+		input_.bindings = { Vertex::GetBinding() };
+		input_.attributes = Vertex::GetAttribute();
+
+		// queued now, so it is usually compiled before the first draw
+		pipeline();
+	}
+
+	void ParticleSystem::Update(float dt) {
+		dt_ += dt;
+		emitCarry_ += emitter_.rate * dt;
+	}
+
+	void ParticleSystem::simulate(vk::CommandBuffer cmd, int flightIndex, uint64_t frame) {
+		// a second DrawParticles in the same frame draws the same particles
+		if (frame_ == frame) return;
+		frame_ = frame;
+
+		// the fence of this frame slot was waited, the count copied by its last frame is readable
+		if (readbackValid_[flightIndex]) {
+			aliveCount_ = *(uint32_t*)readbacks_[flightIndex]->map;
+		}
+
+		uint32_t fromRate = (uint32_t)emitCarry_;
+		emitCarry_ -= float(fromRate);
+		uint32_t emitCount = (uint32_t)std::min<uint64_t>(uint64_t(fromRate) + burst_, capacity_);
+		burst_ = 0;
+
+		uint32_t target = 1 - source_;
+		auto& e = emitter_;
+		ComputeParams params = {
+			SimulateStage, capacity_, emitCount, seed_++, source_, dt_,
+			e.x, e.y, e.radius, glm::radians(e.direction), glm::radians(e.spread),
+			e.minSpeed, e.maxSpeed, e.minLifetime, e.maxLifetime, 0, e.gravityX, e.gravityY, e.drag };
+		dt_ = 0;
+
+		// the last frame may still be reading the buffers this one writes
+		vk::MemoryBarrier barrier;
+		barrier.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite);
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eDrawIndirect |
+			vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eTransfer,
+			vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader,
+			{}, barrier, nullptr, nullptr);
+		cmd.fillBuffer(state_->buffer, offsetof(State, alive) + target * sizeof(uint32_t), sizeof(uint32_t), 0);
+		barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eIndirectCommandRead);
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+			vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eDrawIndirect,
+			{}, barrier, nullptr, nullptr);
+
+		cmd.bindPipeline(vk::PipelineBindPoint::eCompute, computePipeline_);
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, computeLayout_, 0, computeSets_[source_], {});
+
+		// every pass appends to the target count, the next one has to see all of it
+		barrier.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite);
+		// survivors of the source, sized by the count the last finish pass wrote
+		cmd.pushConstants(computeLayout_, vk::ShaderStageFlagBits::eCompute, 0, sizeof(params), &params);
+		cmd.dispatchIndirect(state_->buffer, offsetof(State, simulate));
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
+			{}, barrier, nullptr, nullptr);
+		if (emitCount > 0) {
+			params.stage = EmitStage;
+			cmd.pushConstants(computeLayout_, vk::ShaderStageFlagBits::eCompute, 0, sizeof(params), &params);
+			cmd.dispatch((emitCount + GroupSize - 1) / GroupSize, 1, 1);
+			cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
+				{}, barrier, nullptr, nullptr);
+		}
+		// clamps the count and writes the indirect commands
+		params.stage = FinishStage;
+		cmd.pushConstants(computeLayout_, vk::ShaderStageFlagBits::eCompute, 0, sizeof(params), &params);
+		cmd.dispatch(1, 1, 1);
+
+		barrier.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eTransferRead);
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+			vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eTransfer,
+			{}, barrier, nullptr, nullptr);
+		vk::BufferCopy region(offsetof(State, alive) + target * sizeof(uint32_t), 0, sizeof(uint32_t));
+		cmd.copyBuffer(state_->buffer, readbacks_[flightIndex]->buffer, region);
+		barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eHostRead);
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost,
+			{}, barrier, nullptr, nullptr);
+		readbackValid_[flightIndex] = true;
+
+		source_ = target;
+	}
+
+	vk::Pipeline ParticleSystem::pipeline() {
+		auto& ctx = Context::GetInstance();
+		auto& renderProcess = ctx.renderProcess;
+		PipelineKey key;
+		key.layout = pipelineLayout_;
+		key.vertex = vertModule_;
+		key.fragment = Shader::GetInstance().fragShader;
+		key.input = &input_;
+		key.blend = blend_;
+		if (renderProcess->HasDepth()) {
+			key.depth = DepthMode::Test;
+		}
+		return renderProcess->pipelines.TryGet(key);
+	}
+
+	void ParticleSystem::draw(vk::CommandBuffer cmd, vk::DescriptorSet globalSet, float depth) {
+		DrawParams params = { emitter_.startColor, emitter_.endColor, emitter_.startSize, emitter_.endSize, depth };
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout_, 0, globalSet, {});
+		texture_->Bind(cmd, pipelineLayout_);
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout_, 2, drawSets_[source_], {});
+		cmd.pushConstants(pipelineLayout_, vk::ShaderStageFlagBits::eVertex, 0, sizeof(params), &params);
+		cmd.drawIndexedIndirect(state_->buffer, offsetof(State, draw), 1, sizeof(vk::DrawIndexedIndirectCommand));
+	}
+
+}
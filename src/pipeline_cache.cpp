@@ -0,0 +1,231 @@
+#include "toy2d/pipeline_cache.hpp"
+#include "toy2d/context.hpp"
+#include <iostream>
+
+namespace toy2d {
+
+	namespace {
+		constexpr size_t MinSlots = 16;
+
+		template <typename T>
+		uint64_t handleBits(T handle) {
+			return (uint64_t)static_cast<typename T::CType>(handle);
+		}
+
+		uint64_t mix(uint64_t h, uint64_t v) {
+			// splitmix64 finalizer over the running hash
+			h ^= v + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2);
+			h ^= h >> 30;
+			h *= 0xBF58476D1CE4E5B9ull;
+			h ^= h >> 27;
+			h *= 0x94D049BB133111EBull;
+			return h ^ (h >> 31);
+		}
+	}
+
+	bool PipelineKey::operator==(const PipelineKey& o) const {
+		return layout == o.layout && vertex == o.vertex && fragment == o.fragment && input == o.input &&
+			blend == o.blend && topology == o.topology && depth == o.depth && renderPass == o.renderPass && specializationCount == o.specializationCount &&
+			specialization == o.specialization;
+	}
+
+	PipelineCache::~PipelineCache() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+			queue_.clear();
+		}
+		wake_.notify_all();
+		if (worker_.joinable()) {
+			worker_.join();
+		}
+		Clear();
+	}
+
+	uint64_t PipelineCache::hashKey(const PipelineKey& key) {
+		uint64_t h = 0;
+		h = mix(h, handleBits(key.layout));
+		h = mix(h, handleBits(key.vertex));
+		h = mix(h, handleBits(key.fragment));
+		h = mix(h, (uint64_t)(uintptr_t)key.input);
+		h = mix(h, handleBits(key.renderPass));
+		h = mix(h, (uint64_t(key.depth) << 40) | (uint64_t(key.blend) << 32) | uint64_t(key.topology));
+		h = mix(h, key.specializationCount);
+		for (uint32_t i = 0; i < key.specializationCount; i++) {
+			h = mix(h, key.specialization[i]);
+		}
+		return h;
+	}
+
+	size_t PipelineCache::find(const PipelineKey& key, uint64_t hash) const {
+		size_t mask = slots_.size() - 1;
+		for (size_t i = hash & mask;; i = (i + 1) & mask) {
+			auto& slot = slots_[i];
+			if (!slot.occupied() || (slot.hash == hash && slot.key == key)) {
+				return i;
+			}
+		}
+	}
+
+	void PipelineCache::grow() {
+		std::vector<Slot> old = std::move(slots_);
+		slots_.assign(std::max(old.size() * 2, MinSlots), Slot{});
+		for (auto& slot : old) {
+			if (slot.occupied()) {
+				slots_[find(slot.key, slot.hash)] = slot;
+			}
+		}
+	}
+
+	vk::Pipeline PipelineCache::Get(const PipelineKey& key) {
+		collect();
+		// at most half full, so probes stay short and always hit an empty slot
+		if ((count_ + 1) * 2 > slots_.size()) {
+			grow();
+		}
+		uint64_t hash = hashKey(key);
+		auto& slot = slots_[find(key, hash)];
+		if (!slot.pipeline) {
+			// a queued copy finishing later is destroyed by collect
+			vk::Pipeline pipeline = create(key);
+			if (!slot.occupied()) count_++;
+			slot.key = key;
+			slot.hash = hash;
+			slot.pipeline = pipeline;
+			slot.pending = false;
+			slot.failed = false;
+		}
+		return slot.pipeline;
+	}
+
+	vk::Pipeline PipelineCache::TryGet(const PipelineKey& key) {
+		collect();
+		if ((count_ + 1) * 2 > slots_.size()) {
+			grow();
+		}
+		uint64_t hash = hashKey(key);
+		auto& slot = slots_[find(key, hash)];
+		if (slot.occupied()) {
+			return slot.pipeline;
+		}
+
+		slot.key = key;
+		slot.hash = hash;
+		slot.pending = true;
+		count_++;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (!worker_.joinable()) {
+				worker_ = std::thread(&PipelineCache::workerLoop, this);
+			}
+			queue_.push_back(Job{ key, hash, nullptr });
+		}
+		wake_.notify_one();
+		return nullptr;
+	}
+
+	void PipelineCache::collect() {
+		if (!hasDone_.load(std::memory_order_acquire)) return;
+		std::vector<Job> done;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			done.swap(done_);
+			hasDone_ = false;
+		}
+		auto& device = Context::GetInstance().device;
+		for (auto& job : done) {
+			auto& slot = slots_[find(job.key, job.hash)];
+			if (!job.error.empty()) {
+				// reported here once, TryGet keeps handing out null so the caller stays on its
+				// fallback and Get tries again. a Get since has already filled the slot
+				if (slot.pending) {
+					std::cerr << "Create graphics pipeline in background failed: " << job.error << std::endl;
+					slot.pending = false;
+					slot.failed = true;
+				}
+			} else if (slot.pending) {
+				slot.pipeline = job.pipeline;
+				slot.pending = false;
+			} else {
+				device.destroyPipeline(job.pipeline);
+			}
+		}
+	}
+
+	void PipelineCache::workerLoop() {
+		std::unique_lock<std::mutex> lock(mutex_);
+		for (;;) {
+			wake_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+			if (stop_) return;
+			Job job = queue_.front();
+			queue_.pop_front();
+			busy_ = true;
+
+			// vkCreateGraphicsPipelines may run next to the render thread, the driver cache it
+			// goes through is synchronized internally
+			lock.unlock();
+			try {
+				job.pipeline = create(job.key);
+			} catch (const std::exception& e) {
+				job.error = e.what();
+				if (job.error.empty()) job.error = "unknown error";
+			}
+			lock.lock();
+
+			busy_ = false;
+			done_.push_back(job);
+			hasDone_.store(true, std::memory_order_release);
+			idle_.notify_all();
+		}
+	}
+
+	void PipelineCache::Clear() {
+		auto& device = Context::GetInstance().device;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			queue_.clear();
+			idle_.wait(lock, [this] { return !busy_; });
+			for (auto& job : done_) {
+				if (job.pipeline) device.destroyPipeline(job.pipeline);
+			}
+			done_.clear();
+			hasDone_ = false;
+		}
+		if (count_ == 0) return;
+		for (auto& slot : slots_) {
+			if (slot.pipeline) {
+				device.destroyPipeline(slot.pipeline);
+			}
+			slot = Slot{};
+		}
+		count_ = 0;
+	}
+
+	vk::Pipeline PipelineCache::create(const PipelineKey& key) {
+		std::array<vk::SpecializationMapEntry, 4> entries;
+		for (uint32_t i = 0; i < key.specializationCount; i++) {
+			entries[i].setConstantID(i)
+				.setOffset(i * sizeof(uint32_t))
+				.setSize(sizeof(uint32_t));
+		}
+		vk::SpecializationInfo specialization;
+		specialization.setMapEntryCount(key.specializationCount)
+			.setPMapEntries(entries.data())
+			.setDataSize(key.specializationCount * sizeof(uint32_t))
+			.setPData(key.specialization.data());
+
+		std::vector<vk::PipelineShaderStageCreateInfo> stages(2);
+		stages[0].setStage(vk::ShaderStageFlagBits::eVertex)
+			.setModule(key.vertex)
+			.setPName("main");
+		stages[1].setStage(vk::ShaderStageFlagBits::eFragment)
+			.setModule(key.fragment)
+			.setPName("main");
+		if (key.specializationCount > 0) {
+			for (auto& stage : stages) stage.setPSpecializationInfo(&specialization);
+		}
+
+		return Context::GetInstance().renderProcess->CreateGraphicsPipeline(key.layout, stages, *key.input, key.blend, key.topology, key.depth, key.renderPass);
+	}
+
+}
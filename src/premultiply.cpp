@@ -0,0 +1,157 @@
+#include "toy2d/premultiply.hpp"
+#include "toy2d/cpu_features.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace toy2d {
+
+	namespace {
+
+		// result[a * 256 + c] = srgb(linear(c) * a / 255), padded by 4 bytes so that
+		// a 32bit gather of the last entry does not read out of bounds
+		struct SrgbPremultiplyTable final {
+			std::uint8_t data[256 * 256 + 4];
+
+			SrgbPremultiplyTable() {
+				float decode[256];
+				for (int i = 0; i < 256; i++) {
+					float c = i / 255.0f;
+					decode[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+				}
+				for (int a = 0; a < 256; a++) {
+					for (int c = 0; c < 256; c++) {
+						float l = decode[c] * (a / 255.0f);
+						float s = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+						data[a * 256 + c] = static_cast<std::uint8_t>(std::lround(std::clamp(s, 0.0f, 1.0f) * 255.0f));
+					}
+				}
+				// opaque pixels must come out bit exact
+				for (int c = 0; c < 256; c++) {
+					data[255 * 256 + c] = static_cast<std::uint8_t>(c);
+				}
+				std::fill(data + 256 * 256, data + sizeof(data), std::uint8_t(0));
+			}
+		};
+
+		const SrgbPremultiplyTable& srgbTable() {
+			static SrgbPremultiplyTable table;
+			return table;
+		}
+
+		// round(c * a / 255) without a division
+		inline std::uint8_t mulDiv255(std::uint32_t c, std::uint32_t a) {
+			std::uint32_t t = c * a + 128;
+			return static_cast<std::uint8_t>((t + (t >> 8)) >> 8);
+		}
+
+		void premultiplyFastScalar(const std::uint8_t* src, std::uint8_t* dst, size_t count) {
+			for (size_t i = 0; i < count; i++, src += 4, dst += 4) {
+				std::uint8_t a = src[3];
+				dst[0] = mulDiv255(src[0], a);
+				dst[1] = mulDiv255(src[1], a);
+				dst[2] = mulDiv255(src[2], a);
+				dst[3] = a;
+			}
+		}
+
+		void premultiplySrgbScalar(const std::uint8_t* src, std::uint8_t* dst, size_t count) {
+			const std::uint8_t* table = srgbTable().data;
+			for (size_t i = 0; i < count; i++, src += 4, dst += 4) {
+				std::uint8_t a = src[3];
+				const std::uint8_t* row = table + a * 256;
+				dst[0] = row[src[0]];
+				dst[1] = row[src[1]];
+				dst[2] = row[src[2]];
+				dst[3] = a;
+			}
+		}
+
+#ifdef TOY2D_SIMD_X64
+		// 8 x u16 lanes holding two RGBA pixels, alpha in lanes 3 and 7
+		inline __m128i mulAlphaSSE2(__m128i v) {
+			const __m128i alphaMask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+			const __m128i round = _mm_set1_epi16(128);
+			__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+			__m128i t = _mm_add_epi16(_mm_mullo_epi16(v, a), round);
+			t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+			return _mm_or_si128(_mm_and_si128(alphaMask, v), _mm_andnot_si128(alphaMask, t));
+		}
+
+		size_t premultiplyFastSSE2(const std::uint8_t* src, std::uint8_t* dst, size_t count) {
+			const __m128i zero = _mm_setzero_si128();
+			size_t i = 0;
+			for (; i + 4 <= count; i += 4) {
+				__m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+				__m128i lo = mulAlphaSSE2(_mm_unpacklo_epi8(px, zero));
+				__m128i hi = mulAlphaSSE2(_mm_unpackhi_epi8(px, zero));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_packus_epi16(lo, hi));
+			}
+			return i;
+		}
+
+		TOY2D_TARGET_AVX2 inline __m256i mulAlphaAVX2(__m256i v) {
+			const __m256i alphaMask = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+			const __m256i round = _mm256_set1_epi16(128);
+			__m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+			__m256i t = _mm256_add_epi16(_mm256_mullo_epi16(v, a), round);
+			t = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+			return _mm256_or_si256(_mm256_and_si256(alphaMask, v), _mm256_andnot_si256(alphaMask, t));
+		}
+
+		// unpack/pack work per 128bit lane, so pixel order is preserved
+		TOY2D_TARGET_AVX2 size_t premultiplyFastAVX2(const std::uint8_t* src, std::uint8_t* dst, size_t count) {
+			const __m256i zero = _mm256_setzero_si256();
+			size_t i = 0;
+			for (; i + 8 <= count; i += 8) {
+				__m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+				__m256i lo = mulAlphaAVX2(_mm256_unpacklo_epi8(px, zero));
+				__m256i hi = mulAlphaAVX2(_mm256_unpackhi_epi8(px, zero));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_packus_epi16(lo, hi));
+			}
+			return i;
+		}
+
+		// sRGB has no closed form worth vectorizing, gather straight from the 64KB table instead
+		TOY2D_TARGET_AVX2 size_t premultiplySrgbAVX2(const std::uint8_t* src, std::uint8_t* dst, size_t count) {
+			const int* table = reinterpret_cast<const int*>(srgbTable().data);
+			const __m256i byteMask = _mm256_set1_epi32(0xFF);
+			size_t i = 0;
+			for (; i + 8 <= count; i += 8) {
+				__m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+				__m256i alpha = _mm256_srli_epi32(px, 24);
+				__m256i row = _mm256_slli_epi32(alpha, 8);
+				__m256i r = _mm256_and_si256(px, byteMask);
+				__m256i g = _mm256_and_si256(_mm256_srli_epi32(px, 8), byteMask);
+				__m256i b = _mm256_and_si256(_mm256_srli_epi32(px, 16), byteMask);
+				r = _mm256_and_si256(_mm256_i32gather_epi32(table, _mm256_add_epi32(row, r), 1), byteMask);
+				g = _mm256_and_si256(_mm256_i32gather_epi32(table, _mm256_add_epi32(row, g), 1), byteMask);
+				b = _mm256_and_si256(_mm256_i32gather_epi32(table, _mm256_add_epi32(row, b), 1), byteMask);
+				__m256i out = _mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi32(g, 8)),
+					_mm256_or_si256(_mm256_slli_epi32(b, 16), _mm256_slli_epi32(alpha, 24)));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), out);
+			}
+			return i;
+		}
+#endif
+	}
+
+	void PremultiplyAlpha(const std::uint8_t* src, std::uint8_t* dst, size_t pixelCount, PremultiplyMode mode) {
+		size_t done = 0;
+		if (mode == PremultiplyMode::Fast) {
+#ifdef TOY2D_SIMD_X64
+			done = CpuHasAvx2() ? premultiplyFastAVX2(src, dst, pixelCount)
+				: premultiplyFastSSE2(src, dst, pixelCount);
+#endif
+			premultiplyFastScalar(src + done * 4, dst + done * 4, pixelCount - done);
+		}
+		else {
+#ifdef TOY2D_SIMD_X64
+			if (CpuHasAvx2()) {
+				done = premultiplySrgbAVX2(src, dst, pixelCount);
+			}
+#endif
+			premultiplySrgbScalar(src + done * 4, dst + done * 4, pixelCount - done);
+		}
+	}
+
+}
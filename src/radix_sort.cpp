@@ -0,0 +1,91 @@
+#include "toy2d/radix_sort.hpp"
+#include <algorithm>
+#include <array>
+#include <thread>
+
+namespace toy2d {
+
+	namespace {
+		// below this spawning threads costs more than the sort
+		constexpr size_t ParallelThreshold = 1 << 16;
+		constexpr unsigned MaxThreads = 8;
+
+		using Histogram = std::array<uint32_t, 256>;
+
+		template <typename Func>
+		void parallelFor(unsigned count, const Func& func) {
+			if (count == 1) {
+				func(0);
+				return;
+			}
+			std::vector<std::thread> threads;
+			threads.reserve(count - 1);
+			for (unsigned t = 1; t < count; t++) {
+				threads.emplace_back(func, t);
+			}
+			func(0);
+			for (auto& thread : threads) {
+				thread.join();
+			}
+		}
+	}
+
+	void RadixSort(std::vector<SortItem>& items, std::vector<SortItem>& scratch) {
+		size_t n = items.size();
+		if (n < 2) return;
+
+		uint64_t diff = 0;
+		for (size_t i = 1; i < n; i++) {
+			diff |= items[i].key ^ items[0].key;
+		}
+		if (diff == 0) return;
+
+		scratch.resize(n);
+		unsigned threadCount = 1;
+		if (n >= ParallelThreshold) {
+			threadCount = std::clamp(std::thread::hardware_concurrency(), 1u, MaxThreads);
+		}
+		size_t chunk = (n + threadCount - 1) / threadCount;
+		std::vector<Histogram> histograms(threadCount);
+
+		SortItem* src = items.data();
+		SortItem* dst = scratch.data();
+		for (unsigned shift = 0; shift < 64; shift += 8) {
+			if (((diff >> shift) & 0xFF) == 0) continue;
+
+			parallelFor(threadCount, [&](unsigned t) {
+				auto& histogram = histograms[t];
+				histogram.fill(0);
+				size_t end = std::min(n, (t + 1) * chunk);
+				for (size_t i = t * chunk; i < end; i++) {
+					histogram[(src[i].key >> shift) & 0xFF]++;
+				}
+			});
+
+			// digit major, chunk minor: each chunk scatters after the earlier ones, which keeps it stable
+			uint32_t offset = 0;
+			for (size_t digit = 0; digit < 256; digit++) {
+				for (auto& histogram : histograms) {
+					uint32_t count = histogram[digit];
+					histogram[digit] = offset;
+					offset += count;
+				}
+			}
+
+			parallelFor(threadCount, [&](unsigned t) {
+				auto& histogram = histograms[t];
+				size_t end = std::min(n, (t + 1) * chunk);
+				for (size_t i = t * chunk; i < end; i++) {
+					dst[histogram[(src[i].key >> shift) & 0xFF]++] = src[i];
+				}
+			});
+
+			std::swap(src, dst);
+		}
+
+		if (src != items.data()) {
+			items.swap(scratch);
+		}
+	}
+
+}
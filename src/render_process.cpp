@@ -10,15 +10,24 @@ namespace toy2d {
 	RenderProcess::RenderProcess() {
 		setLayout = createSetLayout();
 		layout = createLayout();
-		renderPass = createRenderPass();
+		if (Context::GetInstance().useDepthBuffer) {
+			depthFormat = pickDepthFormat();
+		}
+		// dynamic rendering names the formats at pipeline creation and the views at beginRendering
+		if (!Context::GetInstance().useDynamicRendering) {
+			renderPass = createRenderPass();
+		}
 		graphicsPipeline = nullptr;
+		spriteInput_ = GetSpriteVertexInput();
+		driverCache_ = Context::GetInstance().device.createPipelineCache(vk::PipelineCacheCreateInfo());
 	}
 
 	RenderProcess::~RenderProcess() {
 		auto device = Context::GetInstance().device;
+		pipelines.Clear();
+		device.destroyPipelineCache(driverCache_);
 		device.destroyPipelineLayout(layout);
 		device.destroyRenderPass(renderPass);
-		device.destroyPipeline(graphicsPipeline);
 	}
 
 	vk::PipelineLayout RenderProcess::createLayout() {
@@ -37,27 +46,60 @@ namespace toy2d {
 		return Context::GetInstance().device.createDescriptorSetLayout(setInfo);
 	}
 
+	VertexInput RenderProcess::GetSpriteVertexInput() {
+		VertexInput input;
+		input.bindings = { Vertex::GetBinding(), SpriteInstance::GetBinding() };
+		input.attributes = Vertex::GetAttribute();
+		auto instanceAttr = SpriteInstance::GetAttribute();
+		input.attributes.insert(input.attributes.end(), instanceAttr.begin(), instanceAttr.end());
+		return input;
+	}
+
 	vk::Pipeline RenderProcess::createGraphicsPipeline() {
+		return GetSpritePipeline(BlendMode::Premultiplied);
+	}
+
+	vk::Pipeline RenderProcess::GetSpritePipeline(BlendMode blend) {
+		return pipelines.Get(spriteKey(blend));
+	}
+
+	vk::Pipeline RenderProcess::TryGetSpritePipeline(BlendMode blend) {
+		return pipelines.TryGet(spriteKey(blend));
+	}
+
+	PipelineKey RenderProcess::spriteKey(BlendMode blend) {
+		auto& shader = Shader::GetInstance();
+		PipelineKey key;
+		key.layout = layout;
+		key.vertex = shader.vertShader;
+		key.fragment = shader.fragShader;
+		key.input = &spriteInput_;
+		key.blend = blend;
+		if (HasDepth()) {
+			key.depth = blend == BlendMode::Opaque ? DepthMode::TestWrite : DepthMode::Test;
+		}
+		return key;
+	}
+
+	vk::Pipeline RenderProcess::CreateGraphicsPipeline(vk::PipelineLayout layout, const std::vector<vk::PipelineShaderStageCreateInfo>& stages, const VertexInput& input,
+		BlendMode blend, vk::PrimitiveTopology topology, DepthMode depth, vk::RenderPass pass) {
 		auto& ctx = Context::GetInstance();
 		vk::GraphicsPipelineCreateInfo createInfo;
 
 		//1 Vertex
 		vk::PipelineVertexInputStateCreateInfo vertexInputState;
-		auto attr = Vertex::GetAttribute();
-		auto binding = Vertex::GetBinding();
-		vertexInputState.setVertexAttributeDescriptions(attr)
-			.setVertexBindingDescriptions(binding);
+		vertexInputState.setVertexAttributeDescriptions(input.attributes)
+			.setVertexBindingDescriptions(input.bindings);
 		createInfo.setPVertexInputState(&vertexInputState);
 
 		//2 Vertex Assembly
 		vk::PipelineInputAssemblyStateCreateInfo assemblyState;
 		assemblyState.setPrimitiveRestartEnable(false)
-			.setTopology(vk::PrimitiveTopology::eTriangleList);
+			.setTopology(topology);
 		createInfo.setPInputAssemblyState(&assemblyState);
 
 		//3. Shader
-		auto stage = Shader::GetInstance().GetStage();
-		createInfo.setStages(stage);
+		createInfo.setStages(stages);
 
 		//4. viewport & scissor
 		vk::PipelineViewportStateCreateInfo viewState;
@@ -87,11 +129,18 @@ namespace toy2d {
 		createInfo.setPMultisampleState(&MSStateInfo);
 
 		//7. stencil test depth test
+		vk::PipelineDepthStencilStateCreateInfo depthState;
+		depthState.setDepthTestEnable(depth != DepthMode::None)
+			.setDepthWriteEnable(depth == DepthMode::TestWrite)
+			.setDepthCompareOp(vk::CompareOp::eGreaterOrEqual)
+			.setDepthBoundsTestEnable(false)
+			.setStencilTestEnable(false);
+		createInfo.setPDepthStencilState(&depthState);
 
 		//8. color blending
 
 		vk::PipelineColorBlendAttachmentState blendstate;
-		blendstate.setBlendEnable(true)
+		blendstate.setBlendEnable(blend != BlendMode::Opaque)
 			.setColorWriteMask(vk::ColorComponentFlagBits::eR |
 				vk::ColorComponentFlagBits::eG |
 				vk::ColorComponentFlagBits::eB |
@@ -102,23 +151,41 @@ namespace toy2d {
 			.setSrcAlphaBlendFactor(vk::BlendFactor::eOne)
 			.setDstAlphaBlendFactor(vk::BlendFactor::eZero)
 			.setAlphaBlendOp(vk::BlendOp::eAdd);
+		if (blend == BlendMode::Additive) {
+			blendstate.setDstColorBlendFactor(vk::BlendFactor::eOne);
+		} else if (blend == BlendMode::Multiply) {
+			blendstate.setSrcColorBlendFactor(vk::BlendFactor::eDstColor);
+		}
 
 		vk::PipelineColorBlendStateCreateInfo ColorBlendStage;
 		ColorBlendStage.setLogicOpEnable(false)
 			.setAttachments(blendstate);
 		createInfo.setPColorBlendState(&ColorBlendStage);
 
-		// dynamic changing state of pipeline
-		//vk::PipelineDynamicStateCreateInfo dynamicState;
-		//std::array states = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
-		//dynamicState.setDynamicStates(states);
-		//createInfo.setPDynamicState(&dynamicState);
+		// dynamic changing state of pipeline. offscreen passes differ in size from the swapchain,
+		// whoever begins them sets viewport and scissor. with dynamic rendering the frame's pass
+		// does too, a resized swapchain then needs no new pipelines
+		bool dynamicRendering = !pass && ctx.useDynamicRendering;
+		vk::PipelineDynamicStateCreateInfo dynamicState;
+		std::array states = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+		dynamicState.setDynamicStates(states);
+		if (pass || dynamicRendering) {
+			createInfo.setPDynamicState(&dynamicState);
+		}
 
 		//9. renderPass & layout
 		createInfo.setLayout(layout)
-			.setRenderPass(renderPass);
+			.setRenderPass(pass ? pass : renderPass);
+		// null render pass, the attachment formats of the frame instead
+		vk::PipelineRenderingCreateInfo renderingInfo;
+		vk::Format colorFormat = ctx.swapchain->info.format.format;
+		if (dynamicRendering) {
+			renderingInfo.setColorAttachmentFormats(colorFormat)
+				.setDepthAttachmentFormat(depthFormat);
+			createInfo.setPNext(&renderingInfo);
+		}
 
-		auto result = Context::GetInstance().device.createGraphicsPipeline(nullptr, createInfo);
+		auto result = Context::GetInstance().device.createGraphicsPipeline(driverCache_, createInfo);
 		if (result.result != vk::Result::eSuccess) {
 			throw std::runtime_error("Create graphics pipeline failed!");
 		}
@@ -128,7 +195,8 @@ namespace toy2d {
 	vk::RenderPass RenderProcess::createRenderPass() {
 		auto& device = Context::GetInstance().device;
 		vk::RenderPassCreateInfo passInfo;
-		vk::AttachmentDescription attachDesc;
+		std::vector<vk::AttachmentDescription> attachments(1);
+		auto& attachDesc = attachments[0];
 		attachDesc.setFormat(Context::GetInstance().swapchain->info.format.format)
 			.setInitialLayout(vk::ImageLayout::eUndefined)
 			.setFinalLayout(vk::ImageLayout::ePresentSrcKHR)
@@ -153,22 +221,66 @@ namespace toy2d {
 			.setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
 			.setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput);
 
+		// one depth image is shared by the frames in flight, cleared at the start of every pass
+		vk::AttachmentReference depthReference;
+		if (HasDepth()) {
+			vk::AttachmentDescription depthDesc;
+			depthDesc.setFormat(depthFormat)
+				.setInitialLayout(vk::ImageLayout::eUndefined)
+				.setFinalLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
+				.setLoadOp(vk::AttachmentLoadOp::eClear)
+				.setStoreOp(vk::AttachmentStoreOp::eDontCare)
+				.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+				.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
+				.setSamples(vk::SampleCountFlagBits::e1);
+			attachments.push_back(depthDesc);
+			depthReference.setLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
+				.setAttachment(1);
+			passDesc.setPDepthStencilAttachment(&depthReference);
+
+			// the clear waits for the previous frame's depth tests
+			dependency.setSrcStageMask(dependency.srcStageMask | vk::PipelineStageFlagBits::eLateFragmentTests)
+				.setDstStageMask(dependency.dstStageMask | vk::PipelineStageFlagBits::eEarlyFragmentTests)
+				.setSrcAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+				.setDstAccessMask(dependency.dstAccessMask | vk::AccessFlagBits::eDepthStencilAttachmentWrite |
+					vk::AccessFlagBits::eDepthStencilAttachmentRead);
+		}
 
 		passInfo.setSubpasses(passDesc)
-			.setAttachments(attachDesc)
+			.setAttachments(attachments)
 			.setDependencies(dependency);
 		return device.createRenderPass(passInfo);
 	}
 
+	vk::Format RenderProcess::pickDepthFormat() {
+		auto& physicalDevice = Context::GetInstance().physicaldevice;
+		// the sprite depths are 24 bit fractions, both keep them exact
+		for (auto format : { vk::Format::eD32Sfloat, vk::Format::eX8D24UnormPack32 }) {
+			auto props = physicalDevice.getFormatProperties(format);
+			if (props.optimalTilingFeatures & vk::FormatFeatureFlagBits::eDepthStencilAttachment) {
+				return format;
+			}
+		}
+		throw std::runtime_error("No supported depth format!");
+	}
+
 	void RenderProcess::recreateGraphicsPipeline() {
-		if (graphicsPipeline)
-			Context::GetInstance().device.destroyPipeline(graphicsPipeline);
+		// every cached variant bakes in the old viewport, or the old formats with dynamic rendering
+		pipelines.Clear();
 		graphicsPipeline = createGraphicsPipeline();
+		// the other variants compile in the background, usually done before a sprite needs them
+		for (auto blend : { BlendMode::Additive, BlendMode::Multiply, BlendMode::Opaque }) {
+			pipelines.TryGet(spriteKey(blend));
+		}
 	}
 	void RenderProcess::recreateRenderPass() {
+		// queued pipelines would be built against the destroyed pass
+		pipelines.Clear();
 		if (renderPass)
 			Context::GetInstance().device.destroyRenderPass(renderPass);
-		renderPass = createRenderPass();
+		if (!Context::GetInstance().useDynamicRendering) {
+			renderPass = createRenderPass();
+		}
 	}
 
 
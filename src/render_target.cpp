@@ -0,0 +1,299 @@
+#include "toy2d/render_target.hpp"
+#include "toy2d/buffer.hpp"
+#include "toy2d/context.hpp"
+#include "toy2d/descriptor_manager.hpp"
+#include "toy2d/shader.hpp"
+#include <algorithm>
+#include <array>
+
+namespace toy2d {
+
+	bool IsDepthFormat(vk::Format format) {
+		switch (format) {
+		case vk::Format::eD16Unorm:
+		case vk::Format::eX8D24UnormPack32:
+		case vk::Format::eD32Sfloat:
+		case vk::Format::eD16UnormS8Uint:
+		case vk::Format::eD24UnormS8Uint:
+		case vk::Format::eD32SfloatS8Uint:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	namespace {
+		// QueryBufferMemTypeIndex takes any of the flags, lazy memory has to be exactly that
+		bool findLazyMemoryType(uint32_t typeBits, uint32_t& index) {
+			auto properties = Context::GetInstance().physicaldevice.getMemoryProperties();
+			for (uint32_t i = 0; i < properties.memoryTypeCount; i++) {
+				if ((typeBits & (1u << i)) &&
+					(properties.memoryTypes[i].propertyFlags & vk::MemoryPropertyFlagBits::eLazilyAllocated)) {
+					index = i;
+					return true;
+				}
+			}
+			return false;
+		}
+	}
+
+	RenderTarget::RenderTarget(const RenderTargetDesc& desc) : desc_(desc) {
+		auto& ctx = Context::GetInstance();
+		auto& device = ctx.device;
+
+		vk::ImageCreateInfo imageInfo;
+		imageInfo.setImageType(vk::ImageType::e2D)
+			.setArrayLayers(1)
+			.setMipLevels(1)
+			.setExtent({ desc.extent.width, desc.extent.height, 1 })
+			.setFormat(desc.format)
+			.setTiling(vk::ImageTiling::eOptimal)
+			.setInitialLayout(vk::ImageLayout::eUndefined)
+			.setUsage(desc.usage)
+			.setSamples(vk::SampleCountFlagBits::e1);
+		image_ = device.createImage(imageInfo);
+
+		auto requirements = device.getImageMemoryRequirements(image_);
+		uint32_t typeIndex;
+		lazy_ = (desc.usage & vk::ImageUsageFlagBits::eTransientAttachment) &&
+			findLazyMemoryType(requirements.memoryTypeBits, typeIndex);
+		if (!lazy_) {
+			typeIndex = QueryBufferMemTypeIndex(requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal);
+		}
+		vk::MemoryAllocateInfo allocInfo;
+		allocInfo.setAllocationSize(requirements.size)
+			.setMemoryTypeIndex(typeIndex);
+		memory_ = device.allocateMemory(allocInfo);
+		device.bindImageMemory(image_, memory_, 0);
+		memorySize_ = requirements.size;
+
+		vk::ImageSubresourceRange range;
+		range.setAspectMask(IsDepth() ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor)
+			.setBaseMipLevel(0)
+			.setLevelCount(1)
+			.setBaseArrayLayer(0)
+			.setLayerCount(1);
+		vk::ImageViewCreateInfo viewInfo;
+		viewInfo.setImage(image_)
+			.setViewType(vk::ImageViewType::e2D)
+			.setFormat(desc.format)
+			.setSubresourceRange(range);
+		view_ = device.createImageView(viewInfo);
+	}
+
+	RenderTarget::~RenderTarget() {
+		auto& device = Context::GetInstance().device;
+		for (auto& fb : framebuffers_) {
+			device.destroyFramebuffer(fb.framebuffer);
+		}
+		device.destroyImageView(view_);
+		device.destroyImage(image_);
+		device.freeMemory(memory_);
+	}
+
+	bool RenderTarget::IsDepth() const {
+		return IsDepthFormat(desc_.format);
+	}
+
+	void RenderTarget::Bind(vk::CommandBuffer cmd, vk::PipelineLayout layout, uint32_t setIndex) const {
+		auto& ctx = Context::GetInstance();
+		vk::DescriptorImageInfo imageInfo;
+		imageInfo.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+			.setImageView(view_)
+			.setSampler(ctx.sampler);
+		if (!ctx.usePushDescriptors) {
+			// targets come and go with the pool, a transient set per bind keeps them out of the image set pools
+			auto set = DescriptorSetManager::Instance().AllocTransientSet(Shader::GetInstance().GetDescriptorSetLayouts()[1]);
+			Shader::DescriptorData data;
+			data.image = imageInfo;
+			Shader::GetInstance().UpdateDescriptorSet(set, 1, &data);
+			cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, setIndex, set, {});
+			return;
+		}
+
+		vk::WriteDescriptorSet writer;
+		writer.setImageInfo(imageInfo)
+			.setDstBinding(0)
+			.setDstArrayElement(0)
+			.setDescriptorCount(1)
+			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+		ctx.cmdPushDescriptorSet(static_cast<VkCommandBuffer>(cmd), VK_PIPELINE_BIND_POINT_GRAPHICS,
+			static_cast<VkPipelineLayout>(layout), setIndex, 1, reinterpret_cast<const VkWriteDescriptorSet*>(&writer));
+	}
+
+	RenderTargetPool::RenderTargetPool(int maxFlightCount) : maxFlightCount_(maxFlightCount) {}
+
+	RenderTargetPool::~RenderTargetPool() {
+		auto& device = Context::GetInstance().device;
+		device.waitIdle();
+
+		targets_.clear();
+		for (auto& pass : passes_) {
+			device.destroyRenderPass(pass.renderPass);
+		}
+	}
+
+	RenderTarget* RenderTargetPool::Acquire(const RenderTargetDesc& desc) {
+		for (auto& target : targets_) {
+			if (target->inUse_ || !(target->desc_ == desc)) continue;
+			// the frames that drew into it or sampled it may still be running
+			if (target->lastUsedFrame_ + maxFlightCount_ > frame_) continue;
+			target->inUse_ = true;
+			stats_.inUse++;
+			return target.get();
+		}
+
+		if (desc.extent.width == 0 || desc.extent.height == 0) {
+			throw std::runtime_error("Render target extent is empty");
+		}
+		targets_.emplace_back(new RenderTarget(desc));
+		auto target = targets_.back().get();
+		target->inUse_ = true;
+		stats_.targets++;
+		stats_.inUse++;
+		stats_.created++;
+		stats_.memory += target->memorySize_;
+		if (target->lazy_) stats_.lazilyAllocated++;
+		return target;
+	}
+
+	void RenderTargetPool::Release(RenderTarget* target) {
+		if (!target || !target->inUse_) return;
+		target->inUse_ = false;
+		target->lastUsedFrame_ = std::max(target->lastUsedFrame_, frame_);
+		stats_.inUse--;
+	}
+
+	void RenderTargetPool::Touch(RenderTarget& target) {
+		target.lastUsedFrame_ = frame_;
+	}
+
+	void RenderTargetPool::BeginFrame(uint64_t frame) {
+		frame_ = frame;
+		for (size_t i = 0; i < targets_.size();) {
+			auto& target = targets_[i];
+			if (!target->inUse_ && target->lastUsedFrame_ + MaxIdleFrames <= frame_) {
+				destroy(i);
+			} else {
+				i++;
+			}
+		}
+	}
+
+	void RenderTargetPool::destroy(size_t index) {
+		auto& device = Context::GetInstance().device;
+		auto& target = targets_[index];
+		// framebuffers of other targets may use it as their depth attachment
+		for (auto& other : targets_) {
+			auto& fbs = other->framebuffers_;
+			for (size_t i = 0; i < fbs.size();) {
+				if (fbs[i].depth == target->view_) {
+					device.destroyFramebuffer(fbs[i].framebuffer);
+					fbs[i] = fbs.back();
+					fbs.pop_back();
+				} else {
+					i++;
+				}
+			}
+		}
+		stats_.targets--;
+		stats_.memory -= target->memorySize_;
+		if (target->lazy_) stats_.lazilyAllocated--;
+		targets_[index] = std::move(targets_.back());
+		targets_.pop_back();
+	}
+
+	vk::RenderPass RenderTargetPool::GetRenderPass(vk::Format color, vk::Format depth) {
+		return renderPass(color, depth, true);
+	}
+
+	vk::RenderPass RenderTargetPool::renderPass(vk::Format color, vk::Format depth, bool storeColor) {
+		for (auto& pass : passes_) {
+			if (pass.color == color && pass.depth == depth && pass.storeColor == storeColor) {
+				return pass.renderPass;
+			}
+		}
+
+		// load and store ops are not part of render pass compatibility, pipelines made for the
+		// stored variant work with the transient one too
+		std::vector<vk::AttachmentDescription> attachments(1);
+		attachments[0].setFormat(color)
+			.setInitialLayout(vk::ImageLayout::eUndefined)
+			.setFinalLayout(storeColor ? vk::ImageLayout::eShaderReadOnlyOptimal : vk::ImageLayout::eColorAttachmentOptimal)
+			.setLoadOp(vk::AttachmentLoadOp::eClear)
+			.setStoreOp(storeColor ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare)
+			.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+			.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
+			.setSamples(vk::SampleCountFlagBits::e1);
+		vk::AttachmentReference colorReference(0, vk::ImageLayout::eColorAttachmentOptimal);
+		vk::AttachmentReference depthReference(1, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+		vk::SubpassDescription subpass;
+		subpass.setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
+			.setColorAttachments(colorReference);
+		if (depth != vk::Format::eUndefined) {
+			vk::AttachmentDescription depthDesc;
+			depthDesc.setFormat(depth)
+				.setInitialLayout(vk::ImageLayout::eUndefined)
+				.setFinalLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
+				.setLoadOp(vk::AttachmentLoadOp::eClear)
+				.setStoreOp(vk::AttachmentStoreOp::eDontCare)
+				.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+				.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
+				.setSamples(vk::SampleCountFlagBits::e1);
+			attachments.push_back(depthDesc);
+			subpass.setPDepthStencilAttachment(&depthReference);
+		}
+
+		// in: the last frame sampling the target and its depth tests are done before the clears.
+		// out: the color writes are visible to the fragment shaders sampling the target afterwards
+		std::array<vk::SubpassDependency, 2> dependencies;
+		dependencies[0].setSrcSubpass(VK_SUBPASS_EXTERNAL)
+			.setDstSubpass(0)
+			.setSrcStageMask(vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eColorAttachmentOutput |
+				vk::PipelineStageFlagBits::eLateFragmentTests)
+			.setSrcAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+			.setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests)
+			.setDstAccessMask(vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentRead |
+				vk::AccessFlagBits::eDepthStencilAttachmentWrite);
+		dependencies[1].setSrcSubpass(0)
+			.setDstSubpass(VK_SUBPASS_EXTERNAL)
+			.setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
+			.setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+			.setDstStageMask(vk::PipelineStageFlagBits::eFragmentShader)
+			.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+
+		vk::RenderPassCreateInfo passInfo;
+		passInfo.setAttachments(attachments)
+			.setSubpasses(subpass)
+			.setDependencies(dependencies);
+		auto pass = Context::GetInstance().device.createRenderPass(passInfo);
+		passes_.push_back(Pass{ color, depth, storeColor, pass });
+		return pass;
+	}
+
+	vk::Framebuffer RenderTargetPool::GetFramebuffer(RenderTarget& color, RenderTarget* depth, vk::RenderPass& pass) {
+		if (color.IsDepth() || (depth && !depth->IsDepth()) || (depth && !(depth->desc_.extent == color.desc_.extent))) {
+			throw std::runtime_error("Render target attachments don't match");
+		}
+		// a color target nobody samples only lives inside the pass
+		bool storeColor = bool(color.desc_.usage & vk::ImageUsageFlagBits::eSampled);
+		pass = renderPass(color.desc_.format, depth ? depth->desc_.format : vk::Format::eUndefined, storeColor);
+		vk::ImageView depthView = depth ? depth->view_ : nullptr;
+		for (auto& fb : color.framebuffers_) {
+			if (fb.renderPass == pass && fb.depth == depthView) return fb.framebuffer;
+		}
+
+		std::vector<vk::ImageView> views = { color.view_ };
+		if (depth) views.push_back(depthView);
+		vk::FramebufferCreateInfo createInfo;
+		createInfo.setRenderPass(pass)
+			.setAttachments(views)
+			.setWidth(color.desc_.extent.width)
+			.setHeight(color.desc_.extent.height)
+			.setLayers(1);
+		auto framebuffer = Context::GetInstance().device.createFramebuffer(createInfo);
+		color.framebuffers_.push_back(RenderTarget::Framebuffer{ pass, depthView, framebuffer });
+		return framebuffer;
+	}
+
+}
@@ -7,10 +7,14 @@
 #include "toy2d/shader.hpp"
 #include "toy2d/texture.hpp"
 #include "toy2d/descriptor_manager.hpp"
+#include "toy2d/radix_sort.hpp"
 #include "vulkan/vulkan.hpp"
 #include "glm/glm.hpp"
 #include "glm/common.hpp"
 #include "glm/gtc/matrix_transform.hpp"
+#include <array>
+#include <algorithm>
+#include <cmath>
 
 //todo  renderer
 
@@ -19,18 +23,102 @@ namespace toy2d {
 
 	static Vertex vertices[] = {
 		Vertex{-0.5, -0.5, 0, 0},
-		Vertex{0.5, -0.5, 1, 0},
-		Vertex{0.5, 0.5, 1 , 1},
-		Vertex{-0.5, 0.5, 0, 1}
+		Vertex{0.5, -0.5, UvOne, 0},
+		Vertex{0.5, 0.5, UvOne, UvOne},
+		Vertex{-0.5, 0.5, 0, UvOne}
 	};
 
-	static std::uint32_t indices[] = {
+	static std::uint16_t indices[] = {
 		0, 1, 3,
 		1, 2, 3,
 	};
 
+	// draw sort key, most significant field first:
+	// layer 8 | pipeline 12 | blend 4 | texture 24 | depth 16
+	// the sprite pipeline is 0, so every sprite of a layer sorts ahead of its other draws
+	// whatever its blend mode, the static layer caches rely on that
+	enum : uint32_t {
+		PremultipliedBlend = uint32_t(BlendMode::Premultiplied),
+	};
+	enum : uint32_t {
+		SpritePipeline = 0,
+		VirtualTexturePipeline = 1,
+		ScenePipeline = 2,
+		TextPipeline = 3,
+		ParticlePipeline = 4,
+		TilemapPipeline = 5,
+		PrimitivePipeline = 6,
+	};
+	// top bits of SortItem::index tell which list it points into, none set means sprites_
+	static constexpr uint32_t CustomDrawBit = 1u << 31;
+	static constexpr uint32_t SceneDrawBit = 1u << 30;
+	static constexpr uint32_t SceneGroupBit = 1u << 29;
+	static constexpr uint32_t TextDrawBit = 1u << 28;
+	static constexpr uint32_t ParticleDrawBit = 1u << 27;
+	static constexpr uint32_t TilemapDrawBit = 1u << 26;
+	static constexpr uint32_t PrimitiveDrawBit = 1u << 25;
+	static constexpr uint32_t DrawKindMask = CustomDrawBit | SceneDrawBit | SceneGroupBit | TextDrawBit | ParticleDrawBit |
+		TilemapDrawBit | PrimitiveDrawBit;
+
+	static uint64_t makeSortKey(uint8_t layer, uint32_t blend, uint32_t pipeline, uint32_t texture, uint16_t depth) {
+		return (uint64_t(layer) << 56) |
+			(uint64_t(pipeline & 0xFFF) << 44) |
+			(uint64_t(blend & 0xF) << 40) |
+			(uint64_t(texture & 0xFFFFFF) << 16) |
+			uint64_t(depth);
+	}
+
+	static BlendMode blendOf(uint64_t key) {
+		return BlendMode((key >> 40) & 0xF);
+	}
 
-	Renderer::Renderer(int maxFlightCount) : maxFlightCount(maxFlightCount), curFrame(0) {
+	// sprite keys carry the submission order inside their layer in the depth field, layer and
+	// order together make a 24 bit depth where later is in front
+	static float spriteDepth(uint64_t key) {
+		return float(((key >> 56) << 16) + (key & 0xFFFF) + 1) / float(1 << 24);
+	}
+
+	// TransformBatch only makes rotate * scale affines, their second column follows from the first
+	static SpriteInstance makeSpriteInstance(const Affine2D& m, float scaleX, float scaleY, PackedColor tint, float depth) {
+		// a zero wide sprite covers nothing whatever the ratio
+		float ratio = scaleX != 0.0f ? scaleY / scaleX : 0.0f;
+		return SpriteInstance{ m.a, m.b, m.tx, m.ty, ratio, tint, depth };
+	}
+
+	// variants still compiling in the background draw with the premultiplied pipeline, which is
+	// exact for opaque sprites and close for additive ones. multiply has no stand-in and is skipped
+	static vk::Pipeline readySpritePipeline(BlendMode blend, bool& fallback) {
+		auto& renderProcess = Context::GetInstance().renderProcess;
+		vk::Pipeline pipeline = renderProcess->TryGetSpritePipeline(blend);
+		fallback = !pipeline;
+		if (pipeline || blend == BlendMode::Multiply) return pipeline;
+		return renderProcess->GetSpritePipeline(BlendMode::Premultiplied);
+	}
+
+	// pipeline and texture binds needed to record items in this order
+	static uint32_t countStateChanges(const std::vector<SortItem>& items) {
+		uint32_t changes = 0;
+		uint64_t pipeline = ~0ull;
+		uint64_t texture = ~0ull;
+		for (auto& item : items) {
+			// pipeline and blend, both pick the bound pipeline
+			uint64_t p = (item.key >> 40) & 0xFFFF;
+			uint64_t t = (item.key >> 16) & 0xFFFFFF;
+			if (p != pipeline) {
+				changes++;
+				pipeline = p;
+				texture = ~0ull;
+			}
+			if (t != 0 && t != texture) {
+				changes++;
+				texture = t;
+			}
+		}
+		return changes;
+	}
+
+
+	Renderer::Renderer(int maxFlightCount) : maxFlightCount(maxFlightCount), curFrame(0), frameCounter(0) {
 		createSemaphores();
 		createFences();
 		createCmdBuffers();
@@ -41,7 +129,13 @@ namespace toy2d {
 		bufferIndicesData();
 
 		createUniformBuffers();
-
+		instanceBuffers_.resize(maxFlightCount);
+		sceneSlotBuffers_.resize(maxFlightCount);
+		glyphBuffers_.resize(maxFlightCount);
+		primitiveBuffers_.resize(maxFlightCount);
+		liveSecondaries_.resize(maxFlightCount);
+		renderTargets_.reset(new RenderTargetPool(maxFlightCount));
+		frameGraph_.reset(new FrameGraph(*renderTargets_, maxFlightCount));
 
 		descriptorManagers = DescriptorSetManager::Instance().AllocBufferSets(maxFlightCount);
 
@@ -49,15 +143,34 @@ namespace toy2d {
 
 		projectMat = glm::mat4x4(1.0f);
 		viewMat = glm::mat4x4(1.0f);
+		viewRect = Rect{ -1, -1, 1, 1 };
 
 		SetDrawColor(Color{ 0, 0, 0 });
 	}
 
 	Renderer::~Renderer() {
+		overdraw_.reset();
+		frameGraph_.reset();
+		renderTargets_.reset();
 		hostVertexBuffer_.reset();
 		deviceVertexBuffer_.reset();
 		hostUniformBuffers_.clear();
 		deviceUniformBuffers_.clear();
+		instanceBuffers_.clear();
+		sceneSlotBuffers_.clear();
+		glyphBuffers_.clear();
+		primitiveBuffers_.clear();
+		auto& cmdMag = Context::GetInstance().commandManager;
+		for (auto& cache : layerCaches_) {
+			retireLayerCache(cache, false);
+		}
+		for (auto& retired : retiredCaches_) {
+			for (auto& cmd : retired.cmds) cmdMag->freeCmds(cmd);
+		}
+		retiredCaches_.clear();
+		for (auto& pool : liveSecondaries_) {
+			for (auto& cmd : pool) cmdMag->freeCmds(cmd);
+		}
 		auto& device = Context::GetInstance().device;
 		for (auto& sem : imageAvailableSems) {
 			device.destroySemaphore(sem);
@@ -68,6 +181,8 @@ namespace toy2d {
 		for (auto& fence : cmdAvailableFences) {
 			device.destroyFence(fence);
 		}
+		device.destroyShaderModule(primitiveVert_);
+		device.destroyShaderModule(primitiveFrag_);
 	}
 
 	void Renderer::createFences() {
@@ -111,6 +226,17 @@ namespace toy2d {
 		}
 		device.resetFences(cmdAvailableFences[curFrame]);
 
+		// everything used maxFlightCount frames ago has finished, textures from then may be evicted
+		frameCounter++;
+		TextureManager::Instance().BeginFrame(frameCounter, maxFlightCount);
+		DescriptorSetManager::Instance().BeginFrame(curFrame);
+		renderTargets_->BeginFrame(frameCounter);
+		frameGraph_->beginFrame(curFrame, frameCounter);
+		freeRetiredCaches();
+		if (overdraw_) {
+			overdraw_->ReadResults(curFrame, overdrawStats_);
+		}
+
 
 		auto& result = device.acquireNextImageKHR(swapchain->swapchain,
 			std::numeric_limits<uint64_t>::max(), imageAvailableSems[curFrame]); //time out
@@ -124,46 +250,323 @@ namespace toy2d {
 		beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
 		cmdBuffers[curFrame].begin(beginInfo);
 
-		vk::RenderPassBeginInfo passbeginInfo;
-		vk::Rect2D area({ 0,0 }, { swapchain->info.imageExtent });
-		vk::ClearValue clearValue;
-		clearValue.setColor(vk::ClearColorValue({ 0.1f, 0.1f, 0.1f, 1.0f }));
-		passbeginInfo.setRenderPass(render_process->renderPass)
-			.setRenderArea(area)
-			.setFramebuffer(swapchain->frameBuffers[imageIndex])
-			.setClearValues(clearValue);
-		cmdBuffers[curFrame].beginRenderPass(&passbeginInfo, vk::SubpassContents::eInline);
-		cmdBuffers[curFrame].bindPipeline(vk::PipelineBindPoint::eGraphics, render_process->graphicsPipeline);
+		drawItems_.clear();
+		opaqueItems_.clear();
+		layerOrder_.fill(0);
+		sprites_.clear();
+		spriteTransforms_.Clear();
+		sceneDraws_.clear();
+		sceneGroups_.clear();
+		sceneCulled_ = 0;
+		customDraws_.clear();
+		textDraws_.clear();
+		glyphs_.clear();
+		frameFonts_.clear();
+		frameScenes_.clear();
+		textCulled_ = 0;
+		particleDraws_.clear();
+		tilemapDraws_.clear();
+		visibleChunks_.clear();
+		primitives_.clear();
+		primitiveRuns_.clear();
+		frameInstanceCount_ = 0;
+		sceneSlotCount_ = 0;
+		liveSecondaryCount_ = 0;
 	}
 
 
-	void Renderer::DrawTexture(int x, int y, float rot, Texture& texture) {
+	void Renderer::DrawTexture(int x, int y, float rot, Texture& texture, uint8_t layer, PackedColor tint, BlendMode blend) {
+		// already recorded, replayed from the layer cache
+		if (layerCaches_[layer].valid) return;
+		TextureManager::Instance().Touch(texture);
+
+		uint16_t order = (uint16_t)std::min<uint32_t>(layerOrder_[layer]++, 0xFFFF);
+		uint64_t key = makeSortKey(layer, uint32_t(blend), SpritePipeline, texture.GetId(), order);
+		sprites_.push_back(SpriteDraw{ &texture, key, tint });
+		spriteTransforms_.Push(float(x), float(y), glm::radians(rot), 400.0f, 400.0f);
+	}
+
+	void Renderer::DrawVirtualTexture(VirtualTexture& texture, uint8_t layer) {
 		auto& ctx = Context::GetInstance();
-		auto& device = ctx.device;
-		auto& layout = ctx.renderProcess->layout;
 
-		vk::DeviceSize offset = 0;
-		cmdBuffers[curFrame].bindVertexBuffers(0, hostVertexBuffer_->buffer, offset);
-		cmdBuffers[curFrame].bindIndexBuffer(hostIndicesBuffer_->buffer, 0, vk::IndexType::eUint32);
-		cmdBuffers[curFrame].bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
-			layout,
-			0, { descriptorManagers[curFrame].set, texture.set.set }, {});
-		glm::mat4x4 modelMat(1.0f);
-		modelMat = glm::translate(modelMat,{ float(x), float(y), 0 });
-		modelMat = glm::scale(modelMat, { 400.0, 400.0, 0 });
-		modelMat = glm::rotate(modelMat, glm::radians(rot),{ 0, 0, 1 });
-		cmdBuffers[curFrame].pushConstants(layout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(glm::mat4x4), (void*)&modelMat);
-		cmdBuffers[curFrame].drawIndexed(6, 1, 0, 0, 0);
+		// uploads go out on their own submit now, ahead of this frame's command buffer
+		float pixelsPerUnit = ctx.swapchain->info.imageExtent.width / (viewRect.maxX - viewRect.minX);
+		texture.update(curFrame, frameCounter, viewRect, pixelsPerUnit);
+
+		uint64_t key = makeSortKey(layer, PremultipliedBlend, VirtualTexturePipeline, 0, 0);
+		drawItems_.push_back(SortItem{ key, (uint32_t)customDraws_.size() | CustomDrawBit });
+		customDraws_.push_back([this, &texture](vk::CommandBuffer cmd) {
+			vk::DeviceSize offset = 0;
+			cmd.bindVertexBuffers(0, hostVertexBuffer_->buffer, offset);
+			cmd.bindIndexBuffer(hostIndicesBuffer_->buffer, 0, vk::IndexType::eUint16);
+			texture.draw(cmd, descriptorManagers[curFrame].set);
+		});
+	}
+
+	void Renderer::DrawScene(Scene& scene) {
+		// the record uploads go out on their own submit in EndRender, ahead of this frame's command
+		// buffer, so changes between two DrawScene calls of a frame share one upload
+		if (scene.frame_ != frameCounter) {
+			frameScenes_.push_back(&scene);
+		}
+		scene.update(curFrame, frameCounter);
+
+		if (scene.gpuCulling_) {
+			// the cull pass goes into this frame's command buffer ahead of the render pass
+			scene.cull(cmdBuffers[curFrame], curFrame, frameCounter, viewRect);
+			for (uint32_t group = 0; group < scene.groups_.size(); group++) {
+				auto& g = scene.groups_[group];
+				if (g.count == 0) continue;
+				TextureManager::Instance().Touch(*g.texture);
+				uint64_t key = makeSortKey(g.layer, PremultipliedBlend, ScenePipeline, g.texture->GetId(), 0);
+				drawItems_.push_back(SortItem{ key, (uint32_t)sceneGroups_.size() | SceneGroupBit });
+				sceneGroups_.push_back(SceneGroupDraw{ &scene, group, g.texture });
+			}
+			return;
+		}
+
+		visibleSprites_.clear();
+		scene.grid_.Query(viewRect, visibleSprites_);
+		sceneCulled_ += uint32_t(scene.grid_.Size() - visibleSprites_.size());
+		for (uint32_t slot : visibleSprites_) {
+			auto& sprite = scene.sprites_[slot];
+			TextureManager::Instance().Touch(*sprite.texture);
+			uint64_t key = makeSortKey(sprite.layer, PremultipliedBlend, ScenePipeline, sprite.texture->GetId(), 0);
+			drawItems_.push_back(SortItem{ key, (uint32_t)sceneDraws_.size() | SceneDrawBit });
+			sceneDraws_.push_back(SceneDraw{ &scene, slot, sprite.texture });
+		}
+	}
+
+	void Renderer::DrawText(Font& font, std::string_view text, float x, float y, float size, PackedColor color, uint8_t layer) {
+		if (font.frame_ != frameCounter) {
+			font.beginFrame(frameCounter, curFrame);
+			frameFonts_.push_back(&font);
+		}
+
+		// same depth scheme as the sprites, so text and sprites of a layer keep submission order
+		uint16_t order = (uint16_t)std::min<uint32_t>(layerOrder_[layer]++, 0xFFFF);
+		uint64_t key = makeSortKey(layer, PremultipliedBlend, TextPipeline, font.id_, order);
+		uint32_t first = uint32_t(glyphs_.size());
+		Rect bounds;
+		font.layout(text, x, y, size, color, spriteDepth(key), glyphs_, bounds);
+		if (glyphs_.size() == first) return;
+		if (!bounds.Intersects(viewRect)) {
+			glyphs_.resize(first);
+			textCulled_++;
+			return;
+		}
+		drawItems_.push_back(SortItem{ key, (uint32_t)textDraws_.size() | TextDrawBit });
+		textDraws_.push_back(TextDraw{ &font, first, uint32_t(glyphs_.size() - first) });
+	}
+
+	void Renderer::DrawParticles(ParticleSystem& particles, uint8_t layer) {
+		// the compute passes go into this frame's command buffer ahead of the render pass
+		particles.simulate(cmdBuffers[curFrame], curFrame, frameCounter);
+		TextureManager::Instance().Touch(*particles.texture_);
+
+		uint16_t order = (uint16_t)std::min<uint32_t>(layerOrder_[layer]++, 0xFFFF);
+		uint64_t key = makeSortKey(layer, uint32_t(particles.blend_), ParticlePipeline, particles.texture_->GetId(), order);
+		drawItems_.push_back(SortItem{ key, (uint32_t)particleDraws_.size() | ParticleDrawBit });
+		particleDraws_.push_back(&particles);
+	}
+
+	void Renderer::DrawTilemap(Tilemap& map, uint8_t layer) {
+		// the chunk uploads go out on their own submit, ahead of this frame's command buffer
+		map.update(curFrame, frameCounter);
+
+		uint32_t first = uint32_t(visibleChunks_.size());
+		map.visibleChunks(viewRect, visibleChunks_);
+		if (visibleChunks_.size() == first) return;
+		TextureManager::Instance().Touch(*map.tileset_);
+
+		uint16_t order = (uint16_t)std::min<uint32_t>(layerOrder_[layer]++, 0xFFFF);
+		uint64_t key = makeSortKey(layer, PremultipliedBlend, TilemapPipeline, map.tileset_->GetId(), order);
+		drawItems_.push_back(SortItem{ key, (uint32_t)tilemapDraws_.size() | TilemapDrawBit });
+		tilemapDraws_.push_back(TilemapDraw{ &map, first, uint32_t(visibleChunks_.size() - first) });
+	}
+
+	void Renderer::DrawLine(float x0, float y0, float x1, float y1, PackedColor color, float width, uint8_t layer) {
+		addPrimitive(PrimitiveInstance{ x0, y0, x1, y1, width, color, PrimitiveInstance::Line }, layer);
+	}
+
+	void Renderer::DrawRect(float x, float y, float w, float h, PackedColor color, float outline, uint8_t layer) {
+		addPrimitive(PrimitiveInstance{ x, y, x + w, y + h, outline, color, PrimitiveInstance::Rect }, layer);
+	}
+
+	void Renderer::DrawCircle(float x, float y, float radius, PackedColor color, float outline, uint8_t layer) {
+		addPrimitive(PrimitiveInstance{ x, y, radius, 0, outline, color, PrimitiveInstance::Circle }, layer);
+	}
+
+	void Renderer::DrawToTarget(RenderTarget& color, RenderTarget* depth, const std::array<float, 4>& clear,
+		std::function<void(vk::CommandBuffer)> draw) {
+		auto& cmd = cmdBuffers[curFrame];
+		auto extent = color.GetDesc().extent;
+
+		std::array<vk::ClearValue, 2> clearValues;
+		clearValues[0].setColor(vk::ClearColorValue(clear));
+		clearValues[1].setDepthStencil(vk::ClearDepthStencilValue(0.0f, 0));
+		vk::RenderPass pass;
+		vk::Framebuffer framebuffer = renderTargets_->GetFramebuffer(color, depth, pass);
+		vk::RenderPassBeginInfo passBeginInfo;
+		passBeginInfo.setRenderPass(pass)
+			.setFramebuffer(framebuffer)
+			.setRenderArea(vk::Rect2D({ 0, 0 }, extent))
+			.setClearValueCount(depth ? 2 : 1)
+			.setPClearValues(clearValues.data());
+		cmd.beginRenderPass(passBeginInfo, vk::SubpassContents::eInline);
+		cmd.setViewport(0, vk::Viewport(0, 0, float(extent.width), float(extent.height), 0, 1));
+		cmd.setScissor(0, vk::Rect2D({ 0, 0 }, extent));
+		draw(cmd);
+		cmd.endRenderPass();
+
+		renderTargets_->Touch(color);
+		if (depth) renderTargets_->Touch(*depth);
+	}
+
+	void Renderer::addPrimitive(PrimitiveInstance primitive, uint8_t layer) {
+		// nothing else was drawn on the layer since the last primitive, so it joins that run
+		uint64_t runKey = primitiveRunKey_;
+		bool extend = !primitiveRuns_.empty() && (runKey >> 56) == layer &&
+			layerOrder_[layer] == (runKey & 0xFFFF) + 1;
+		if (!extend) {
+			if (!primitiveVert_) primitivePipeline();
+			uint16_t order = (uint16_t)std::min<uint32_t>(layerOrder_[layer]++, 0xFFFF);
+			runKey = makeSortKey(layer, PremultipliedBlend, PrimitivePipeline, 0, order);
+			primitiveRunKey_ = runKey;
+			drawItems_.push_back(SortItem{ runKey, (uint32_t)primitiveRuns_.size() | PrimitiveDrawBit });
+			primitiveRuns_.push_back(PrimitiveRun{ uint32_t(primitives_.size()), 0 });
+		}
+		primitive.depth = spriteDepth(runKey);
+		primitives_.push_back(primitive);
+		primitiveRuns_.back().count++;
+	}
+
+	vk::Pipeline Renderer::primitivePipeline() {
+		auto& renderProcess = Context::GetInstance().renderProcess;
+		if (!primitiveVert_) {
+			primitiveVert_ = Shader::CreateModule(ReadWholeFile(GetShaderPath("primitives_vert.spv")));
+			primitiveFrag_ = Shader::CreateModule(ReadWholeFile(GetShaderPath("primitives_frag.spv")));
+			primitiveInput_.bindings = { Vertex::GetBinding(), PrimitiveInstance::GetBinding() };
+			primitiveInput_.attributes = Vertex::GetAttribute();
+			auto instanceAttr = PrimitiveInstance::GetAttribute();
+			primitiveInput_.attributes.insert(primitiveInput_.attributes.end(), instanceAttr.begin(), instanceAttr.end());
+		}
+		PipelineKey key;
+		key.layout = renderProcess->layout;
+		key.vertex = primitiveVert_;
+		key.fragment = primitiveFrag_;
+		key.input = &primitiveInput_;
+		if (renderProcess->HasDepth()) {
+			key.depth = DepthMode::Test;
+		}
+		return renderProcess->pipelines.TryGet(key);
+	}
 
+	void Renderer::pushPixelSize(vk::CommandBuffer cmd, vk::PipelineLayout layout) {
+		auto extent = Context::GetInstance().swapchain->info.imageExtent;
+		std::array<float, 2> pixel = {
+			std::abs(viewRect.maxX - viewRect.minX) / float(extent.width),
+			std::abs(viewRect.maxY - viewRect.minY) / float(extent.height) };
+		cmd.pushConstants(layout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(pixel), pixel.data());
 	}
 
 	void Renderer::EndRender() {
 		auto& ctx = Context::GetInstance();
 		auto& device = ctx.device;
 		auto& swapchain = ctx.swapchain;
+		auto& cmd = cmdBuffers[curFrame];
+
+		stats_ = FrameStats{};
+		spriteAffines_.resize(spriteTransforms_.Size());
+		TransformBatch(spriteTransforms_, spriteAffines_.data(), sinCosMode_);
+		spriteBounds_.Clear();
+		for (auto& m : spriteAffines_) {
+			// box around the unit quad [-0.5, 0.5] moved by m
+			float hx = 0.5f * (std::abs(m.a) + std::abs(m.c));
+			float hy = 0.5f * (std::abs(m.b) + std::abs(m.d));
+			spriteBounds_.Push(Rect{ m.tx - hx, m.ty - hy, m.tx + hx, m.ty + hy });
+		}
+		// opaque sprites go into the early front to back pass up to the first layer with draws that
+		// don't test depth, above it they would be painted over
+		uint32_t earlyLayers = 0;
+		if (ctx.renderProcess->HasDepth()) {
+			earlyLayers = 256;
+			for (auto& item : drawItems_) {
+				// text, particles, tilemaps and primitives test depth like the sprites
+				if (item.index & (TextDrawBit | ParticleDrawBit | TilemapDrawBit | PrimitiveDrawBit)) continue;
+				earlyLayers = std::min(earlyLayers, uint32_t(item.key >> 56) + 1);
+			}
+		}
+		visibleSprites_.clear();
+		CullBounds(spriteBounds_, viewRect, visibleSprites_);
+		size_t firstSprite = drawItems_.size();
+		for (uint32_t index : visibleSprites_) {
+			uint64_t key = sprites_[index].key;
+			uint32_t layer = uint32_t(key >> 56);
+			if (layerCaches_[layer].isStatic) continue;
+			if (layer < earlyLayers && blendOf(key) == BlendMode::Opaque) {
+				// nearest layer first, the textures stay grouped inside a layer
+				uint64_t earlyKey = makeSortKey(uint8_t(255 - layer), uint32_t(BlendMode::Opaque), SpritePipeline,
+					uint32_t(key >> 16) & 0xFFFFFF, uint16_t(0xFFFF - (key & 0xFFFF)));
+				opaqueItems_.push_back(SortItem{ earlyKey, index });
+				continue;
+			}
+			drawItems_.push_back(SortItem{ key, index });
+		}
+		if (staticLayerCount_ > 0) {
+			// static layers are recorded once and replayed under any view, so none of them is culled
+			for (uint32_t index = 0; index < sprites_.size(); index++) {
+				if (layerCaches_[sprites_[index].key >> 56].isStatic) {
+					drawItems_.push_back(SortItem{ sprites_[index].key, index });
+				}
+			}
+		}
+		stats_.culled = uint32_t(sprites_.size() - (drawItems_.size() - firstSprite) - opaqueItems_.size()) + sceneCulled_ + textCulled_;
+		stats_.draws = uint32_t(drawItems_.size() + opaqueItems_.size());
+		uint32_t unsortedChanges = countStateChanges(drawItems_) + countStateChanges(opaqueItems_);
+		RadixSort(drawItems_, sortScratch_);
+		RadixSort(opaqueItems_, sortScratch_);
+		stats_.stateChanges = countStateChanges(drawItems_) + countStateChanges(opaqueItems_);
+		stats_.stateChangesAvoided = unsortedChanges > stats_.stateChanges ? unsortedChanges - stats_.stateChanges : 0;
+
+		reserveFrameBuffer(instanceBuffers_[curFrame], sprites_.size() * sizeof(SpriteInstance));
+		reserveFrameBuffer(sceneSlotBuffers_[curFrame], sceneDraws_.size() * sizeof(uint32_t));
+		// laid out in DrawText already, copied in one go
+		reserveFrameBuffer(glyphBuffers_[curFrame], glyphs_.size() * sizeof(GlyphInstance));
+		if (!glyphs_.empty()) {
+			memcpy(glyphBuffers_[curFrame]->map, glyphs_.data(), glyphs_.size() * sizeof(GlyphInstance));
+		}
+		reserveFrameBuffer(primitiveBuffers_[curFrame], primitives_.size() * sizeof(PrimitiveInstance));
+		if (!primitives_.empty()) {
+			memcpy(primitiveBuffers_[curFrame]->map, primitives_.data(), primitives_.size() * sizeof(PrimitiveInstance));
+		}
+		frameGraph_->record(cmd);
+		if (overdraw_) {
+			overdraw_->BeginStatistics(cmd, curFrame, frameCounter);
+		}
+		if (staticLayerCount_ == 0) {
+			beginMainPass(cmd, false);
+			recordDraws(cmd, opaqueItems_.data(), opaqueItems_.size());
+			recordDraws(cmd, drawItems_.data(), drawItems_.size());
+		} else {
+			// a subpass with secondaries may not record anything inline
+			beginMainPass(cmd, true);
+			recordLayers(cmd);
+		}
+		endMainPass(cmd);
+		if (overdraw_) {
+			overdraw_->EndStatistics(cmd, curFrame);
+			recordOverdraw(cmd);
+		}
+		cmd.end();
 
-		cmdBuffers[curFrame].endRenderPass();
-		cmdBuffers[curFrame].end();
+		// new glyphs go out ahead of the frame that samples them
+		for (auto font : frameFonts_) {
+			font->flush();
+		}
+		for (auto scene : frameScenes_) {
+			scene->flush();
+		}
 
 		vk::SubmitInfo submitInfo;
 		vk::PipelineStageFlags stagemask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
@@ -187,6 +590,695 @@ namespace toy2d {
 	}
 
 
+	void Renderer::beginMainPass(vk::CommandBuffer cmd, bool secondaries) {
+		auto& ctx = Context::GetInstance();
+		auto& swapchain = ctx.swapchain;
+		bool depth = ctx.renderProcess->HasDepth();
+		vk::Rect2D area({ 0,0 }, { swapchain->info.imageExtent });
+		std::array<vk::ClearValue, 2> clearValues;
+		clearValues[0].setColor(vk::ClearColorValue({ 0.1f, 0.1f, 0.1f, 1.0f }));
+		// 0 is the farthest, every sprite is in front of it
+		clearValues[1].setDepthStencil(vk::ClearDepthStencilValue(0.0f, 0));
+
+		if (!ctx.useDynamicRendering) {
+			vk::RenderPassBeginInfo passbeginInfo;
+			passbeginInfo.setRenderPass(ctx.renderProcess->renderPass)
+				.setRenderArea(area)
+				.setFramebuffer(swapchain->frameBuffers[imageIndex])
+				.setClearValueCount(depth ? 2 : 1)
+				.setPClearValues(clearValues.data());
+			cmd.beginRenderPass(&passbeginInfo, secondaries ? vk::SubpassContents::eSecondaryCommandBuffers : vk::SubpassContents::eInline);
+			return;
+		}
+
+		// what the render pass's layouts and dependency did: the acquired image and the shared
+		// depth image start undefined, the depth clear waits for the previous frame's tests
+		std::array<vk::ImageMemoryBarrier, 2> barriers;
+		vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+		barriers[0].setImage(swapchain->images[imageIndex])
+			.setOldLayout(vk::ImageLayout::eUndefined)
+			.setNewLayout(vk::ImageLayout::eColorAttachmentOptimal)
+			.setDstAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+			.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+			.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+			.setSubresourceRange(range);
+		range.setAspectMask(vk::ImageAspectFlagBits::eDepth);
+		barriers[1].setImage(swapchain->depthImage)
+			.setOldLayout(vk::ImageLayout::eUndefined)
+			.setNewLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
+			.setSrcAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+			.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+			.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+			.setSubresourceRange(range);
+		vk::PipelineStageFlags srcStages = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+		vk::PipelineStageFlags dstStages = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+		if (depth) {
+			srcStages |= vk::PipelineStageFlagBits::eLateFragmentTests;
+			dstStages |= vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+		}
+		cmd.pipelineBarrier(srcStages, dstStages, {}, {}, {},
+			vk::ArrayProxy<const vk::ImageMemoryBarrier>(depth ? 2u : 1u, barriers.data()));
+
+		vk::RenderingAttachmentInfo colorAttachment;
+		colorAttachment.setImageView(swapchain->imageViews[imageIndex])
+			.setImageLayout(vk::ImageLayout::eColorAttachmentOptimal)
+			.setLoadOp(vk::AttachmentLoadOp::eClear)
+			.setStoreOp(vk::AttachmentStoreOp::eStore)
+			.setClearValue(clearValues[0]);
+		vk::RenderingAttachmentInfo depthAttachment;
+		depthAttachment.setImageView(swapchain->depthView)
+			.setImageLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
+			.setLoadOp(vk::AttachmentLoadOp::eClear)
+			.setStoreOp(vk::AttachmentStoreOp::eDontCare)
+			.setClearValue(clearValues[1]);
+		vk::RenderingInfo renderingInfo;
+		renderingInfo.setRenderArea(area)
+			.setLayerCount(1)
+			.setColorAttachments(colorAttachment);
+		if (depth) {
+			renderingInfo.setPDepthAttachment(&depthAttachment);
+		}
+		if (secondaries) {
+			renderingInfo.setFlags(vk::RenderingFlagBits::eContentsSecondaryCommandBuffers);
+		}
+		cmd.beginRendering(renderingInfo);
+		// secondaries set their own, beginSecondary does it
+		if (!secondaries) {
+			setMainViewport(cmd);
+		}
+	}
+
+	void Renderer::endMainPass(vk::CommandBuffer cmd) {
+		auto& ctx = Context::GetInstance();
+		if (!ctx.useDynamicRendering) {
+			cmd.endRenderPass();
+			return;
+		}
+
+		cmd.endRendering();
+		vk::ImageMemoryBarrier barrier;
+		barrier.setImage(ctx.swapchain->images[imageIndex])
+			.setOldLayout(vk::ImageLayout::eColorAttachmentOptimal)
+			.setNewLayout(vk::ImageLayout::ePresentSrcKHR)
+			.setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite)
+			.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+			.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+			.setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eBottomOfPipe,
+			{}, {}, {}, barrier);
+	}
+
+	void Renderer::setMainViewport(vk::CommandBuffer cmd) {
+		if (!Context::GetInstance().useDynamicRendering) return;
+		auto extent = Context::GetInstance().swapchain->info.imageExtent;
+		cmd.setViewport(0, vk::Viewport(0, 0, float(extent.width), float(extent.height), 0, 1));
+		cmd.setScissor(0, vk::Rect2D({ 0, 0 }, extent));
+	}
+
+	void Renderer::recordDraws(vk::CommandBuffer cmd, const SortItem* items, size_t count) {
+		auto& ctx = Context::GetInstance();
+		auto& layout = ctx.renderProcess->layout;
+
+		// several calls in one frame append to the same per frame buffers
+		auto& instanceBuffer = instanceBuffers_[curFrame];
+		auto& slotBuffer = sceneSlotBuffers_[curFrame];
+		SpriteInstance* instances = (SpriteInstance*)instanceBuffer->map;
+		uint32_t* slots = (uint32_t*)slotBuffer->map;
+		uint32_t& instanceCount = frameInstanceCount_;
+		uint32_t& slotCount = sceneSlotCount_;
+
+		// what the command buffer has bound right now
+		bool spriteStateBound = false;
+		BlendMode spriteBlend = BlendMode::Premultiplied;
+		Scene* boundScene = nullptr;
+		Scene* boundGroupScene = nullptr;
+		Texture* boundTexture = nullptr;
+		size_t i = 0;
+		while (i < count) {
+			uint32_t index = items[i].index;
+			if (index & CustomDrawBit) {
+				// custom draws bind their own pipeline and buffers
+				customDraws_[index & ~DrawKindMask](cmd);
+				spriteStateBound = false;
+				boundScene = nullptr;
+				boundGroupScene = nullptr;
+				boundTexture = nullptr;
+				stats_.batches++;
+				i++;
+				continue;
+			}
+
+			if (index & TextDrawBit) {
+				auto& draw = textDraws_[index & ~DrawKindMask];
+				Font* font = draw.font;
+				uint32_t first = draw.firstGlyph;
+				uint32_t end = first + draw.glyphCount;
+				i++;
+				// labels of a font submitted back to back have adjacent glyph ranges
+				while (i < count && (items[i].index & TextDrawBit)) {
+					auto& next = textDraws_[items[i].index & ~DrawKindMask];
+					if (next.font != font || next.firstGlyph != end) break;
+					end += next.glyphCount;
+					i++;
+				}
+				vk::Pipeline pipeline = font->pipeline();
+				if (!pipeline) {
+					// still compiling, the text shows up a frame or two later
+					stats_.pipelineFallbacks++;
+					continue;
+				}
+				std::array<vk::Buffer, 2> buffers = { hostVertexBuffer_->buffer, glyphBuffers_[curFrame]->buffer };
+				std::array<vk::DeviceSize, 2> offsets = { 0, 0 };
+				cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+				cmd.bindVertexBuffers(0, buffers, offsets);
+				cmd.bindIndexBuffer(hostIndicesBuffer_->buffer, 0, vk::IndexType::eUint16);
+				cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, descriptorManagers[curFrame].set, {});
+				font->bind(cmd, layout);
+				spriteStateBound = false;
+				boundScene = nullptr;
+				boundGroupScene = nullptr;
+				boundTexture = nullptr;
+				cmd.drawIndexed(6, end - first, 0, 0, first);
+				stats_.batches++;
+				continue;
+			}
+
+			if (index & PrimitiveDrawBit) {
+				auto& run = primitiveRuns_[index & ~DrawKindMask];
+				uint32_t first = run.first;
+				uint32_t end = first + run.count;
+				i++;
+				// runs of a layer with nothing drawn in between are contiguous
+				while (i < count && (items[i].index & PrimitiveDrawBit)) {
+					auto& next = primitiveRuns_[items[i].index & ~DrawKindMask];
+					if (next.first != end) break;
+					end += next.count;
+					i++;
+				}
+				vk::Pipeline pipeline = primitivePipeline();
+				if (!pipeline) {
+					stats_.pipelineFallbacks++;
+					continue;
+				}
+				std::array<vk::Buffer, 2> buffers = { hostVertexBuffer_->buffer, primitiveBuffers_[curFrame]->buffer };
+				std::array<vk::DeviceSize, 2> offsets = { 0, 0 };
+				cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+				cmd.bindVertexBuffers(0, buffers, offsets);
+				cmd.bindIndexBuffer(hostIndicesBuffer_->buffer, 0, vk::IndexType::eUint16);
+				cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, descriptorManagers[curFrame].set, {});
+				pushPixelSize(cmd, layout);
+				spriteStateBound = false;
+				boundScene = nullptr;
+				boundGroupScene = nullptr;
+				boundTexture = nullptr;
+				cmd.drawIndexed(6, end - first, 0, 0, first);
+				stats_.batches++;
+				continue;
+			}
+
+			if (index & TilemapDrawBit) {
+				auto& draw = tilemapDraws_[index & ~DrawKindMask];
+				vk::Pipeline pipeline = draw.map->pipeline();
+				if (!pipeline) {
+					stats_.pipelineFallbacks++;
+					i++;
+					continue;
+				}
+				cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+				cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, descriptorManagers[curFrame].set, {});
+				// one tileset bind for every visible chunk
+				draw.map->tileset_->Bind(cmd, layout);
+				draw.map->draw(cmd, layout, visibleChunks_.data() + draw.firstChunk, draw.chunkCount, spriteDepth(items[i].key));
+				spriteStateBound = false;
+				boundScene = nullptr;
+				boundGroupScene = nullptr;
+				boundTexture = nullptr;
+				stats_.batches += draw.chunkCount;
+				i++;
+				continue;
+			}
+
+			if (index & ParticleDrawBit) {
+				ParticleSystem* particles = particleDraws_[index & ~DrawKindMask];
+				vk::Pipeline pipeline = particles->pipeline();
+				if (!pipeline) {
+					stats_.pipelineFallbacks++;
+					i++;
+					continue;
+				}
+				vk::DeviceSize offset = 0;
+				cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+				cmd.bindVertexBuffers(0, hostVertexBuffer_->buffer, offset);
+				cmd.bindIndexBuffer(hostIndicesBuffer_->buffer, 0, vk::IndexType::eUint16);
+				particles->draw(cmd, descriptorManagers[curFrame].set, spriteDepth(items[i].key));
+				spriteStateBound = false;
+				boundScene = nullptr;
+				boundGroupScene = nullptr;
+				boundTexture = nullptr;
+				stats_.batches++;
+				i++;
+				continue;
+			}
+
+			if (index & SceneGroupBit) {
+				auto& draw = sceneGroups_[index & ~DrawKindMask];
+				Scene* scene = draw.scene;
+				auto& cull = scene->cullFrames_[curFrame];
+				if (scene != boundGroupScene) {
+					std::array<vk::Buffer, 2> buffers = { hostVertexBuffer_->buffer, cull.visible->buffer };
+					std::array<vk::DeviceSize, 2> offsets = { 0, 0 };
+					cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, scene->pipeline_);
+					cmd.bindVertexBuffers(0, buffers, offsets);
+					cmd.bindIndexBuffer(hostIndicesBuffer_->buffer, 0, vk::IndexType::eUint16);
+					cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, scene->pipelineLayout_, 0, descriptorManagers[curFrame].set, {});
+					cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, scene->pipelineLayout_, 2, scene->set_, {});
+					boundGroupScene = scene;
+					boundScene = nullptr;
+					spriteStateBound = false;
+					boundTexture = nullptr;
+				}
+				if (draw.texture != boundTexture) {
+					draw.texture->Bind(cmd, scene->pipelineLayout_);
+					boundTexture = draw.texture;
+				}
+
+				// the instance count and where the group's slots start were written by the cull pass
+				vk::DeviceSize offset = vk::DeviceSize(draw.group) * sizeof(vk::DrawIndexedIndirectCommand);
+				cmd.drawIndexedIndirect(cull.commands->buffer, offset, 1, sizeof(vk::DrawIndexedIndirectCommand));
+				stats_.batches++;
+				i++;
+				continue;
+			}
+
+			if (index & SceneDrawBit) {
+				auto& draw = sceneDraws_[index & ~DrawKindMask];
+				Scene* scene = draw.scene;
+				if (scene != boundScene) {
+					std::array<vk::Buffer, 2> buffers = { hostVertexBuffer_->buffer, slotBuffer->buffer };
+					std::array<vk::DeviceSize, 2> offsets = { 0, 0 };
+					cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, scene->pipeline_);
+					cmd.bindVertexBuffers(0, buffers, offsets);
+					cmd.bindIndexBuffer(hostIndicesBuffer_->buffer, 0, vk::IndexType::eUint16);
+					cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, scene->pipelineLayout_, 0, descriptorManagers[curFrame].set, {});
+					cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, scene->pipelineLayout_, 2, scene->set_, {});
+					boundScene = scene;
+					boundGroupScene = nullptr;
+					spriteStateBound = false;
+					boundTexture = nullptr;
+				}
+				if (draw.texture != boundTexture) {
+					draw.texture->Bind(cmd, scene->pipelineLayout_);
+					boundTexture = draw.texture;
+				}
+
+				// the records already live on the gpu, only their indices are written per frame
+				uint32_t firstInstance = slotCount;
+				while (i < count) {
+					uint32_t next = items[i].index;
+					if (!(next & SceneDrawBit)) break;
+					auto& nextDraw = sceneDraws_[next & ~DrawKindMask];
+					if (nextDraw.scene != scene || nextDraw.texture != boundTexture) break;
+					slots[slotCount++] = nextDraw.slot;
+					i++;
+				}
+				cmd.drawIndexed(6, slotCount - firstInstance, 0, 0, firstInstance);
+				stats_.batches++;
+				continue;
+			}
+
+			// blend modes sort before textures, each one is a pipeline variant of its own
+			BlendMode blend = blendOf(items[i].key);
+			if (!spriteStateBound || blend != spriteBlend) {
+				bool fallback;
+				vk::Pipeline pipeline = readySpritePipeline(blend, fallback);
+				if (fallback) stats_.pipelineFallbacks++;
+				if (!pipeline) {
+					// the whole run of this blend mode waits for its pipeline
+					while (i < count && !(items[i].index & DrawKindMask) && blendOf(items[i].key) == blend) i++;
+					continue;
+				}
+				std::array<vk::Buffer, 2> buffers = { hostVertexBuffer_->buffer, instanceBuffer->buffer };
+				std::array<vk::DeviceSize, 2> offsets = { 0, 0 };
+				cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+				cmd.bindVertexBuffers(0, buffers, offsets);
+				cmd.bindIndexBuffer(hostIndicesBuffer_->buffer, 0, vk::IndexType::eUint16);
+				cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, descriptorManagers[curFrame].set, {});
+				spriteStateBound = true;
+				spriteBlend = blend;
+				boundScene = nullptr;
+				boundGroupScene = nullptr;
+				boundTexture = nullptr;
+			}
+			Texture* texture = sprites_[index].texture;
+			if (texture != boundTexture) {
+				texture->Bind(cmd, layout);
+				boundTexture = texture;
+			}
+
+			// one instanced draw for the run of sprites sharing this texture
+			uint32_t firstInstance = instanceCount;
+			while (i < count) {
+				uint32_t next = items[i].index;
+				if ((next & DrawKindMask) || sprites_[next].texture != texture || blendOf(items[i].key) != blend) break;
+				auto& m = spriteAffines_[next];
+				auto& sprite = sprites_[next];
+				instances[instanceCount++] = makeSpriteInstance(m, spriteTransforms_.scaleX[next], spriteTransforms_.scaleY[next],
+					sprite.tint, spriteDepth(sprite.key));
+				i++;
+			}
+			cmd.drawIndexed(6, instanceCount - firstInstance, 0, 0, firstInstance);
+			stats_.batches++;
+		}
+	}
+
+	void Renderer::SetLayerStatic(uint8_t layer, bool isStatic) {
+		auto& cache = layerCaches_[layer];
+		if (cache.isStatic == isStatic) return;
+		cache.isStatic = isStatic;
+		if (isStatic) {
+			staticLayerCount_++;
+		} else {
+			staticLayerCount_--;
+			retireLayerCache(cache, false);
+		}
+	}
+
+	void Renderer::InvalidateLayer(uint8_t layer) {
+		retireLayerCache(layerCaches_[layer], false);
+	}
+
+	void Renderer::recordLayers(vk::CommandBuffer cmd) {
+		auto& ctx = Context::GetInstance();
+		const SortItem* items = drawItems_.data();
+		size_t count = drawItems_.size();
+
+		executes_.clear();
+		recordLive(opaqueItems_.data(), opaqueItems_.size());
+		size_t liveBegin = 0;
+		size_t i = 0;
+		for (uint32_t layer = 0; layer < layerCaches_.size(); layer++) {
+			size_t end = i;
+			while (end < count && (items[end].key >> 56) == layer) end++;
+			auto& cache = layerCaches_[layer];
+			if (!cache.isStatic) {
+				i = end;
+				continue;
+			}
+
+			// sprites of every blend mode sort first inside a layer, whatever follows them stays live
+			size_t split = i;
+			while (split < end && !(items[split].index & DrawKindMask)) split++;
+
+			recordLive(items + liveBegin, i - liveBegin);
+			if (!cache.valid && split > i) {
+				buildLayerCache(cache, items + i, split - i);
+			}
+			if (cache.valid) {
+				bool stale = cache.pipeline != ctx.renderProcess->graphicsPipeline ||
+					cache.renderPass != ctx.renderProcess->renderPass;
+				for (auto& batch : cache.batches) {
+					// a reload rewrites the descriptor set the recorded commands bind
+					if (!batch.texture->IsResident()) stale = true;
+					TextureManager::Instance().Touch(*batch.texture);
+				}
+				if (cache.provisional) {
+					// recorded with stand-ins, redone once every variant it needs is compiled
+					bool ready = true;
+					for (auto& batch : cache.batches) {
+						if (!ctx.renderProcess->TryGetSpritePipeline(batch.blend)) ready = false;
+					}
+					if (ready) stale = true;
+				}
+				if (stale) {
+					retireLayerCache(cache, true);
+				}
+				if (cache.cmds.empty()) {
+					recordLayerCache(cache);
+				} else {
+					stats_.cachedLayers++;
+				}
+				executes_.push_back(cache.cmds[curFrame]);
+			}
+			liveBegin = split;
+			i = end;
+		}
+		recordLive(items + liveBegin, count - liveBegin);
+
+		if (!executes_.empty()) {
+			cmd.executeCommands(executes_);
+		}
+	}
+
+	void Renderer::SetOverdrawMode(bool enable) {
+		if (enable == bool(overdraw_)) return;
+		if (enable) {
+			overdraw_.reset(new OverdrawMeter(maxFlightCount));
+		} else {
+			overdraw_.reset();
+		}
+		overdrawStats_ = OverdrawStats{};
+	}
+
+	void Renderer::recordOverdraw(vk::CommandBuffer cmd) {
+		auto& ctx = Context::GetInstance();
+		auto& layout = ctx.renderProcess->layout;
+		std::array<vk::DeviceSize, 2> offsets = { 0, 0 };
+
+		overdraw_->BeginHeatPass(cmd);
+		cmd.bindIndexBuffer(hostIndicesBuffer_->buffer, 0, vk::IndexType::eUint16);
+
+		// the fragment count doesn't depend on order or texture, so all sprites go in a few draws:
+		// the instances recordDraws wrote this frame and the ones of the static layers
+		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics,
+			overdraw_->GetHeatPipeline(layout, Shader::GetInstance().vertShader, ctx.renderProcess->GetSpriteInput()));
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, descriptorManagers[curFrame].set, {});
+		if (frameInstanceCount_ > 0) {
+			std::array<vk::Buffer, 2> buffers = { hostVertexBuffer_->buffer, instanceBuffers_[curFrame]->buffer };
+			cmd.bindVertexBuffers(0, buffers, offsets);
+			cmd.drawIndexed(6, frameInstanceCount_, 0, 0, 0);
+		}
+		for (auto& cache : layerCaches_) {
+			if (!cache.isStatic || !cache.valid || cache.batches.empty()) continue;
+			auto& last = cache.batches.back();
+			std::array<vk::Buffer, 2> buffers = { hostVertexBuffer_->buffer, cache.instances->buffer };
+			cmd.bindVertexBuffers(0, buffers, offsets);
+			cmd.drawIndexed(6, last.firstInstance + last.instanceCount, 0, 0, 0);
+		}
+
+		// scene sprites, the slots were written in draw order so the runs are walked again
+		auto bindScene = [&](Scene* scene, vk::Buffer instances) {
+			std::array<vk::Buffer, 2> buffers = { hostVertexBuffer_->buffer, instances };
+			cmd.bindPipeline(vk::PipelineBindPoint::eGraphics,
+				overdraw_->GetHeatPipeline(scene->pipelineLayout_, scene->vertModule_, scene->input_));
+			cmd.bindVertexBuffers(0, buffers, offsets);
+			cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, scene->pipelineLayout_, 0, descriptorManagers[curFrame].set, {});
+			cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, scene->pipelineLayout_, 2, scene->set_, {});
+		};
+		uint32_t slot = 0;
+		size_t i = 0;
+		while (i < drawItems_.size()) {
+			uint32_t index = drawItems_[i].index;
+			if (index & SceneGroupBit) {
+				auto& draw = sceneGroups_[index & ~DrawKindMask];
+				auto& cull = draw.scene->cullFrames_[curFrame];
+				bindScene(draw.scene, cull.visible->buffer);
+				vk::DeviceSize offset = vk::DeviceSize(draw.group) * sizeof(vk::DrawIndexedIndirectCommand);
+				cmd.drawIndexedIndirect(cull.commands->buffer, offset, 1, sizeof(vk::DrawIndexedIndirectCommand));
+				i++;
+			} else if (index & TextDrawBit) {
+				auto& draw = textDraws_[index & ~DrawKindMask];
+				std::array<vk::Buffer, 2> buffers = { hostVertexBuffer_->buffer, glyphBuffers_[curFrame]->buffer };
+				cmd.bindPipeline(vk::PipelineBindPoint::eGraphics,
+					overdraw_->GetHeatPipeline(layout, draw.font->vertModule_, draw.font->input_));
+				cmd.bindVertexBuffers(0, buffers, offsets);
+				cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, descriptorManagers[curFrame].set, {});
+				cmd.drawIndexed(6, draw.glyphCount, 0, 0, draw.firstGlyph);
+				i++;
+			} else if (index & PrimitiveDrawBit) {
+				auto& run = primitiveRuns_[index & ~DrawKindMask];
+				std::array<vk::Buffer, 2> buffers = { hostVertexBuffer_->buffer, primitiveBuffers_[curFrame]->buffer };
+				cmd.bindPipeline(vk::PipelineBindPoint::eGraphics,
+					overdraw_->GetHeatPipeline(layout, primitiveVert_, primitiveInput_));
+				cmd.bindVertexBuffers(0, buffers, offsets);
+				cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, descriptorManagers[curFrame].set, {});
+				pushPixelSize(cmd, layout);
+				cmd.drawIndexed(6, run.count, 0, 0, run.first);
+				i++;
+			} else if (index & TilemapDrawBit) {
+				auto& draw = tilemapDraws_[index & ~DrawKindMask];
+				cmd.bindPipeline(vk::PipelineBindPoint::eGraphics,
+					overdraw_->GetHeatPipeline(layout, draw.map->vertModule_, draw.map->input_));
+				cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, descriptorManagers[curFrame].set, {});
+				draw.map->draw(cmd, layout, visibleChunks_.data() + draw.firstChunk, draw.chunkCount, 0);
+				// the sprite draws after this one use the shared quad
+				cmd.bindIndexBuffer(hostIndicesBuffer_->buffer, 0, vk::IndexType::eUint16);
+				i++;
+			} else if (index & ParticleDrawBit) {
+				ParticleSystem* particles = particleDraws_[index & ~DrawKindMask];
+				cmd.bindPipeline(vk::PipelineBindPoint::eGraphics,
+					overdraw_->GetHeatPipeline(particles->pipelineLayout_, particles->vertModule_, particles->input_));
+				cmd.bindVertexBuffers(0, hostVertexBuffer_->buffer, offsets[0]);
+				particles->draw(cmd, descriptorManagers[curFrame].set, 0);
+				i++;
+			} else if (index & SceneDrawBit) {
+				Scene* scene = sceneDraws_[index & ~DrawKindMask].scene;
+				uint32_t first = slot;
+				while (i < drawItems_.size() && (drawItems_[i].index & SceneDrawBit) &&
+					sceneDraws_[drawItems_[i].index & ~DrawKindMask].scene == scene) {
+					slot++;
+					i++;
+				}
+				bindScene(scene, sceneSlotBuffers_[curFrame]->buffer);
+				cmd.drawIndexed(6, slot - first, 0, 0, first);
+			} else {
+				i++;
+			}
+		}
+
+		overdraw_->EndHeatPass(cmd, curFrame);
+	}
+
+	void Renderer::recordLive(const SortItem* items, size_t count) {
+		if (count == 0) return;
+
+		auto& pool = liveSecondaries_[curFrame];
+		if (liveSecondaryCount_ == pool.size()) {
+			pool.push_back(Context::GetInstance().commandManager->CreateCommandBuffers(1, vk::CommandBufferLevel::eSecondary)[0]);
+		}
+		auto cmd = pool[liveSecondaryCount_++];
+		cmd.reset();
+		beginSecondary(cmd, vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+		recordDraws(cmd, items, count);
+		cmd.end();
+		executes_.push_back(cmd);
+	}
+
+	void Renderer::buildLayerCache(LayerCache& cache, const SortItem* items, size_t count) {
+		// written once, the instances stay until the layer is invalidated
+		cache.instances.reset(new Buffer(count * sizeof(SpriteInstance),
+			vk::BufferUsageFlagBits::eVertexBuffer,
+			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+		SpriteInstance* instances = (SpriteInstance*)cache.instances->map;
+
+		cache.batches.clear();
+		for (uint32_t i = 0; i < count; i++) {
+			auto& sprite = sprites_[items[i].index];
+			uint32_t index = items[i].index;
+			instances[i] = makeSpriteInstance(spriteAffines_[index], spriteTransforms_.scaleX[index], spriteTransforms_.scaleY[index],
+				sprite.tint, spriteDepth(sprite.key));
+			BlendMode blend = blendOf(items[i].key);
+			if (cache.batches.empty() || cache.batches.back().texture != sprite.texture || cache.batches.back().blend != blend) {
+				cache.batches.push_back(CachedBatch{ sprite.texture, blend, i, 0 });
+			}
+			cache.batches.back().instanceCount++;
+		}
+		cache.valid = true;
+	}
+
+	void Renderer::recordLayerCache(LayerCache& cache) {
+		auto& ctx = Context::GetInstance();
+		auto& layout = ctx.renderProcess->layout;
+
+		// a frame slot's primary is done before it is recorded again, so no simultaneous use
+		cache.cmds = ctx.commandManager->CreateCommandBuffers(maxFlightCount, vk::CommandBufferLevel::eSecondary);
+		cache.provisional = false;
+		for (int slot = 0; slot < maxFlightCount; slot++) {
+			auto cmd = cache.cmds[slot];
+			beginSecondary(cmd, {});
+
+			std::array<vk::Buffer, 2> buffers = { hostVertexBuffer_->buffer, cache.instances->buffer };
+			std::array<vk::DeviceSize, 2> offsets = { 0, 0 };
+			cmd.bindVertexBuffers(0, buffers, offsets);
+			cmd.bindIndexBuffer(hostIndicesBuffer_->buffer, 0, vk::IndexType::eUint16);
+			vk::Pipeline bound;
+			for (auto& batch : cache.batches) {
+				bool fallback;
+				auto pipeline = readySpritePipeline(batch.blend, fallback);
+				if (fallback) cache.provisional = true;
+				if (!pipeline) continue;
+				if (pipeline != bound) {
+					cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+					if (!bound) {
+						cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, 0, descriptorManagers[slot].set, {});
+					}
+					bound = pipeline;
+				}
+				batch.texture->Bind(cmd, layout);
+				cmd.drawIndexed(6, batch.instanceCount, 0, 0, batch.firstInstance);
+			}
+			cmd.end();
+		}
+		cache.pipeline = ctx.renderProcess->graphicsPipeline;
+		cache.renderPass = ctx.renderProcess->renderPass;
+		stats_.batches += (uint32_t)cache.batches.size();
+	}
+
+	void Renderer::beginSecondary(vk::CommandBuffer cmd, vk::CommandBufferUsageFlags flags) {
+		auto& ctx = Context::GetInstance();
+		// any framebuffer of the swapchain is compatible, so none is named
+		vk::CommandBufferInheritanceInfo inheritance;
+		inheritance.setRenderPass(ctx.renderProcess->renderPass)
+			.setSubpass(0);
+		// dynamic rendering has no render pass to inherit, the formats stand in for it
+		vk::CommandBufferInheritanceRenderingInfo renderingInfo;
+		vk::Format colorFormat = ctx.swapchain->info.format.format;
+		if (ctx.useDynamicRendering) {
+			renderingInfo.setColorAttachmentFormats(colorFormat)
+				.setDepthAttachmentFormat(ctx.renderProcess->depthFormat)
+				.setRasterizationSamples(vk::SampleCountFlagBits::e1);
+			inheritance.setPNext(&renderingInfo);
+		}
+		// lets them run inside the overdraw statistics query, harmless without one
+		if (Context::GetInstance().pipelineStatisticsSupported) {
+			inheritance.setPipelineStatistics(vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations);
+		}
+		vk::CommandBufferBeginInfo beginInfo;
+		beginInfo.setFlags(flags | vk::CommandBufferUsageFlagBits::eRenderPassContinue)
+			.setPInheritanceInfo(&inheritance);
+		cmd.begin(beginInfo);
+		// dynamic state is not inherited
+		setMainViewport(cmd);
+	}
+
+	void Renderer::retireLayerCache(LayerCache& cache, bool keepInstances) {
+		// the command buffers may be pending in frames still in flight
+		if (!cache.cmds.empty() || (!keepInstances && cache.instances)) {
+			RetiredCache retired;
+			retired.cmds = std::move(cache.cmds);
+			if (!keepInstances) retired.instances = std::move(cache.instances);
+			retired.frame = frameCounter;
+			retiredCaches_.push_back(std::move(retired));
+		}
+		cache.cmds.clear();
+		if (!keepInstances) {
+			cache.batches.clear();
+			cache.valid = false;
+		}
+	}
+
+	void Renderer::freeRetiredCaches() {
+		auto& cmdMag = Context::GetInstance().commandManager;
+		auto done = std::remove_if(retiredCaches_.begin(), retiredCaches_.end(), [&](RetiredCache& retired) {
+			if (retired.frame + maxFlightCount > frameCounter) return false;
+			for (auto& cmd : retired.cmds) cmdMag->freeCmds(cmd);
+			return true;
+		});
+		retiredCaches_.erase(done, retiredCaches_.end());
+	}
+
+	void Renderer::reserveFrameBuffer(std::unique_ptr<Buffer>& buffer, size_t size) {
+		size = std::max<size_t>(size, 1);
+		if (buffer && buffer->size >= size) return;
+
+		// the fence of this frame slot was waited in StartRender, the old buffer is idle
+		size_t capacity = buffer ? buffer->size : 4096;
+		while (capacity < size) capacity *= 2;
+		buffer.reset(new Buffer(capacity,
+			vk::BufferUsageFlagBits::eVertexBuffer,
+			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+	}
+
 	void Renderer::createVertexBuffer() {
 		hostVertexBuffer_.reset(new Buffer(sizeof(vertices), 
 			vk::BufferUsageFlagBits::eVertexBuffer,
@@ -295,50 +1387,11 @@ namespace toy2d {
 
 	void Renderer::updateDescriptorSets() {
 		for (size_t i = 0; i < descriptorManagers.size();i++) {
-			
-			// bind MVP buffer
-			vk::DescriptorBufferInfo bufferInfo1;
-			bufferInfo1.setBuffer(deviceUniformBuffers_[i]->buffer)
-				.setRange(sizeof(glm::mat4) * 2) // sizeof(glm::mat4) * 2
-				.setOffset(0);
-
-			std::vector<vk::WriteDescriptorSet> writeInfos(2);
-			writeInfos[0].setDescriptorType(vk::DescriptorType::eUniformBuffer)
-				.setBufferInfo(bufferInfo1)
-				.setDstBinding(0)
-				.setDescriptorType(vk::DescriptorType::eUniformBuffer)
-				.setDescriptorCount(1)
-				.setDstArrayElement(0)
-				.setDstSet(descriptorManagers[i].set);
-
-
-			// bind Color buffer
-			vk::DescriptorBufferInfo bufferInfo2;
-			bufferInfo2.setBuffer(deviceColorBuffers_[i]->buffer)
-				.setOffset(0)
-				.setRange(sizeof(Color));
-
-			writeInfos[1].setBufferInfo(bufferInfo2)
-				.setDstBinding(1)
-				.setDstArrayElement(0)
-				.setDescriptorCount(1)
-				.setDescriptorType(vk::DescriptorType::eUniformBuffer)
-				.setDstSet(descriptorManagers[i].set);
-
-			//// bind image
-			//vk::DescriptorImageInfo imageInfo;
-			//imageInfo.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
-			//	.setImageView(texture->imageView)
-			//	.setSampler(sampler);
-
-			//writeInfos[2].setImageInfo(imageInfo)
-			//	.setDstBinding(2)
-			//	.setDstArrayElement(0)
-			//	.setDescriptorCount(1)
-			//	.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
-			//	.setDstSet(descriptorSets[i]);
-
-			Context::GetInstance().device.updateDescriptorSets(writeInfos, {});
+			// binding 0 is the MVP buffer, binding 1 the color buffer
+			std::array<Shader::DescriptorData, 2> data;
+			data[0].buffer = VkDescriptorBufferInfo{ static_cast<VkBuffer>(deviceUniformBuffers_[i]->buffer), 0, sizeof(glm::mat4) * 2 };
+			data[1].buffer = VkDescriptorBufferInfo{ static_cast<VkBuffer>(deviceColorBuffers_[i]->buffer), 0, sizeof(Color) };
+			Shader::GetInstance().UpdateDescriptorSet(descriptorManagers[i].set, 0, data.data());
 		}
 	}
 
@@ -363,6 +1416,9 @@ namespace toy2d {
 		projectMat[3][1] = (float)(top + bottom) / (bottom - top);
 		projectMat[3][2] = (float)(near + far) / (far - near);
 
+		viewRect = Rect{ (float)std::min(left, right), (float)std::min(bottom, top),
+			(float)std::max(left, right), (float)std::max(bottom, top) };
+
 		bufferMVPData();
 	}
 
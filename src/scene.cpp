@@ -0,0 +1,626 @@
+#include "toy2d/scene.hpp"
+#include "toy2d/context.hpp"
+#include "toy2d/shader.hpp"
+#include "toy2d/vertex.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace toy2d {
+
+	namespace {
+		constexpr uint32_t MinCapacity = 64;
+
+		constexpr PackedColor White = { 255, 255, 255, 255 };
+	}
+
+	Scene::Scene(int maxFlightCount, float cellSize) : maxFlightCount_(maxFlightCount), grid_(cellSize) {
+		auto& ctx = Context::GetInstance();
+
+		createDescriptors();
+		createPipeline();
+		growRecords(0);
+
+		uploadCmds_ = ctx.commandManager->CreateCommandBuffers(maxFlightCount_);
+		stagingBuffers_.resize(maxFlightCount_);
+		cullFrames_.resize(maxFlightCount_);
+	}
+
+	Scene::~Scene() {
+		auto& ctx = Context::GetInstance();
+		auto& device = ctx.device;
+		device.waitIdle();
+
+		for (auto cmd : uploadCmds_) {
+			ctx.commandManager->freeCmds(cmd);
+		}
+		stagingBuffers_.clear();
+		retired_.clear();
+		recordBuffer_.reset();
+		cullFrames_.clear();
+
+		if (cullPipeline_) {
+			device.destroyPipeline(cullPipeline_);
+			device.destroyPipelineLayout(cullLayout_);
+			device.destroyShaderModule(cullModule_);
+		}
+		device.destroyPipeline(pipeline_);
+		device.destroyPipelineLayout(pipelineLayout_);
+		device.destroyShaderModule(vertModule_);
+		device.destroyDescriptorPool(descriptorPool_);
+		device.destroyDescriptorSetLayout(setLayout_);
+		device.destroyDescriptorSetLayout(cullSetLayout_);
+	}
+
+	void Scene::createDescriptors() {
+		auto& device = Context::GetInstance().device;
+
+		vk::DescriptorSetLayoutBinding binding;
+		binding.setBinding(0)
+			.setDescriptorCount(1)
+			.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+			.setStageFlags(vk::ShaderStageFlagBits::eVertex);
+		vk::DescriptorSetLayoutCreateInfo layoutInfo;
+		layoutInfo.setBindings(binding);
+		setLayout_ = device.createDescriptorSetLayout(layoutInfo);
+
+		// records, indirect commands and visible slots of the cull pass
+		std::array<vk::DescriptorSetLayoutBinding, 3> cullBindings;
+		for (uint32_t i = 0; i < cullBindings.size(); i++) {
+			cullBindings[i].setBinding(i)
+				.setDescriptorCount(1)
+				.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+				.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+		}
+		layoutInfo.setBindings(cullBindings);
+		cullSetLayout_ = device.createDescriptorSetLayout(layoutInfo);
+
+		// the current set plus the ones retired while frames still use them, and a cull set per frame
+		uint32_t recordSets = maxFlightCount_ + 2;
+		uint32_t maxSets = recordSets + maxFlightCount_;
+		vk::DescriptorPoolSize size;
+		size.setType(vk::DescriptorType::eStorageBuffer)
+			.setDescriptorCount(recordSets + maxFlightCount_ * (uint32_t)cullBindings.size());
+		vk::DescriptorPoolCreateInfo poolInfo;
+		poolInfo.setFlags(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet)
+			.setMaxSets(maxSets)
+			.setPoolSizes(size);
+		descriptorPool_ = device.createDescriptorPool(poolInfo);
+	}
+
+	vk::DescriptorSet Scene::allocateSet(vk::Buffer buffer) {
+		auto& device = Context::GetInstance().device;
+
+		vk::DescriptorSetAllocateInfo allocInfo;
+		allocInfo.setDescriptorPool(descriptorPool_)
+			.setSetLayouts(setLayout_);
+		auto set = device.allocateDescriptorSets(allocInfo)[0];
+
+		vk::DescriptorBufferInfo bufferInfo;
+		bufferInfo.setBuffer(buffer)
+			.setOffset(0)
+			.setRange(VK_WHOLE_SIZE);
+		vk::WriteDescriptorSet writer;
+		writer.setBufferInfo(bufferInfo)
+			.setDstBinding(0)
+			.setDstArrayElement(0)
+			.setDstSet(set)
+			.setDescriptorCount(1)
+			.setDescriptorType(vk::DescriptorType::eStorageBuffer);
+		device.updateDescriptorSets(writer, {});
+		return set;
+	}
+
+	void Scene::createPipeline() {
+		auto& ctx = Context::GetInstance();
+		auto& shader = Shader::GetInstance();
+
+		std::array<vk::DescriptorSetLayout, 3> setLayouts = {
+			shader.GetDescriptorSetLayouts()[0], shader.GetDescriptorSetLayouts()[1], setLayout_ };
+		vk::PipelineLayoutCreateInfo layoutInfo;
+		layoutInfo.setSetLayouts(setLayouts);
+		pipelineLayout_ = ctx.device.createPipelineLayout(layoutInfo);
+
+		// same fragment stage as the immediate sprites
+		vertModule_ = Shader::CreateModule(ReadWholeFile(GetShaderPath("scene_vert.spv")));
+		auto stages = shader.GetStage();
+		stages[0].setModule(vertModule_);
+
+		// binding 1 only carries the record index of each instance
+		VertexInput& input = input_;
+		vk::VertexInputBindingDescription slotBinding;
+		slotBinding.setBinding(1)
+			.setInputRate(vk::VertexInputRate::eInstance)
+			.setStride(sizeof(uint32_t));
+		vk::VertexInputAttributeDescription slotAttr;
+		slotAttr.setBinding(1)
+			.setFormat(vk::Format::eR32Uint)
+			.setLocation(2)
+			.setOffset(0);
+		input.bindings = { Vertex::GetBinding(), slotBinding };
+		input.attributes = Vertex::GetAttribute();
+		input.attributes.push_back(slotAttr);
+		pipeline_ = ctx.renderProcess->CreateGraphicsPipeline(pipelineLayout_, stages, input);
+	}
+
+	void Scene::createCullPipeline() {
+		auto& device = Context::GetInstance().device;
+
+		vk::PushConstantRange range;
+		range.setOffset(0)
+			.setSize(sizeof(float) * 4 + sizeof(uint32_t))
+			.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+		vk::PipelineLayoutCreateInfo layoutInfo;
+		layoutInfo.setSetLayouts(cullSetLayout_)
+			.setPushConstantRanges(range);
+		cullLayout_ = device.createPipelineLayout(layoutInfo);
+
+		cullModule_ = Shader::CreateModule(ReadWholeFile(GetShaderPath("scene_cull_comp.spv")));
+		vk::PipelineShaderStageCreateInfo stage;
+		stage.setStage(vk::ShaderStageFlagBits::eCompute)
+			.setModule(cullModule_)
+			.setPName("main");
+		vk::ComputePipelineCreateInfo createInfo;
+		createInfo.setStage(stage)
+			.setLayout(cullLayout_);
+		auto result = device.createComputePipeline(nullptr, createInfo);
+		if (result.result != vk::Result::eSuccess) {
+			throw std::runtime_error("Create scene cull pipeline failed!");
+		}
+		cullPipeline_ = result.value;
+	}
+
+	void Scene::writeCullSet(CullFrame& frame) {
+		auto& device = Context::GetInstance().device;
+
+		if (!frame.set) {
+			vk::DescriptorSetAllocateInfo allocInfo;
+			allocInfo.setDescriptorPool(descriptorPool_)
+				.setSetLayouts(cullSetLayout_);
+			frame.set = device.allocateDescriptorSets(allocInfo)[0];
+		}
+
+		std::array<vk::DescriptorBufferInfo, 3> bufferInfos;
+		bufferInfos[0].setBuffer(recordBuffer_->buffer).setOffset(0).setRange(VK_WHOLE_SIZE);
+		bufferInfos[1].setBuffer(frame.commands->buffer).setOffset(0).setRange(VK_WHOLE_SIZE);
+		bufferInfos[2].setBuffer(frame.visible->buffer).setOffset(0).setRange(VK_WHOLE_SIZE);
+		std::array<vk::WriteDescriptorSet, 3> writers;
+		for (uint32_t i = 0; i < writers.size(); i++) {
+			writers[i].setBufferInfo(bufferInfos[i])
+				.setDstBinding(i)
+				.setDstArrayElement(0)
+				.setDstSet(frame.set)
+				.setDescriptorCount(1)
+				.setDescriptorType(vk::DescriptorType::eStorageBuffer);
+		}
+		device.updateDescriptorSets(writers, {});
+		frame.records = recordBuffer_->buffer;
+	}
+
+	Scene::Node& Scene::node(NodeId id) {
+		if (id >= nodes_.size() || !nodes_[id].alive) {
+			throw std::runtime_error("Scene node does not exist");
+		}
+		return nodes_[id];
+	}
+
+	Scene::NodeId Scene::allocNode(NodeId parent) {
+		if (parent != InvalidNode) {
+			node(parent);
+		}
+		NodeId id;
+		if (!freeNodes_.empty()) {
+			id = freeNodes_.back();
+			freeNodes_.pop_back();
+		} else {
+			id = (NodeId)nodes_.size();
+			nodes_.emplace_back();
+		}
+		nodes_[id] = Node{};
+		nodes_[id].alive = true;
+		link(id, parent);
+		markDirty(id);
+		stats_.nodes++;
+		return id;
+	}
+
+	Scene::NodeId Scene::CreateNode(NodeId parent) {
+		return allocNode(parent);
+	}
+
+	Scene::NodeId Scene::CreateSprite(Texture& texture, float w, float h, NodeId parent, uint8_t layer) {
+		NodeId id = allocNode(parent);
+
+		uint32_t slot;
+		if (!freeSlots_.empty()) {
+			slot = freeSlots_.back();
+			freeSlots_.pop_back();
+		} else {
+			slot = (uint32_t)sprites_.size();
+			sprites_.emplace_back();
+			records_.push_back(Record{ 0, 0, 0, 0, 0, 0, White, NoGroup });
+			slotDirty_.push_back(false);
+		}
+		sprites_[slot] = Sprite{ id, &texture, { w, h }, layer, White, acquireGroup(&texture, layer) };
+		nodes_[id].slot = slot;
+		stats_.sprites++;
+		return id;
+	}
+
+	void Scene::Destroy(NodeId id) {
+		node(id);
+		unlink(id);
+
+		stack_.clear();
+		stack_.push_back(id);
+		while (!stack_.empty()) {
+			NodeId cur = stack_.back();
+			stack_.pop_back();
+			auto& n = nodes_[cur];
+			for (NodeId child = n.firstChild; child != InvalidNode; child = nodes_[child].nextSibling) {
+				stack_.push_back(child);
+			}
+			if (n.slot != NoSlot) {
+				grid_.Remove(n.slot);
+				releaseGroup(sprites_[n.slot].group);
+				sprites_[n.slot] = Sprite{ InvalidNode, nullptr, { 0, 0 }, 0, White, NoGroup };
+				// the cull pass reads every slot, a free one must not draw
+				records_[n.slot].group = NoGroup;
+				markSlotDirty(n.slot);
+				freeSlots_.push_back(n.slot);
+				stats_.sprites--;
+			}
+			n.alive = false;
+			freeNodes_.push_back(cur);
+			stats_.nodes--;
+		}
+	}
+
+	void Scene::link(NodeId id, NodeId parent) {
+		if (parent == InvalidNode) return;
+		auto& n = nodes_[id];
+		auto& p = nodes_[parent];
+		n.parent = parent;
+		n.prevSibling = InvalidNode;
+		n.nextSibling = p.firstChild;
+		if (p.firstChild != InvalidNode) {
+			nodes_[p.firstChild].prevSibling = id;
+		}
+		p.firstChild = id;
+	}
+
+	void Scene::unlink(NodeId id) {
+		auto& n = nodes_[id];
+		if (n.parent == InvalidNode) return;
+		if (n.prevSibling != InvalidNode) {
+			nodes_[n.prevSibling].nextSibling = n.nextSibling;
+		} else {
+			nodes_[n.parent].firstChild = n.nextSibling;
+		}
+		if (n.nextSibling != InvalidNode) {
+			nodes_[n.nextSibling].prevSibling = n.prevSibling;
+		}
+		n.parent = InvalidNode;
+		n.prevSibling = InvalidNode;
+		n.nextSibling = InvalidNode;
+	}
+
+	void Scene::markDirty(NodeId id) {
+		auto& n = nodes_[id];
+		if (!n.dirty) {
+			n.dirty = true;
+			dirtyNodes_.push_back(id);
+		}
+	}
+
+	void Scene::markSlotDirty(uint32_t slot) {
+		if (!slotDirty_[slot]) {
+			slotDirty_[slot] = true;
+			dirtySlots_.push_back(slot);
+		}
+	}
+
+	void Scene::SetPosition(NodeId id, float x, float y) {
+		node(id).position = { x, y };
+		markDirty(id);
+	}
+
+	void Scene::SetRotation(NodeId id, float degrees) {
+		node(id).rotation = glm::radians(degrees);
+		markDirty(id);
+	}
+
+	void Scene::SetScale(NodeId id, float sx, float sy) {
+		node(id).scale = { sx, sy };
+		markDirty(id);
+	}
+
+	void Scene::SetParent(NodeId id, NodeId parent) {
+		node(id);
+		if (parent != InvalidNode) {
+			node(parent);
+			for (NodeId p = parent; p != InvalidNode; p = nodes_[p].parent) {
+				if (p == id) {
+					throw std::runtime_error("Scene node can not become a child of its own subtree");
+				}
+			}
+		}
+		unlink(id);
+		link(id, parent);
+		markDirty(id);
+	}
+
+	void Scene::SetTexture(NodeId id, Texture& texture) {
+		auto& n = node(id);
+		if (n.slot == NoSlot) {
+			throw std::runtime_error("Scene node is not a sprite");
+		}
+		sprites_[n.slot].texture = &texture;
+		moveToGroup(n.slot);
+	}
+
+	void Scene::SetLayer(NodeId id, uint8_t layer) {
+		auto& n = node(id);
+		if (n.slot == NoSlot) {
+			throw std::runtime_error("Scene node is not a sprite");
+		}
+		sprites_[n.slot].layer = layer;
+		moveToGroup(n.slot);
+	}
+
+	uint32_t Scene::acquireGroup(Texture* texture, uint8_t layer) {
+		uint64_t key = (uint64_t(texture->GetId()) << 8) | layer;
+		auto it = groupIndex_.find(key);
+		if (it != groupIndex_.end()) {
+			groups_[it->second].count++;
+			return it->second;
+		}
+
+		uint32_t group;
+		if (!freeGroups_.empty()) {
+			group = freeGroups_.back();
+			freeGroups_.pop_back();
+		} else {
+			group = (uint32_t)groups_.size();
+			groups_.emplace_back();
+		}
+		groups_[group] = Group{ texture, layer, 1 };
+		groupIndex_.emplace(key, group);
+		return group;
+	}
+
+	void Scene::releaseGroup(uint32_t group) {
+		auto& g = groups_[group];
+		if (--g.count > 0) return;
+		groupIndex_.erase((uint64_t(g.texture->GetId()) << 8) | g.layer);
+		g.texture = nullptr;
+		freeGroups_.push_back(group);
+	}
+
+	void Scene::moveToGroup(uint32_t slot) {
+		// only the group index of the record changes, the transform stays clean
+		auto& sprite = sprites_[slot];
+		uint32_t group = acquireGroup(sprite.texture, sprite.layer);
+		releaseGroup(sprite.group);
+		sprite.group = group;
+		records_[slot].group = group;
+		markSlotDirty(slot);
+	}
+
+	void Scene::SetTint(NodeId id, PackedColor tint) {
+		auto& n = node(id);
+		if (n.slot == NoSlot) {
+			throw std::runtime_error("Scene node is not a sprite");
+		}
+		// only the record changes, the transform stays clean
+		sprites_[n.slot].tint = tint;
+		records_[n.slot].tint = tint;
+		markSlotDirty(n.slot);
+	}
+
+	void Scene::updateSubtree(NodeId root) {
+		// parents are popped before their children, so the parent world is always current
+		stack_.clear();
+		stack_.push_back(root);
+		while (!stack_.empty()) {
+			NodeId id = stack_.back();
+			stack_.pop_back();
+			auto& n = nodes_[id];
+
+			glm::mat4x4 local(1.0f);
+			local = glm::translate(local, { n.position.x, n.position.y, 0 });
+			local = glm::rotate(local, n.rotation, { 0, 0, 1 });
+			local = glm::scale(local, { n.scale.x, n.scale.y, 1 });
+			n.world = n.parent != InvalidNode ? nodes_[n.parent].world * local : local;
+			n.dirty = false;
+			stats_.transformsUpdated++;
+
+			if (n.slot != NoSlot) {
+				auto& sprite = sprites_[n.slot];
+				glm::mat4x4 model = glm::scale(n.world, { sprite.size.x, sprite.size.y, 1 });
+				auto& record = records_[n.slot];
+				record = Record{ model[0][0], model[0][1], model[1][0], model[1][1], model[3][0], model[3][1], sprite.tint, sprite.group };
+				// box around the unit quad [-0.5, 0.5] moved by the record
+				float hx = 0.5f * (std::abs(record.a) + std::abs(record.c));
+				float hy = 0.5f * (std::abs(record.b) + std::abs(record.d));
+				grid_.Update(n.slot, Rect{ record.tx - hx, record.ty - hy, record.tx + hx, record.ty + hy });
+				markSlotDirty(n.slot);
+			}
+
+			for (NodeId child = n.firstChild; child != InvalidNode; child = nodes_[child].nextSibling) {
+				stack_.push_back(child);
+			}
+		}
+	}
+
+	void Scene::growRecords(uint64_t frame) {
+		uint32_t capacity = std::max(capacity_, MinCapacity);
+		while (capacity < sprites_.size()) capacity *= 2;
+		if (capacity == capacity_) return;
+
+		if (recordBuffer_) {
+			retired_.push_back(Retired{ std::move(recordBuffer_), set_, frame });
+		}
+		recordBuffer_.reset(new Buffer(sizeof(Record) * capacity,
+			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+			vk::MemoryPropertyFlagBits::eDeviceLocal));
+		set_ = allocateSet(recordBuffer_->buffer);
+		capacity_ = capacity;
+
+		// the new buffer starts empty, every record goes out again. free slots too, the cull pass
+		// reads them
+		for (uint32_t slot = 0; slot < sprites_.size(); slot++) {
+			markSlotDirty(slot);
+		}
+	}
+
+	void Scene::update(int flightIndex, uint64_t frame) {
+		auto& ctx = Context::GetInstance();
+		if (frame_ != frame) {
+			frame_ = frame;
+			flightIndex_ = flightIndex;
+			stats_.transformsUpdated = 0;
+			stats_.recordsUploaded = 0;
+
+			for (size_t i = 0; i < retired_.size();) {
+				if (retired_[i].frame + maxFlightCount_ <= frame) {
+					ctx.device.freeDescriptorSets(descriptorPool_, retired_[i].set);
+					retired_[i] = std::move(retired_.back());
+					retired_.pop_back();
+				} else {
+					i++;
+				}
+			}
+		}
+
+		for (NodeId id : dirtyNodes_) {
+			auto& n = nodes_[id];
+			if (!n.alive || !n.dirty) continue;
+			// a dirty ancestor recomputes this node as part of its own subtree
+			NodeId top = id;
+			for (NodeId p = n.parent; p != InvalidNode; p = nodes_[p].parent) {
+				if (nodes_[p].dirty) top = p;
+			}
+			updateSubtree(top);
+		}
+		dirtyNodes_.clear();
+
+		if (sprites_.size() > capacity_) {
+			growRecords(frame);
+		}
+	}
+
+	void Scene::flush() {
+		if (dirtySlots_.empty()) return;
+
+		// the fence of this frame slot was waited by the renderer, its staging buffer is idle and
+		// this is its only upload of the frame
+		auto& ctx = Context::GetInstance();
+		size_t size = dirtySlots_.size() * sizeof(Record);
+		auto& staging = stagingBuffers_[flightIndex_];
+		if (!staging || staging->size < size) {
+			staging.reset(new Buffer(std::max(size, staging ? staging->size * 2 : 0),
+				vk::BufferUsageFlagBits::eTransferSrc,
+				vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+		}
+
+		// neighbouring slots go out as one copy region
+		std::sort(dirtySlots_.begin(), dirtySlots_.end());
+		std::vector<vk::BufferCopy> regions;
+		auto dst = (Record*)staging->map;
+		for (size_t i = 0; i < dirtySlots_.size(); i++) {
+			uint32_t slot = dirtySlots_[i];
+			dst[i] = records_[slot];
+			slotDirty_[slot] = false;
+			vk::DeviceSize dstOffset = vk::DeviceSize(slot) * sizeof(Record);
+			if (!regions.empty() && regions.back().dstOffset + regions.back().size == dstOffset) {
+				regions.back().size += sizeof(Record);
+			} else {
+				regions.emplace_back(vk::DeviceSize(i) * sizeof(Record), dstOffset, sizeof(Record));
+			}
+		}
+		stats_.recordsUploaded = (uint32_t)dirtySlots_.size();
+		dirtySlots_.clear();
+
+		// submitted ahead of the frame's command buffer on the same queue, like the virtual texture
+		// uploads. the first barrier keeps the copy behind the previous frame still reading the records
+		auto cmd = uploadCmds_[flightIndex_];
+		cmd.reset();
+		vk::CommandBufferBeginInfo beginInfo;
+		beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+		cmd.begin(beginInfo);
+		auto readers = vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eComputeShader;
+		cmd.pipelineBarrier(readers, vk::PipelineStageFlagBits::eTransfer,
+			{}, nullptr, nullptr, nullptr);
+		cmd.copyBuffer(staging->buffer, recordBuffer_->buffer, regions);
+		vk::MemoryBarrier barrier;
+		barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, readers,
+			{}, barrier, nullptr, nullptr);
+		cmd.end();
+
+		vk::SubmitInfo submitInfo;
+		submitInfo.setCommandBuffers(cmd);
+		ctx.graphics_queue.submit(submitInfo);
+	}
+
+	void Scene::cull(vk::CommandBuffer cmd, int flightIndex, uint64_t frame, const Rect& view) {
+		// a second DrawScene in the same frame draws from the same output
+		auto& cf = cullFrames_[flightIndex];
+		if (cf.frame == frame) return;
+		cf.frame = frame;
+
+		if (!cullPipeline_) {
+			createCullPipeline();
+		}
+
+		// the fence of this frame slot was waited by the renderer, its buffers are idle
+		bool rewrite = cf.records != recordBuffer_->buffer;
+		size_t commandsSize = std::max<size_t>(groups_.size(), 1) * sizeof(vk::DrawIndexedIndirectCommand);
+		if (!cf.commands || cf.commands->size < commandsSize) {
+			cf.commands.reset(new Buffer(std::max(commandsSize, cf.commands ? cf.commands->size * 2 : 0),
+				vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+				vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+			rewrite = true;
+		}
+		size_t visibleSize = size_t(capacity_) * sizeof(uint32_t);
+		if (!cf.visible || cf.visible->size < visibleSize) {
+			cf.visible.reset(new Buffer(visibleSize,
+				vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+				vk::MemoryPropertyFlagBits::eDeviceLocal));
+			rewrite = true;
+		}
+		if (rewrite) {
+			writeCullSet(cf);
+		}
+
+		// every group gets a range of the visible buffer big enough for all its sprites,
+		// the cull pass only counts instances up
+		auto commands = (vk::DrawIndexedIndirectCommand*)cf.commands->map;
+		uint32_t firstInstance = 0;
+		for (size_t i = 0; i < groups_.size(); i++) {
+			commands[i] = vk::DrawIndexedIndirectCommand(6, 0, 0, 0, firstInstance);
+			firstInstance += groups_[i].count;
+		}
+		if (sprites_.empty()) return;
+
+		struct {
+			float minX, minY, maxX, maxY;
+			uint32_t count;
+		} params = { view.minX, view.minY, view.maxX, view.maxY, (uint32_t)sprites_.size() };
+		cmd.bindPipeline(vk::PipelineBindPoint::eCompute, cullPipeline_);
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, cullLayout_, 0, cf.set, {});
+		cmd.pushConstants(cullLayout_, vk::ShaderStageFlagBits::eCompute, 0, sizeof(params), &params);
+		cmd.dispatch(((uint32_t)sprites_.size() + 63) / 64, 1, 1);
+
+		vk::MemoryBarrier barrier;
+		barrier.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eVertexAttributeRead);
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+			vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput,
+			{}, barrier, nullptr, nullptr);
+	}
+
+}
@@ -18,16 +18,16 @@ namespace toy2d {
 		return *instance_;
 	}
 
-	Shader::Shader(const std::string& vertexSource, const std::string& fragSource) {
+	vk::ShaderModule Shader::CreateModule(const std::string& code) {
 		vk::ShaderModuleCreateInfo create_info;
-		create_info.setCodeSize(vertexSource.size())
-			.setPCode((uint32_t*)(vertexSource.data()));
-		vertShader = Context::GetInstance().device.createShaderModule(create_info);
-
+		create_info.setCodeSize(code.size())
+			.setPCode((uint32_t*)(code.data()));
+		return Context::GetInstance().device.createShaderModule(create_info);
+	}
 
-		create_info.setCodeSize(fragSource.size())
-			.setPCode((uint32_t*)(fragSource.data()));
-		fragShader = Context::GetInstance().device.createShaderModule(create_info);
+	Shader::Shader(const std::string& vertexSource, const std::string& fragSource) {
+		vertShader = CreateModule(vertexSource);
+		fragShader = CreateModule(fragSource);
 
 		initDescriptorSetLayouts();
 		InitStage();
@@ -35,6 +35,10 @@ namespace toy2d {
 
 	Shader::~Shader() {
 		auto& device = Context::GetInstance().device;
+		for (auto& updateTemplate : updateTemplates) {
+			if (updateTemplate) device.destroyDescriptorUpdateTemplate(updateTemplate);
+		}
+		updateTemplates.clear();
 		for (auto& layout : layouts) {
 			device.destroyDescriptorSetLayout(layout);
 		}
@@ -59,8 +63,6 @@ namespace toy2d {
 	}
 
 	void Shader::initDescriptorSetLayouts() {
-		auto device = Context::GetInstance().device;
-		vk::DescriptorSetLayoutCreateInfo createInfo;
 		std::vector<vk::DescriptorSetLayoutBinding> bindings(2);
 		bindings[0].setBinding(0)
 			.setDescriptorCount(1)
@@ -70,16 +72,50 @@ namespace toy2d {
 			.setDescriptorCount(1)
 			.setDescriptorType(vk::DescriptorType::eUniformBuffer)
 			.setStageFlags(vk::ShaderStageFlagBits::eFragment);
-		createInfo.setBindings(bindings);
-		layouts.push_back(device.createDescriptorSetLayout(createInfo));
+		addDescriptorSetLayout(bindings);
 
 		bindings.resize(1);
 		bindings[0].setBinding(0)
 			.setDescriptorCount(1)
 			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
 			.setStageFlags(vk::ShaderStageFlagBits::eFragment);
-		createInfo.setBindings(bindings);
-		layouts.push_back(device.createDescriptorSetLayout(createInfo));
+		// the texture set is never allocated in push mode, the image is pushed per draw
+		addDescriptorSetLayout(bindings, Context::GetInstance().usePushDescriptors ?
+			vk::DescriptorSetLayoutCreateFlagBits::ePushDescriptorKHR : vk::DescriptorSetLayoutCreateFlags{});
+	}
+
+	void Shader::addDescriptorSetLayout(const std::vector<vk::DescriptorSetLayoutBinding>& bindings, vk::DescriptorSetLayoutCreateFlags flags) {
+		auto& device = Context::GetInstance().device;
+		vk::DescriptorSetLayoutCreateInfo createInfo;
+		createInfo.setBindings(bindings)
+			.setFlags(flags);
+		auto layout = device.createDescriptorSetLayout(createInfo);
+		layouts.push_back(layout);
+		if (flags & vk::DescriptorSetLayoutCreateFlagBits::ePushDescriptorKHR) {
+			// no sets to update, keeps the template index equal to the layout index
+			updateTemplates.push_back(nullptr);
+			return;
+		}
+
+		// the template lets the driver write a whole set from one packed array in a single call
+		std::vector<vk::DescriptorUpdateTemplateEntry> entries(bindings.size());
+		for (size_t i = 0; i < bindings.size(); i++) {
+			entries[i].setDstBinding(bindings[i].binding)
+				.setDstArrayElement(0)
+				.setDescriptorCount(bindings[i].descriptorCount)
+				.setDescriptorType(bindings[i].descriptorType)
+				.setOffset(bindings[i].binding * sizeof(DescriptorData))
+				.setStride(sizeof(DescriptorData));
+		}
+		vk::DescriptorUpdateTemplateCreateInfo templateInfo;
+		templateInfo.setDescriptorUpdateEntries(entries)
+			.setTemplateType(vk::DescriptorUpdateTemplateType::eDescriptorSet)
+			.setDescriptorSetLayout(layout);
+		updateTemplates.push_back(device.createDescriptorUpdateTemplate(templateInfo));
+	}
+
+	void Shader::UpdateDescriptorSet(vk::DescriptorSet set, uint32_t layoutIndex, const DescriptorData* data) const {
+		Context::GetInstance().device.updateDescriptorSetWithTemplate(set, updateTemplates[layoutIndex], data);
 	}
 
 	vk::PushConstantRange Shader::GetPushConstantRange() const {
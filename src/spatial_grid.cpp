@@ -0,0 +1,141 @@
+#include "toy2d/spatial_grid.hpp"
+#include <cmath>
+#include <stdexcept>
+
+namespace toy2d {
+
+	SpatialGrid::SpatialGrid(float cellSize) : cellSize_(cellSize), invCellSize_(1.0f / cellSize) {
+		if (cellSize <= 0) {
+			throw std::runtime_error("SpatialGrid cell size must be positive");
+		}
+	}
+
+	SpatialGrid::CellRange SpatialGrid::cellRange(const Rect& bounds) const {
+		return CellRange{
+			(int32_t)std::floor(bounds.minX * invCellSize_),
+			(int32_t)std::floor(bounds.minY * invCellSize_),
+			(int32_t)std::floor(bounds.maxX * invCellSize_),
+			(int32_t)std::floor(bounds.maxY * invCellSize_),
+		};
+	}
+
+	void SpatialGrid::link(uint32_t id, const CellRange& range) {
+		for (int32_t y = range.y0; y <= range.y1; y++) {
+			for (int32_t x = range.x0; x <= range.x1; x++) {
+				cells_[cellKey(x, y)].push_back(id);
+			}
+		}
+	}
+
+	void SpatialGrid::unlink(uint32_t id, const CellRange& range) {
+		for (int32_t y = range.y0; y <= range.y1; y++) {
+			for (int32_t x = range.x0; x <= range.x1; x++) {
+				auto it = cells_.find(cellKey(x, y));
+				if (it == cells_.end()) continue;
+				auto& ids = it->second;
+				for (size_t i = 0; i < ids.size(); i++) {
+					if (ids[i] == id) {
+						ids[i] = ids.back();
+						ids.pop_back();
+						break;
+					}
+				}
+				if (ids.empty()) {
+					cells_.erase(it);
+				}
+			}
+		}
+	}
+
+	void SpatialGrid::Insert(uint32_t id, const Rect& bounds) {
+		if (Contains(id)) {
+			throw std::runtime_error("SpatialGrid id inserted twice");
+		}
+		if (id >= items_.size()) {
+			items_.resize(id + 1);
+		}
+		auto& item = items_[id];
+		item.bounds = bounds;
+		item.cells = cellRange(bounds);
+		item.alive = true;
+		link(id, item.cells);
+		size_++;
+	}
+
+	void SpatialGrid::Update(uint32_t id, const Rect& bounds) {
+		if (!Contains(id)) {
+			Insert(id, bounds);
+			return;
+		}
+		auto& item = items_[id];
+		item.bounds = bounds;
+		auto range = cellRange(bounds);
+		if (range == item.cells) return;
+		unlink(id, item.cells);
+		item.cells = range;
+		link(id, range);
+	}
+
+	void SpatialGrid::Remove(uint32_t id) {
+		if (!Contains(id)) return;
+		auto& item = items_[id];
+		unlink(id, item.cells);
+		item.alive = false;
+		size_--;
+	}
+
+	void SpatialGrid::Clear() {
+		items_.clear();
+		cells_.clear();
+		size_ = 0;
+	}
+
+	void SpatialGrid::Query(const Rect& view, std::vector<uint32_t>& out) {
+		// stamps mark items already gathered from another cell
+		if (++queryStamp_ == 0) {
+			for (auto& item : items_) item.queryStamp = 0;
+			queryStamp_ = 1;
+		}
+
+		candidates_.clear();
+		auto range = cellRange(view);
+		int64_t cellCount = (int64_t(range.x1) - range.x0 + 1) * (int64_t(range.y1) - range.y0 + 1);
+		if (cellCount > (int64_t)cells_.size()) {
+			// zoomed far out, visiting the occupied cells is cheaper than the covered ones
+			for (auto& [key, ids] : cells_) {
+				int32_t x = int32_t(key >> 32);
+				int32_t y = int32_t(uint32_t(key));
+				if (x < range.x0 || x > range.x1 || y < range.y0 || y > range.y1) continue;
+				for (uint32_t id : ids) {
+					if (items_[id].queryStamp == queryStamp_) continue;
+					items_[id].queryStamp = queryStamp_;
+					candidates_.push_back(id);
+				}
+			}
+		} else {
+			for (int32_t y = range.y0; y <= range.y1; y++) {
+				for (int32_t x = range.x0; x <= range.x1; x++) {
+					auto it = cells_.find(cellKey(x, y));
+					if (it == cells_.end()) continue;
+					for (uint32_t id : it->second) {
+						if (items_[id].queryStamp == queryStamp_) continue;
+						items_[id].queryStamp = queryStamp_;
+						candidates_.push_back(id);
+					}
+				}
+			}
+		}
+
+		// cells are coarse, the exact box test runs on the gathered candidates
+		candidateBounds_.Clear();
+		for (uint32_t id : candidates_) {
+			candidateBounds_.Push(items_[id].bounds);
+		}
+		visible_.clear();
+		CullBounds(candidateBounds_, view, visible_);
+		for (uint32_t i : visible_) {
+			out.push_back(candidates_[i]);
+		}
+	}
+
+}
@@ -1,5 +1,6 @@
 #include "toy2d/swapchain.hpp"
 #include "toy2d/context.hpp"
+#include "toy2d/buffer.hpp"
 
 namespace toy2d {
 	Swapchain::Swapchain(int W, int H) {
@@ -100,19 +101,69 @@ namespace toy2d {
 		for (auto& x : frameBuffers) {
 			Context::GetInstance().device.destroyFramebuffer(x);
 		}
+		if (depthImage) {
+			Context::GetInstance().device.destroyImageView(depthView);
+			Context::GetInstance().device.destroyImage(depthImage);
+			Context::GetInstance().device.freeMemory(depthMemory);
+		}
 		Context::GetInstance().device.destroySwapchainKHR(swapchain);
 	}
 
 
 	void Swapchain::createFramebuffers(int W, int H) {
+		bool depth = Context::GetInstance().renderProcess->HasDepth();
+		if (depth) {
+			createDepthImage(W, H);
+		}
+		// beginRendering takes imageViews and depthView as they are
+		if (Context::GetInstance().useDynamicRendering) return;
 		frameBuffers.resize(images.size());
 		for (uint32_t i = 0; i < frameBuffers.size();i++) {
+			std::vector<vk::ImageView> attachments = { imageViews[i] };
+			if (depth) attachments.push_back(depthView);
 			vk::FramebufferCreateInfo frameBufferInfo;
-			frameBufferInfo.setAttachments(imageViews[i])
+			frameBufferInfo.setAttachments(attachments)
 				.setWidth(W).setHeight(H)
 				.setRenderPass(Context::GetInstance().renderProcess->renderPass)
 				.setLayers(1);
 			frameBuffers[i] = Context::GetInstance().device.createFramebuffer(frameBufferInfo);
 		}
 	}
+
+	void Swapchain::createDepthImage(int W, int H) {
+		auto& device = Context::GetInstance().device;
+		auto format = Context::GetInstance().renderProcess->depthFormat;
+
+		vk::ImageCreateInfo imageInfo;
+		imageInfo.setImageType(vk::ImageType::e2D)
+			.setArrayLayers(1)
+			.setMipLevels(1)
+			.setExtent({ uint32_t(W), uint32_t(H), 1 })
+			.setFormat(format)
+			.setTiling(vk::ImageTiling::eOptimal)
+			.setInitialLayout(vk::ImageLayout::eUndefined)
+			.setUsage(vk::ImageUsageFlagBits::eDepthStencilAttachment)
+			.setSamples(vk::SampleCountFlagBits::e1);
+		depthImage = device.createImage(imageInfo);
+
+		auto requirements = device.getImageMemoryRequirements(depthImage);
+		vk::MemoryAllocateInfo allocInfo;
+		allocInfo.setAllocationSize(requirements.size)
+			.setMemoryTypeIndex(QueryBufferMemTypeIndex(requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal));
+		depthMemory = device.allocateMemory(allocInfo);
+		device.bindImageMemory(depthImage, depthMemory, 0);
+
+		vk::ImageSubresourceRange range;
+		range.setAspectMask(vk::ImageAspectFlagBits::eDepth)
+			.setBaseMipLevel(0)
+			.setLevelCount(1)
+			.setBaseArrayLayer(0)
+			.setLayerCount(1);
+		vk::ImageViewCreateInfo viewInfo;
+		viewInfo.setImage(depthImage)
+			.setViewType(vk::ImageViewType::e2D)
+			.setFormat(format)
+			.setSubresourceRange(range);
+		depthView = device.createImageView(viewInfo);
+	}
 }
\ No newline at end of file
@@ -1,6 +1,10 @@
 #include "toy2d/texture.hpp"
 #include "toy2d/buffer.hpp"
 #include "toy2d/context.hpp"
+#include "toy2d/shader.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <cctype>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "toy2d/stb_image.h"
@@ -8,10 +12,48 @@
 
 
 namespace toy2d {
-	Texture::Texture(std::string_view filename) {
+	// 0 is left for draws without a texture
+	uint32_t Texture::nextId_ = 1;
+
+	Texture::Texture(std::string_view filename, PremultiplyMode mode) : filename_(filename), mode_(mode), id_(nextId_++) {
+		if (!Context::GetInstance().usePushDescriptors) {
+			set = DescriptorSetManager::Instance().AllocImageSet();
+		}
+		load();
+	}
+
+	Texture::~Texture() {
+		if (set.set) {
+			DescriptorSetManager::Instance().FreeImageSet(set);
+		}
+		release();
+	}
+
+	void Texture::Bind(vk::CommandBuffer cmd, vk::PipelineLayout layout, uint32_t setIndex) const {
+		auto& ctx = Context::GetInstance();
+		if (!ctx.usePushDescriptors) {
+			cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, setIndex, set.set, {});
+			return;
+		}
+
+		// read when recording, so a reload needs the command buffer recorded again
+		vk::DescriptorImageInfo imageInfo;
+		imageInfo.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+			.setImageView(imageView)
+			.setSampler(ctx.sampler);
+		vk::WriteDescriptorSet writer;
+		writer.setImageInfo(imageInfo)
+			.setDstBinding(0)
+			.setDstArrayElement(0)
+			.setDescriptorCount(1)
+			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+		ctx.cmdPushDescriptorSet(static_cast<VkCommandBuffer>(cmd), VK_PIPELINE_BIND_POINT_GRAPHICS,
+			static_cast<VkPipelineLayout>(layout), setIndex, 1, reinterpret_cast<const VkWriteDescriptorSet*>(&writer));
+	}
+
+	void Texture::load() {
 		int w, h, channel;
-		stbi_uc* pixels = stbi_load(filename.data(), &w, &h, &channel, STBI_rgb_alpha);
-		printf("Load picture: width: %d, height:%d, channel: %d.\n", w, h, channel);
+		stbi_uc* pixels = stbi_load(filename_.c_str(), &w, &h, &channel, STBI_rgb_alpha);
 		size_t size = w * h * 4; //RGBA
 
 		if (!pixels || (w <=0) || (h<=0)) {
@@ -23,7 +65,8 @@ namespace toy2d {
 			vk::BufferUsageFlagBits::eTransferSrc,
 			vk::MemoryPropertyFlagBits::eHostVisible| vk::MemoryPropertyFlagBits::eHostCoherent);
 
-		memcpy(buffer->map, pixels, size);
+		// the pipeline blends with eOne/eOneMinusSrcAlpha, so store premultiplied alpha
+		PremultiplyAlpha(pixels, static_cast<std::uint8_t*>(buffer->map), size_t(w) * h, mode_);
 
 		createImage(w, h);
 		allocMemory();
@@ -34,16 +77,22 @@ namespace toy2d {
 		createImageView();
 
 		stbi_image_free(pixels);
-		set = DescriptorSetManager::Instance().AllocImageSet();
 		updateDescriptorSet();
+
+		width_ = w;
+		height_ = h;
+		resident_ = true;
 	}
 
-	Texture::~Texture() {
+	void Texture::release() {
 		auto& device = Context::GetInstance().device;
-		DescriptorSetManager::Instance().FreeImageSet(set);
 		device.destroyImageView(imageView);
 		device.destroyImage(image);
 		device.freeMemory(memory);
+		imageView = nullptr;
+		image = nullptr;
+		memory = nullptr;
+		resident_ = false;
 	}
 
 	void Texture::createImage(uint32_t w, uint32_t h) {
@@ -65,6 +114,7 @@ namespace toy2d {
 		vk::MemoryAllocateInfo alloc_info;
 		auto requirements = device.getImageMemoryRequirements(image);
 		alloc_info.setAllocationSize(requirements.size);
+		memorySize_ = requirements.size;
 
 		auto index = QueryBufferMemTypeIndex(requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal);
 		alloc_info.setMemoryTypeIndex(index);
@@ -165,44 +215,166 @@ namespace toy2d {
 	}
 
 	void Texture::updateDescriptorSet() {
-		vk::WriteDescriptorSet writer;
-		vk::DescriptorImageInfo imageInfo;
-		//vk::DescriptorBufferInfo bufferinfo;
-		imageInfo.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
-			.setImageView(imageView)
-			.setSampler(Context::GetInstance().sampler);
-		writer.setImageInfo(imageInfo)
-			.setDstBinding(0)
-			.setDstArrayElement(0)
-			.setDstSet(set.set)
-			//.setBufferInfo(bufferinfo)
-			.setDescriptorCount(1)
-			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
-		Context::GetInstance().device.updateDescriptorSets(writer, {});
+		if (!set.set) return;
+		Shader::DescriptorData data;
+		data.image = VkDescriptorImageInfo{
+			static_cast<VkSampler>(Context::GetInstance().sampler),
+			static_cast<VkImageView>(imageView),
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		Shader::GetInstance().UpdateDescriptorSet(set.set, 1, &data);
 	}
 
 
 	std::unique_ptr<TextureManager> TextureManager::instance_ = nullptr;
 
-	Texture* TextureManager::Load(const std::string& filename) {
-		datas.push_back(std::unique_ptr<Texture>(new Texture(filename)));
-		return datas.back().get();
+	std::string TextureManager::makeKey(const std::string& filename, PremultiplyMode mode) {
+		// "a/../b.png", "./b.png" and "b.png" must all map to the same entry
+		std::error_code err;
+		std::filesystem::path path = std::filesystem::weakly_canonical(filename, err);
+		if (err) {
+			path = std::filesystem::path(filename).lexically_normal();
+		}
+		std::string key = path.generic_string();
+#ifdef _WIN32
+		std::transform(key.begin(), key.end(), key.begin(),
+			[](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+#endif
+		// the same file premultiplied differently is a different image
+		key += mode == PremultiplyMode::Srgb ? "|srgb" : "|fast";
+		return key;
+	}
+
+	Texture* TextureManager::Load(const std::string& filename, PremultiplyMode mode) {
+		auto key = makeKey(filename, mode);
+		auto it = datas.find(key);
+		if (it != datas.end()) {
+			it->second.refCount++;
+			return it->second.texture.get();
+		}
+
+		std::unique_ptr<Texture> texture(new Texture(filename, mode));
+		texture->key_ = key;
+		auto result = texture.get();
+		datas.emplace(std::move(key), Entry{ std::move(texture), 1 });
+		track(*result);
+		evictOverBudget();
+		return result;
 	}
 
 	void TextureManager::Clear() {
+		lru_.clear();
+		stats_.residentBytes = 0;
 		datas.clear();
 	}
 
 	void TextureManager::Destroy(Texture* texture) {
-		auto it = std::find_if(datas.begin(), datas.end(),
-			[&](const std::unique_ptr<Texture>& t) {
-				return t.get() == texture;
-			});
-		if (it != datas.end()) {
-			Context::GetInstance().device.waitIdle();
-			datas.erase(it);
+		if (!texture) return;
+		auto it = datas.find(texture->key_);
+		if (it == datas.end() || it->second.texture.get() != texture) {
+			return;
+		}
+		if (--it->second.refCount > 0) {
+			return;
+		}
+		Context::GetInstance().device.waitIdle();
+		if (texture->resident_) {
+			untrack(*texture);
+		}
+		datas.erase(it);
+	}
+
+	uint32_t TextureManager::GetRefCount(const Texture* texture) const {
+		auto it = datas.find(texture->key_);
+		if (it == datas.end() || it->second.texture.get() != texture) {
+			return 0;
+		}
+		return it->second.refCount;
+	}
+
+	void TextureManager::SetMemoryBudget(vk::DeviceSize bytes) {
+		userBudget_ = bytes;
+		evictOverBudget();
+	}
+
+	void TextureManager::BeginFrame(uint64_t frame, uint32_t framesInFlight) {
+		constexpr uint64_t BudgetQueryInterval = 60;
+
+		frame_ = frame;
+		framesInFlight_ = framesInFlight;
+		if (frame % BudgetQueryInterval == 0) {
+			queryDeviceBudget();
+		}
+		evictOverBudget();
+	}
+
+	void TextureManager::Touch(Texture& texture) {
+		// not created through Load, residency is up to the owner
+		if (texture.key_.empty()) return;
+
+		if (!texture.resident_) {
+			texture.load();
+			stats_.reloads++;
+			track(texture);
+			evictOverBudget();
 			return;
 		}
+		texture.lastUsedFrame_ = frame_;
+		lru_.splice(lru_.end(), lru_, texture.lruIt_);
+	}
+
+	void TextureManager::track(Texture& texture) {
+		texture.lastUsedFrame_ = frame_;
+		texture.lruIt_ = lru_.insert(lru_.end(), &texture);
+		stats_.residentBytes += texture.memorySize_;
+	}
+
+	void TextureManager::untrack(Texture& texture) {
+		lru_.erase(texture.lruIt_);
+		stats_.residentBytes -= texture.memorySize_;
+	}
+
+	void TextureManager::evictOverBudget() {
+		vk::DeviceSize budget = userBudget_;
+		if (deviceBudget_ != 0) {
+			budget = budget == 0 ? deviceBudget_ : std::min(budget, deviceBudget_);
+		}
+		stats_.budget = budget;
+		if (budget == 0) return;
+
+		while (stats_.residentBytes > budget && !lru_.empty()) {
+			Texture* texture = lru_.front();
+			// the list is ordered by last use, so everything after this one is in flight too
+			if (texture->lastUsedFrame_ + framesInFlight_ > frame_) {
+				break;
+			}
+			untrack(*texture);
+			texture->release();
+			stats_.evictions++;
+		}
+	}
+
+	void TextureManager::queryDeviceBudget() {
+		auto& ctx = Context::GetInstance();
+		if (!ctx.memoryBudgetSupported) {
+			deviceBudget_ = 0;
+			return;
+		}
+
+		auto chain = ctx.physicaldevice.getMemoryProperties2<vk::PhysicalDeviceMemoryProperties2,
+			vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+		auto& properties = chain.get<vk::PhysicalDeviceMemoryProperties2>().memoryProperties;
+		auto& budget = chain.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+
+		// what is left for the process on device local heaps, plus what our textures already hold
+		vk::DeviceSize available = 0;
+		for (uint32_t i = 0; i < properties.memoryHeapCount; i++) {
+			if (properties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal) {
+				if (budget.heapBudget[i] > budget.heapUsage[i]) {
+					available += budget.heapBudget[i] - budget.heapUsage[i];
+				}
+			}
+		}
+		deviceBudget_ = available + stats_.residentBytes;
 	}
 
 }
\ No newline at end of file
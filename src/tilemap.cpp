@@ -0,0 +1,270 @@
+#include "toy2d/tilemap.hpp"
+#include "toy2d/context.hpp"
+#include "toy2d/shader.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace toy2d {
+
+	namespace {
+		// 128 * 128 quads use every 16 bit index
+		constexpr uint32_t MaxChunkSize = 128;
+
+		uint16_t toUnorm16(float v) {
+			return uint16_t(std::clamp(v, 0.0f, 1.0f) * UvOne + 0.5f);
+		}
+	}
+
+	Tilemap::Tilemap(Texture& tileset, uint32_t atlasColumns, uint32_t atlasRows,
+		uint32_t columns, uint32_t rows, float tileSize, int maxFlightCount, uint32_t chunkSize)
+		: tileset_(&tileset), atlasColumns_(std::max(atlasColumns, 1u)), atlasRows_(std::max(atlasRows, 1u)),
+		columns_(columns), rows_(rows), tileSize_(tileSize), maxFlightCount_(maxFlightCount),
+		chunkSize_(std::clamp(chunkSize, 1u, MaxChunkSize)) {
+		auto& ctx = Context::GetInstance();
+
+		chunkColumns_ = (columns_ + chunkSize_ - 1) / chunkSize_;
+		chunkRows_ = (rows_ + chunkSize_ - 1) / chunkSize_;
+		tiles_.assign(size_t(columns_) * rows_, EmptyTile);
+		// empty chunks build nothing, they only need to be marked clean
+		chunks_.resize(size_t(chunkColumns_) * chunkRows_);
+		for (auto& chunk : chunks_) {
+			chunk.dirty = false;
+		}
+		stats_.chunks = (uint32_t)chunks_.size();
+
+		createIndices();
+		uploadCmds_ = ctx.commandManager->CreateCommandBuffers(maxFlightCount_);
+		stagingBuffers_.resize(maxFlightCount_);
+
+		vertModule_ = Shader::CreateModule(ReadWholeFile(GetShaderPath("tilemap_vert.spv")));
+		input_.bindings = { Vertex::GetBinding() };
+		input_.attributes = Vertex::GetAttribute();
+		// queued now, so it is usually compiled before the first draw
+		pipeline();
+	}
+
+	Tilemap::~Tilemap() {
+		auto& ctx = Context::GetInstance();
+		auto& device = ctx.device;
+		device.waitIdle();
+
+		for (auto cmd : uploadCmds_) {
+			ctx.commandManager->freeCmds(cmd);
+		}
+		stagingBuffers_.clear();
+		retired_.clear();
+		chunks_.clear();
+		indices_.reset();
+		device.destroyShaderModule(vertModule_);
+	}
+
+	void Tilemap::createIndices() {
+		auto& ctx = Context::GetInstance();
+
+		// staged once into device local memory, like the renderer's quad buffers
+		uint32_t quads = chunkSize_ * chunkSize_;
+		size_t size = size_t(quads) * 6 * sizeof(uint16_t);
+		Buffer staging(size, vk::BufferUsageFlagBits::eTransferSrc,
+			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+		auto dst = (uint16_t*)staging.map;
+		for (uint32_t i = 0; i < quads; i++) {
+			uint16_t base = uint16_t(i * 4);
+			uint16_t quad[] = { 0, 1, 3, 1, 2, 3 };
+			for (uint32_t k = 0; k < 6; k++) {
+				dst[i * 6 + k] = uint16_t(base + quad[k]);
+			}
+		}
+		indices_.reset(new Buffer(size,
+			vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer,
+			vk::MemoryPropertyFlagBits::eDeviceLocal));
+		ctx.commandManager->ExecuteCmd(ctx.graphics_queue, [&](vk::CommandBuffer& cmd) {
+			vk::BufferCopy region(0, 0, size);
+			cmd.copyBuffer(staging.buffer, indices_->buffer, region);
+		});
+	}
+
+	void Tilemap::SetTile(uint32_t x, uint32_t y, uint16_t tile) {
+		if (x >= columns_ || y >= rows_) {
+			throw std::runtime_error("Tile is outside of the map");
+		}
+		auto& cur = tiles_[size_t(y) * columns_ + x];
+		if (cur == tile) return;
+		cur = tile;
+
+		uint32_t index = (y / chunkSize_) * chunkColumns_ + x / chunkSize_;
+		auto& chunk = chunks_[index];
+		if (!chunk.dirty) {
+			chunk.dirty = true;
+			dirtyChunks_.push_back(index);
+		}
+	}
+
+	uint16_t Tilemap::GetTile(uint32_t x, uint32_t y) const {
+		if (x >= columns_ || y >= rows_) {
+			throw std::runtime_error("Tile is outside of the map");
+		}
+		return tiles_[size_t(y) * columns_ + x];
+	}
+
+	uint32_t Tilemap::buildChunk(uint32_t index, Vertex* dst) const {
+		uint32_t cx = index % chunkColumns_ * chunkSize_;
+		uint32_t cy = index / chunkColumns_ * chunkSize_;
+		uint32_t endX = std::min(cx + chunkSize_, columns_);
+		uint32_t endY = std::min(cy + chunkSize_, rows_);
+
+		// half a texel in keeps linear filtering from picking up the neighbouring tile
+		float tileU = 1.0f / atlasColumns_;
+		float tileV = 1.0f / atlasRows_;
+		float insetU = tileset_->GetWidth() ? 0.5f / tileset_->GetWidth() : 0.0f;
+		float insetV = tileset_->GetHeight() ? 0.5f / tileset_->GetHeight() : 0.0f;
+
+		uint32_t quads = 0;
+		for (uint32_t y = cy; y < endY; y++) {
+			for (uint32_t x = cx; x < endX; x++) {
+				uint16_t tile = tiles_[size_t(y) * columns_ + x];
+				if (tile == EmptyTile || tile >= atlasColumns_ * atlasRows_) continue;
+				float u0 = (tile % atlasColumns_) * tileU;
+				float v0 = (tile / atlasColumns_) * tileV;
+				uint16_t su0 = toUnorm16(u0 + insetU), su1 = toUnorm16(u0 + tileU - insetU);
+				uint16_t sv0 = toUnorm16(v0 + insetV), sv1 = toUnorm16(v0 + tileV - insetV);
+				float x0 = x * tileSize_, y0 = y * tileSize_;
+				float x1 = x0 + tileSize_, y1 = y0 + tileSize_;
+				Vertex* v = dst + quads * 4;
+				v[0] = Vertex{ x0, y0, su0, sv0 };
+				v[1] = Vertex{ x1, y0, su1, sv0 };
+				v[2] = Vertex{ x1, y1, su1, sv1 };
+				v[3] = Vertex{ x0, y1, su0, sv1 };
+				quads++;
+			}
+		}
+		return quads;
+	}
+
+	void Tilemap::update(int flightIndex, uint64_t frame) {
+		// a second DrawTilemap in the same frame would reset the pending upload and its staging buffer
+		if (frame_ == frame) return;
+		frame_ = frame;
+
+		auto& ctx = Context::GetInstance();
+		stats_.chunksRebuilt = 0;
+		stats_.verticesUploaded = 0;
+
+		for (size_t i = 0; i < retired_.size();) {
+			if (retired_[i].frame + maxFlightCount_ <= frame) {
+				retired_[i] = std::move(retired_.back());
+				retired_.pop_back();
+			} else {
+				i++;
+			}
+		}
+		if (dirtyChunks_.empty()) return;
+
+		// the fence of this frame slot was waited by the renderer, its staging buffer is idle
+		size_t chunkBytes = size_t(chunkSize_) * chunkSize_ * 4 * sizeof(Vertex);
+		size_t size = dirtyChunks_.size() * chunkBytes;
+		auto& staging = stagingBuffers_[flightIndex];
+		if (!staging || staging->size < size) {
+			staging.reset(new Buffer(std::max(size, staging ? staging->size * 2 : 0),
+				vk::BufferUsageFlagBits::eTransferSrc,
+				vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+		}
+
+		struct Copy {
+			vk::Buffer dst;
+			vk::BufferCopy region;
+		};
+		std::vector<Copy> copies;
+		auto dst = (Vertex*)staging->map;
+		size_t written = 0;
+		for (uint32_t index : dirtyChunks_) {
+			auto& chunk = chunks_[index];
+			chunk.dirty = false;
+			chunk.quadCount = buildChunk(index, dst + written);
+			stats_.chunksRebuilt++;
+			if (chunk.quadCount == 0) continue;
+
+			size_t bytes = size_t(chunk.quadCount) * 4 * sizeof(Vertex);
+			if (!chunk.vertices || chunk.vertices->size < bytes) {
+				if (chunk.vertices) {
+					retired_.push_back(Retired{ std::move(chunk.vertices), frame });
+				}
+				// room to grow, painting a chunk tile by tile shouldn't reallocate every time
+				chunk.vertices.reset(new Buffer(std::min(bytes * 2, chunkBytes),
+					vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
+					vk::MemoryPropertyFlagBits::eDeviceLocal));
+			}
+			copies.push_back(Copy{ chunk.vertices->buffer, vk::BufferCopy(written * sizeof(Vertex), 0, bytes) });
+			written += size_t(chunk.quadCount) * 4;
+		}
+		dirtyChunks_.clear();
+		stats_.verticesUploaded = uint32_t(written);
+		if (copies.empty()) return;
+
+		// submitted ahead of the frame's command buffer like the scene records, the first barrier
+		// keeps the copies behind the previous frame still drawing the chunks
+		auto cmd = uploadCmds_[flightIndex];
+		cmd.reset();
+		vk::CommandBufferBeginInfo beginInfo;
+		beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+		cmd.begin(beginInfo);
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eVertexInput, vk::PipelineStageFlagBits::eTransfer,
+			{}, nullptr, nullptr, nullptr);
+		for (auto& copy : copies) {
+			cmd.copyBuffer(staging->buffer, copy.dst, copy.region);
+		}
+		vk::MemoryBarrier barrier;
+		barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eVertexAttributeRead);
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eVertexInput,
+			{}, barrier, nullptr, nullptr);
+		cmd.end();
+
+		vk::SubmitInfo submitInfo;
+		submitInfo.setCommandBuffers(cmd);
+		ctx.graphics_queue.submit(submitInfo);
+	}
+
+	void Tilemap::visibleChunks(const Rect& view, std::vector<uint32_t>& out) const {
+		// the chunks form a grid, so only the ones under the view are visited
+		float chunkWorld = chunkSize_ * tileSize_;
+		int minX = std::max(0, (int)std::floor((view.minX - x_) / chunkWorld));
+		int minY = std::max(0, (int)std::floor((view.minY - y_) / chunkWorld));
+		int maxX = std::min((int)chunkColumns_ - 1, (int)std::floor((view.maxX - x_) / chunkWorld));
+		int maxY = std::min((int)chunkRows_ - 1, (int)std::floor((view.maxY - y_) / chunkWorld));
+		for (int y = minY; y <= maxY; y++) {
+			for (int x = minX; x <= maxX; x++) {
+				uint32_t index = uint32_t(y) * chunkColumns_ + uint32_t(x);
+				if (chunks_[index].quadCount > 0) {
+					out.push_back(index);
+				}
+			}
+		}
+	}
+
+	vk::Pipeline Tilemap::pipeline() {
+		auto& renderProcess = Context::GetInstance().renderProcess;
+		PipelineKey key;
+		key.layout = renderProcess->layout;
+		key.vertex = vertModule_;
+		key.fragment = Shader::GetInstance().fragShader;
+		key.input = &input_;
+		if (renderProcess->HasDepth()) {
+			key.depth = DepthMode::Test;
+		}
+		return renderProcess->pipelines.TryGet(key);
+	}
+
+	void Tilemap::draw(vk::CommandBuffer cmd, vk::PipelineLayout layout, const uint32_t* chunks, size_t count, float depth) const {
+		// the sprite layout's push constant range is big enough for the map's offset and tint
+		DrawParams params = { x_, y_, tint_, depth };
+		cmd.pushConstants(layout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(params), &params);
+		cmd.bindIndexBuffer(indices_->buffer, 0, vk::IndexType::eUint16);
+		for (size_t i = 0; i < count; i++) {
+			auto& chunk = chunks_[chunks[i]];
+			vk::DeviceSize offset = 0;
+			cmd.bindVertexBuffers(0, chunk.vertices->buffer, offset);
+			cmd.drawIndexed(chunk.quadCount * 6, 1, 0, 0, 0);
+		}
+	}
+
+}
@@ -20,4 +20,8 @@ namespace toy2d {
         return content;
     }
 
+    std::string GetShaderPath(const std::string& filename) {
+        return "G:/code/toy2d/shader/" + filename;
+    }
+
 }
@@ -9,11 +9,15 @@ namespace toy2d {
 
     std::unique_ptr<Renderer> renderer_;
 
-    void Init(const std::vector<const char*>& extensions, CreateSurfaceFunc func, int W, int H) {
+    void Init(const std::vector<const char*>& extensions, CreateSurfaceFunc func, int W, int H, bool pushDescriptors, bool depthBuffer,
+        bool dynamicRendering) {
         Context::Init(extensions, func);
         auto& ctx = Context::GetInstance();
+        ctx.usePushDescriptors = pushDescriptors && ctx.pushDescriptorSupported;
+        ctx.useDepthBuffer = depthBuffer;
+        ctx.useDynamicRendering = dynamicRendering && ctx.dynamicRenderingSupported;
         ctx.InitSwapchain(W, H);
-        Shader::Init(ReadWholeFile("G:/code/toy2d/shader/vert.spv"), ReadWholeFile("G:/code/toy2d/shader/frag.spv"));
+        Shader::Init(ReadWholeFile(GetShaderPath("vert.spv")), ReadWholeFile(GetShaderPath("frag.spv")));
         ctx.InitRenderProcess();
         ctx.InitGraphicsPipeline();
         ctx.swapchain->InitFramebuffers();
@@ -41,8 +45,8 @@ namespace toy2d {
         return renderer_.get();
     }
 
-    Texture* LoadTexture(const std::string& filename) {
-        return TextureManager::Instance().Load(filename);
+    Texture* LoadTexture(const std::string& filename, PremultiplyMode mode) {
+        return TextureManager::Instance().Load(filename, mode);
     }
 
     void DestroyTexture(Texture* texture) {
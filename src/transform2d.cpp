@@ -0,0 +1,268 @@
+#include "toy2d/transform2d.hpp"
+#include "toy2d/cpu_features.hpp"
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+#if !defined(TOY2D_SIMD_X64) && (defined(__aarch64__) || defined(_M_ARM64))
+#define TOY2D_SIMD_NEON64
+#include <arm_neon.h>
+#endif
+
+namespace toy2d {
+
+	namespace {
+		// sin/cos: reduce by multiples of pi/2, then polynomials on [-pi/4, pi/4] and
+		// swap/negate by quadrant. precise mode splits pi/2 in three parts (Cody-Waite)
+		// and uses the cephes sinf/cosf polynomials
+		constexpr float TwoOverPi = 0.636619772367581343f;
+		constexpr float PiO2 = 1.57079632679489662f;
+		constexpr float PiO2A = 1.5703125f;
+		constexpr float PiO2B = 4.837512969970703125e-4f;
+		constexpr float PiO2C = 7.54978995489188216e-8f;
+
+		constexpr float S1 = -1.6666654611e-1f;
+		constexpr float S2 = 8.3321608736e-3f;
+		constexpr float S3 = -1.9515295891e-4f;
+		constexpr float C1 = 4.166664568298827e-2f;
+		constexpr float C2 = -1.388731625493765e-3f;
+		constexpr float C3 = 2.443315711809948e-5f;
+
+		// minimax fits for the fast mode
+		constexpr float FastS1 = -1.667758e-1f;
+		constexpr float FastS2 = 8.42533e-3f;
+		constexpr float FastC1 = -4.998781e-1f;
+		constexpr float FastC2 = 4.067757e-2f;
+
+		void sinCosScalar(float x, bool precise, float& sinOut, float& cosOut) {
+			float j = std::nearbyint(x * TwoOverPi);
+			int32_t q = int32_t(j);
+			float r = precise ? ((x - j * PiO2A) - j * PiO2B) - j * PiO2C : x - j * PiO2;
+			float r2 = r * r;
+			float s, c;
+			if (precise) {
+				s = r + r * r2 * (S1 + r2 * (S2 + r2 * S3));
+				c = 1.0f - 0.5f * r2 + r2 * r2 * (C1 + r2 * (C2 + r2 * C3));
+			} else {
+				s = r * (1.0f + r2 * (FastS1 + r2 * FastS2));
+				c = 1.0f + r2 * (FastC1 + r2 * FastC2);
+			}
+			if (q & 1) std::swap(s, c);
+			sinOut = (q & 2) ? -s : s;
+			cosOut = ((q + 1) & 2) ? -c : c;
+		}
+
+		void transformScalar(const TransformList& t, size_t begin, size_t end, Affine2D* out, bool precise) {
+			for (size_t i = begin; i < end; i++) {
+				float s, c;
+				sinCosScalar(t.rotation[i], precise, s, c);
+				float sx = t.scaleX[i];
+				float sy = t.scaleY[i];
+				out[i] = Affine2D{ sx * c, sx * s, -sy * s, sy * c, t.x[i], t.y[i] };
+			}
+		}
+
+#ifdef TOY2D_SIMD_X64
+		inline void sinCosSSE2(__m128 x, bool precise, __m128& sinOut, __m128& cosOut) {
+			// cvtps rounds to nearest even under the default rounding mode, like nearbyint
+			__m128i q = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(TwoOverPi)));
+			__m128 j = _mm_cvtepi32_ps(q);
+			__m128 r;
+			if (precise) {
+				r = _mm_sub_ps(x, _mm_mul_ps(j, _mm_set1_ps(PiO2A)));
+				r = _mm_sub_ps(r, _mm_mul_ps(j, _mm_set1_ps(PiO2B)));
+				r = _mm_sub_ps(r, _mm_mul_ps(j, _mm_set1_ps(PiO2C)));
+			} else {
+				r = _mm_sub_ps(x, _mm_mul_ps(j, _mm_set1_ps(PiO2)));
+			}
+			__m128 r2 = _mm_mul_ps(r, r);
+			__m128 s, c;
+			if (precise) {
+				s = _mm_add_ps(_mm_set1_ps(S2), _mm_mul_ps(r2, _mm_set1_ps(S3)));
+				s = _mm_add_ps(_mm_set1_ps(S1), _mm_mul_ps(r2, s));
+				s = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), s));
+				c = _mm_add_ps(_mm_set1_ps(C2), _mm_mul_ps(r2, _mm_set1_ps(C3)));
+				c = _mm_add_ps(_mm_set1_ps(C1), _mm_mul_ps(r2, c));
+				c = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), r2)), _mm_mul_ps(_mm_mul_ps(r2, r2), c));
+			} else {
+				s = _mm_add_ps(_mm_set1_ps(FastS1), _mm_mul_ps(r2, _mm_set1_ps(FastS2)));
+				s = _mm_mul_ps(r, _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(r2, s)));
+				c = _mm_add_ps(_mm_set1_ps(FastC1), _mm_mul_ps(r2, _mm_set1_ps(FastC2)));
+				c = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(r2, c));
+			}
+
+			const __m128i one = _mm_set1_epi32(1);
+			const __m128i signBit = _mm_set1_epi32(int32_t(0x80000000u));
+			__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+			__m128 sinv = _mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s));
+			__m128 cosv = _mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c));
+			// bit 1 of the quadrant moved to the sign bit
+			sinOut = _mm_xor_ps(sinv, _mm_castsi128_ps(_mm_and_si128(_mm_slli_epi32(q, 30), signBit)));
+			cosOut = _mm_xor_ps(cosv, _mm_castsi128_ps(_mm_and_si128(_mm_slli_epi32(_mm_add_epi32(q, one), 30), signBit)));
+		}
+
+		// writes 4 Affine2D from one register per component
+		inline void storeAffineSSE2(Affine2D* out, __m128 a, __m128 b, __m128 c, __m128 d, __m128 tx, __m128 ty) {
+			_MM_TRANSPOSE4_PS(a, b, c, d);
+			__m128 t01 = _mm_unpacklo_ps(tx, ty);
+			__m128 t23 = _mm_unpackhi_ps(tx, ty);
+			_mm_storeu_ps(&out[0].a, a);
+			_mm_storel_pi((__m64*)&out[0].tx, t01);
+			_mm_storeu_ps(&out[1].a, b);
+			_mm_storeh_pi((__m64*)&out[1].tx, t01);
+			_mm_storeu_ps(&out[2].a, c);
+			_mm_storel_pi((__m64*)&out[2].tx, t23);
+			_mm_storeu_ps(&out[3].a, d);
+			_mm_storeh_pi((__m64*)&out[3].tx, t23);
+		}
+
+		size_t transformSSE2(const TransformList& t, Affine2D* out, bool precise) {
+			size_t n = t.Size();
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4) {
+				__m128 s, c;
+				sinCosSSE2(_mm_loadu_ps(&t.rotation[i]), precise, s, c);
+				__m128 sx = _mm_loadu_ps(&t.scaleX[i]);
+				__m128 sy = _mm_loadu_ps(&t.scaleY[i]);
+				__m128 negSy = _mm_sub_ps(_mm_setzero_ps(), sy);
+				storeAffineSSE2(out + i, _mm_mul_ps(sx, c), _mm_mul_ps(sx, s), _mm_mul_ps(negSy, s), _mm_mul_ps(sy, c),
+					_mm_loadu_ps(&t.x[i]), _mm_loadu_ps(&t.y[i]));
+			}
+			return i;
+		}
+
+		TOY2D_TARGET_AVX2 inline void sinCosAVX2(__m256 x, bool precise, __m256& sinOut, __m256& cosOut) {
+			__m256i q = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(TwoOverPi)));
+			__m256 j = _mm256_cvtepi32_ps(q);
+			__m256 r;
+			if (precise) {
+				r = _mm256_sub_ps(x, _mm256_mul_ps(j, _mm256_set1_ps(PiO2A)));
+				r = _mm256_sub_ps(r, _mm256_mul_ps(j, _mm256_set1_ps(PiO2B)));
+				r = _mm256_sub_ps(r, _mm256_mul_ps(j, _mm256_set1_ps(PiO2C)));
+			} else {
+				r = _mm256_sub_ps(x, _mm256_mul_ps(j, _mm256_set1_ps(PiO2)));
+			}
+			__m256 r2 = _mm256_mul_ps(r, r);
+			__m256 s, c;
+			if (precise) {
+				s = _mm256_add_ps(_mm256_set1_ps(S2), _mm256_mul_ps(r2, _mm256_set1_ps(S3)));
+				s = _mm256_add_ps(_mm256_set1_ps(S1), _mm256_mul_ps(r2, s));
+				s = _mm256_add_ps(r, _mm256_mul_ps(_mm256_mul_ps(r, r2), s));
+				c = _mm256_add_ps(_mm256_set1_ps(C2), _mm256_mul_ps(r2, _mm256_set1_ps(C3)));
+				c = _mm256_add_ps(_mm256_set1_ps(C1), _mm256_mul_ps(r2, c));
+				c = _mm256_add_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(_mm256_set1_ps(0.5f), r2)), _mm256_mul_ps(_mm256_mul_ps(r2, r2), c));
+			} else {
+				s = _mm256_add_ps(_mm256_set1_ps(FastS1), _mm256_mul_ps(r2, _mm256_set1_ps(FastS2)));
+				s = _mm256_mul_ps(r, _mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(r2, s)));
+				c = _mm256_add_ps(_mm256_set1_ps(FastC1), _mm256_mul_ps(r2, _mm256_set1_ps(FastC2)));
+				c = _mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(r2, c));
+			}
+
+			const __m256i one = _mm256_set1_epi32(1);
+			const __m256i signBit = _mm256_set1_epi32(int32_t(0x80000000u));
+			__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one));
+			__m256 sinv = _mm256_blendv_ps(s, c, swap);
+			__m256 cosv = _mm256_blendv_ps(c, s, swap);
+			sinOut = _mm256_xor_ps(sinv, _mm256_castsi256_ps(_mm256_and_si256(_mm256_slli_epi32(q, 30), signBit)));
+			cosOut = _mm256_xor_ps(cosv, _mm256_castsi256_ps(_mm256_and_si256(_mm256_slli_epi32(_mm256_add_epi32(q, one), 30), signBit)));
+		}
+
+		TOY2D_TARGET_AVX2 size_t transformAVX2(const TransformList& t, Affine2D* out, bool precise) {
+			size_t n = t.Size();
+			size_t i = 0;
+			for (; i + 8 <= n; i += 8) {
+				__m256 s, c;
+				sinCosAVX2(_mm256_loadu_ps(&t.rotation[i]), precise, s, c);
+				__m256 sx = _mm256_loadu_ps(&t.scaleX[i]);
+				__m256 sy = _mm256_loadu_ps(&t.scaleY[i]);
+				__m256 negSy = _mm256_sub_ps(_mm256_setzero_ps(), sy);
+				__m256 a = _mm256_mul_ps(sx, c);
+				__m256 b = _mm256_mul_ps(sx, s);
+				__m256 cc = _mm256_mul_ps(negSy, s);
+				__m256 d = _mm256_mul_ps(sy, c);
+				__m256 tx = _mm256_loadu_ps(&t.x[i]);
+				__m256 ty = _mm256_loadu_ps(&t.y[i]);
+				// the interleave is per 128 bit half, the sse store handles each half
+				storeAffineSSE2(out + i, _mm256_castps256_ps128(a), _mm256_castps256_ps128(b), _mm256_castps256_ps128(cc),
+					_mm256_castps256_ps128(d), _mm256_castps256_ps128(tx), _mm256_castps256_ps128(ty));
+				storeAffineSSE2(out + i + 4, _mm256_extractf128_ps(a, 1), _mm256_extractf128_ps(b, 1), _mm256_extractf128_ps(cc, 1),
+					_mm256_extractf128_ps(d, 1), _mm256_extractf128_ps(tx, 1), _mm256_extractf128_ps(ty, 1));
+			}
+			return i;
+		}
+#endif
+
+#ifdef TOY2D_SIMD_NEON64
+		inline void sinCosNEON(float32x4_t x, bool precise, float32x4_t& sinOut, float32x4_t& cosOut) {
+			int32x4_t q = vcvtnq_s32_f32(vmulq_n_f32(x, TwoOverPi));
+			float32x4_t j = vcvtq_f32_s32(q);
+			float32x4_t r;
+			if (precise) {
+				r = vmlsq_n_f32(x, j, PiO2A);
+				r = vmlsq_n_f32(r, j, PiO2B);
+				r = vmlsq_n_f32(r, j, PiO2C);
+			} else {
+				r = vmlsq_n_f32(x, j, PiO2);
+			}
+			float32x4_t r2 = vmulq_f32(r, r);
+			float32x4_t s, c;
+			if (precise) {
+				s = vmlaq_n_f32(vdupq_n_f32(S2), r2, S3);
+				s = vmlaq_f32(vdupq_n_f32(S1), r2, s);
+				s = vmlaq_f32(r, vmulq_f32(r, r2), s);
+				c = vmlaq_n_f32(vdupq_n_f32(C2), r2, C3);
+				c = vmlaq_f32(vdupq_n_f32(C1), r2, c);
+				c = vmlaq_f32(vmlsq_n_f32(vdupq_n_f32(1.0f), r2, 0.5f), vmulq_f32(r2, r2), c);
+			} else {
+				s = vmlaq_n_f32(vdupq_n_f32(FastS1), r2, FastS2);
+				s = vmulq_f32(r, vmlaq_f32(vdupq_n_f32(1.0f), r2, s));
+				c = vmlaq_n_f32(vdupq_n_f32(FastC1), r2, FastC2);
+				c = vmlaq_f32(vdupq_n_f32(1.0f), r2, c);
+			}
+
+			uint32x4_t uq = vreinterpretq_u32_s32(q);
+			uint32x4_t swap = vtstq_u32(uq, vdupq_n_u32(1));
+			float32x4_t sinv = vbslq_f32(swap, c, s);
+			float32x4_t cosv = vbslq_f32(swap, s, c);
+			uint32x4_t signBit = vdupq_n_u32(0x80000000u);
+			sinOut = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(sinv), vandq_u32(vshlq_n_u32(uq, 30), signBit)));
+			cosOut = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(cosv),
+				vandq_u32(vshlq_n_u32(vaddq_u32(uq, vdupq_n_u32(1)), 30), signBit)));
+		}
+
+		size_t transformNEON(const TransformList& t, Affine2D* out, bool precise) {
+			size_t n = t.Size();
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4) {
+				float32x4_t s, c;
+				sinCosNEON(vld1q_f32(&t.rotation[i]), precise, s, c);
+				float32x4_t sx = vld1q_f32(&t.scaleX[i]);
+				float32x4_t sy = vld1q_f32(&t.scaleY[i]);
+				// a b c d of the 4 sprites interleaved, then tx ty pairs
+				float32x4x4_t abcd = { { vmulq_f32(sx, c), vmulq_f32(sx, s), vnegq_f32(vmulq_f32(sy, s)), vmulq_f32(sy, c) } };
+				float32x4x2_t t2 = { { vld1q_f32(&t.x[i]), vld1q_f32(&t.y[i]) } };
+				float tmp[16];
+				float pos[8];
+				vst4q_f32(tmp, abcd);
+				vst2q_f32(pos, t2);
+				for (int k = 0; k < 4; k++) {
+					out[i + k] = Affine2D{ tmp[k * 4], tmp[k * 4 + 1], tmp[k * 4 + 2], tmp[k * 4 + 3], pos[k * 2], pos[k * 2 + 1] };
+				}
+			}
+			return i;
+		}
+#endif
+	}
+
+	void TransformBatch(const TransformList& transforms, Affine2D* out, SinCosMode mode) {
+		bool precise = mode == SinCosMode::Precise;
+		size_t done = 0;
+#if defined(TOY2D_SIMD_X64)
+		done = CpuHasAvx2() ? transformAVX2(transforms, out, precise) : transformSSE2(transforms, out, precise);
+#elif defined(TOY2D_SIMD_NEON64)
+		done = transformNEON(transforms, out, precise);
+#endif
+		transformScalar(transforms, done, transforms.Size(), out, precise);
+	}
+
+}
@@ -0,0 +1,688 @@
+#include "toy2d/virtual_texture.hpp"
+#include "toy2d/context.hpp"
+#include "toy2d/shader.hpp"
+#include "toy2d/premultiply.hpp"
+#include "toy2d/stb_image.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <limits>
+
+namespace toy2d {
+
+	namespace {
+		constexpr uint32_t NoSlot = ~0u;
+
+		uint32_t packEntry(uint32_t slotX, uint32_t slotY, uint32_t level) {
+			// RGBA8UI: x, y, level, valid
+			return slotX | (slotY << 8) | (level << 16) | (1u << 24);
+		}
+
+		void imageBarrier(vk::CommandBuffer cmd, vk::Image image,
+			vk::ImageLayout oldLayout, vk::ImageLayout newLayout,
+			vk::PipelineStageFlags srcStage, vk::PipelineStageFlags dstStage,
+			vk::AccessFlags srcAccess, vk::AccessFlags dstAccess) {
+			vk::ImageMemoryBarrier barrier;
+			vk::ImageSubresourceRange range;
+			range.setAspectMask(vk::ImageAspectFlagBits::eColor)
+				.setBaseMipLevel(0)
+				.setLevelCount(1)
+				.setBaseArrayLayer(0)
+				.setLayerCount(1);
+			barrier.setImage(image)
+				.setOldLayout(oldLayout)
+				.setNewLayout(newLayout)
+				.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+				.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+				.setSrcAccessMask(srcAccess)
+				.setDstAccessMask(dstAccess)
+				.setSubresourceRange(range);
+			cmd.pipelineBarrier(srcStage, dstStage, {}, {}, nullptr, barrier);
+		}
+
+		void createImage2D(uint32_t w, uint32_t h, vk::Format format,
+			vk::Image& image, vk::DeviceMemory& memory, vk::ImageView& view) {
+			auto& device = Context::GetInstance().device;
+
+			vk::ImageCreateInfo imageInfo;
+			imageInfo.setImageType(vk::ImageType::e2D)
+				.setArrayLayers(1)
+				.setMipLevels(1)
+				.setExtent({ w, h, 1 })
+				.setFormat(format)
+				.setTiling(vk::ImageTiling::eOptimal)
+				.setInitialLayout(vk::ImageLayout::eUndefined)
+				.setUsage(vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled)
+				.setSamples(vk::SampleCountFlagBits::e1);
+			image = device.createImage(imageInfo);
+
+			auto requirements = device.getImageMemoryRequirements(image);
+			vk::MemoryAllocateInfo allocInfo;
+			allocInfo.setAllocationSize(requirements.size)
+				.setMemoryTypeIndex(QueryBufferMemTypeIndex(requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal));
+			memory = device.allocateMemory(allocInfo);
+			device.bindImageMemory(image, memory, 0);
+
+			vk::ImageSubresourceRange range;
+			range.setAspectMask(vk::ImageAspectFlagBits::eColor)
+				.setBaseMipLevel(0)
+				.setLevelCount(1)
+				.setBaseArrayLayer(0)
+				.setLayerCount(1);
+			vk::ImageViewCreateInfo viewInfo;
+			viewInfo.setImage(image)
+				.setViewType(vk::ImageViewType::e2D)
+				.setFormat(format)
+				.setSubresourceRange(range);
+			view = device.createImageView(viewInfo);
+		}
+	}
+
+	TiledImageSource::TiledImageSource(const std::string& directory) : directory_(directory) {
+		std::ifstream file(directory + "/layout.txt");
+		if (!(file >> width_ >> height_ >> pageSize_ >> levelCount_) ||
+			width_ == 0 || height_ == 0 || pageSize_ == 0 || levelCount_ == 0) {
+			throw std::runtime_error("Read virtual texture layout failed!");
+		}
+	}
+
+	bool TiledImageSource::LoadPage(uint32_t level, uint32_t x, uint32_t y, std::uint8_t* pixels) {
+		std::string filename = directory_ + "/" + std::to_string(level) + "/" +
+			std::to_string(x) + "_" + std::to_string(y) + ".png";
+		int w, h, channel;
+		stbi_uc* data = stbi_load(filename.c_str(), &w, &h, &channel, STBI_rgb_alpha);
+		if (!data) {
+			return false;
+		}
+
+		std::memset(pixels, 0, size_t(pageSize_) * pageSize_ * 4);
+		uint32_t rows = std::min<uint32_t>(h, pageSize_);
+		uint32_t cols = std::min<uint32_t>(w, pageSize_);
+		for (uint32_t row = 0; row < rows; row++) {
+			std::memcpy(pixels + size_t(row) * pageSize_ * 4, data + size_t(row) * w * 4, size_t(cols) * 4);
+		}
+		stbi_image_free(data);
+		return true;
+	}
+
+	VirtualTexture::VirtualTexture(std::unique_ptr<VirtualTextureSource> source, int maxFlightCount)
+		: source_(std::move(source)), rect_{ 0, 0, 0, 0 }, maxFlightCount_(maxFlightCount),
+		dirtyMinY_(~0u), dirtyMaxY_(0) {
+		auto& ctx = Context::GetInstance();
+
+		pageSize_ = source_->PageSize();
+		levelCount_ = std::max<uint32_t>(source_->LevelCount(), 1);
+		tableWidth_ = (source_->Width() + pageSize_ - 1) / pageSize_;
+		tableHeight_ = (source_->Height() + pageSize_ - 1) / pageSize_;
+
+		// the cache follows the screen, not the image: every page touching the viewport
+		// twice over (level transitions, stale pages still in flight), plus the pinned level
+		auto extent = ctx.swapchain->info.imageExtent;
+		uint32_t screenPages = (extent.width / pageSize_ + 2) * (extent.height / pageSize_ + 2);
+		cachePages_ = static_cast<uint32_t>(std::ceil(std::sqrt(float(screenPages * 2 + 1))));
+		uint32_t maxDimension = ctx.physicaldevice.getProperties().limits.maxImageDimension2D;
+		// physical page coordinates are stored in 8 bits
+		cachePages_ = std::min({ cachePages_, 255u, maxDimension / pageSize_ });
+
+		slots_.resize(cachePages_ * cachePages_, Slot{ NoPage, 0, false });
+		table_.assign(size_t(tableWidth_) * tableHeight_, 0);
+		stats_.cachePages = static_cast<uint32_t>(slots_.size());
+
+		createImages();
+		createDescriptors();
+		createPipeline();
+
+		uploadCmds_ = ctx.commandManager->CreateCommandBuffers(maxFlightCount_);
+		size_t stagingSize = size_t(MaxUploadsPerFrame) * pageSize_ * pageSize_ * 4 + table_.size() * sizeof(uint32_t);
+		stagingBuffers_.resize(maxFlightCount_);
+		for (auto& buffer : stagingBuffers_) {
+			buffer.reset(new Buffer(stagingSize,
+				vk::BufferUsageFlagBits::eTransferSrc,
+				vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+		}
+
+		loadPinnedPage();
+
+		worker_ = std::thread(&VirtualTexture::workerLoop, this);
+	}
+
+	VirtualTexture::~VirtualTexture() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			quit_ = true;
+		}
+		cond_.notify_all();
+		worker_.join();
+
+		auto& ctx = Context::GetInstance();
+		auto& device = ctx.device;
+		device.waitIdle();
+
+		for (auto cmd : uploadCmds_) {
+			ctx.commandManager->freeCmds(cmd);
+		}
+		stagingBuffers_.clear();
+
+		device.destroyPipeline(pipeline_);
+		device.destroyPipelineLayout(pipelineLayout_);
+		device.destroyShaderModule(vertModule_);
+		device.destroyShaderModule(fragModule_);
+		device.destroyDescriptorPool(descriptorPool_);
+		device.destroyDescriptorSetLayout(setLayout_);
+		device.destroySampler(cacheSampler_);
+		device.destroySampler(tableSampler_);
+		device.destroyImageView(cacheView_);
+		device.destroyImage(cacheImage_);
+		device.freeMemory(cacheMemory_);
+		device.destroyImageView(tableView_);
+		device.destroyImage(tableImage_);
+		device.freeMemory(tableMemory_);
+	}
+
+	void VirtualTexture::SetRect(float x, float y, float w, float h) {
+		rect_ = Rect{ x, y, x + w, y + h };
+	}
+
+	void VirtualTexture::createImages() {
+		auto& ctx = Context::GetInstance();
+
+		createImage2D(cachePages_ * pageSize_, cachePages_ * pageSize_, vk::Format::eR8G8B8A8Srgb,
+			cacheImage_, cacheMemory_, cacheView_);
+		createImage2D(tableWidth_, tableHeight_, vk::Format::eR8G8B8A8Uint,
+			tableImage_, tableMemory_, tableView_);
+
+		ctx.commandManager->ExecuteCmd(ctx.graphics_queue,
+			[&](vk::CommandBuffer cmdBuf) {
+				vk::ImageSubresourceRange range;
+				range.setAspectMask(vk::ImageAspectFlagBits::eColor)
+					.setBaseMipLevel(0)
+					.setLevelCount(1)
+					.setBaseArrayLayer(0)
+					.setLayerCount(1);
+				for (auto image : { cacheImage_, tableImage_ }) {
+					imageBarrier(cmdBuf, image, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
+						vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
+						{}, vk::AccessFlagBits::eTransferWrite);
+				}
+				cmdBuf.clearColorImage(cacheImage_, vk::ImageLayout::eTransferDstOptimal,
+					vk::ClearColorValue(std::array<float, 4>{ 0, 0, 0, 0 }), range);
+				cmdBuf.clearColorImage(tableImage_, vk::ImageLayout::eTransferDstOptimal,
+					vk::ClearColorValue(std::array<uint32_t, 4>{ 0, 0, 0, 0 }), range);
+				for (auto image : { cacheImage_, tableImage_ }) {
+					imageBarrier(cmdBuf, image, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
+						vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader,
+						vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead);
+				}
+			});
+
+		vk::SamplerCreateInfo samplerInfo;
+		samplerInfo.setMagFilter(vk::Filter::eLinear)
+			.setMinFilter(vk::Filter::eLinear)
+			.setAddressModeU(vk::SamplerAddressMode::eClampToEdge)
+			.setAddressModeV(vk::SamplerAddressMode::eClampToEdge)
+			.setAddressModeW(vk::SamplerAddressMode::eClampToEdge)
+			.setAnisotropyEnable(false)
+			.setUnnormalizedCoordinates(false)
+			.setCompareEnable(false)
+			.setMipmapMode(vk::SamplerMipmapMode::eNearest);
+		cacheSampler_ = ctx.device.createSampler(samplerInfo);
+
+		// the page table is integer, it is only read with texelFetch
+		samplerInfo.setMagFilter(vk::Filter::eNearest)
+			.setMinFilter(vk::Filter::eNearest);
+		tableSampler_ = ctx.device.createSampler(samplerInfo);
+	}
+
+	void VirtualTexture::createDescriptors() {
+		auto& device = Context::GetInstance().device;
+
+		std::vector<vk::DescriptorSetLayoutBinding> bindings(2);
+		bindings[0].setBinding(0)
+			.setDescriptorCount(1)
+			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+			.setStageFlags(vk::ShaderStageFlagBits::eFragment);
+		bindings[1].setBinding(1)
+			.setDescriptorCount(1)
+			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+			.setStageFlags(vk::ShaderStageFlagBits::eFragment);
+		vk::DescriptorSetLayoutCreateInfo layoutInfo;
+		layoutInfo.setBindings(bindings);
+		setLayout_ = device.createDescriptorSetLayout(layoutInfo);
+
+		vk::DescriptorPoolSize size;
+		size.setType(vk::DescriptorType::eCombinedImageSampler)
+			.setDescriptorCount(2);
+		vk::DescriptorPoolCreateInfo poolInfo;
+		poolInfo.setMaxSets(1)
+			.setPoolSizes(size);
+		descriptorPool_ = device.createDescriptorPool(poolInfo);
+
+		vk::DescriptorSetAllocateInfo allocInfo;
+		allocInfo.setDescriptorPool(descriptorPool_)
+			.setSetLayouts(setLayout_);
+		set_ = device.allocateDescriptorSets(allocInfo)[0];
+
+		vk::DescriptorImageInfo cacheInfo;
+		cacheInfo.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+			.setImageView(cacheView_)
+			.setSampler(cacheSampler_);
+		vk::DescriptorImageInfo tableInfo;
+		tableInfo.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+			.setImageView(tableView_)
+			.setSampler(tableSampler_);
+
+		std::vector<vk::WriteDescriptorSet> writers(2);
+		writers[0].setImageInfo(cacheInfo)
+			.setDstBinding(0)
+			.setDstArrayElement(0)
+			.setDstSet(set_)
+			.setDescriptorCount(1)
+			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+		writers[1].setImageInfo(tableInfo)
+			.setDstBinding(1)
+			.setDstArrayElement(0)
+			.setDstSet(set_)
+			.setDescriptorCount(1)
+			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler);
+		device.updateDescriptorSets(writers, {});
+	}
+
+	void VirtualTexture::createPipeline() {
+		auto& ctx = Context::GetInstance();
+
+		std::array<vk::DescriptorSetLayout, 2> setLayouts = { Shader::GetInstance().GetDescriptorSetLayouts()[0], setLayout_ };
+		std::array<vk::PushConstantRange, 2> ranges;
+		ranges[0].setOffset(0)
+			.setSize(sizeof(glm::mat4x4))
+			.setStageFlags(vk::ShaderStageFlagBits::eVertex);
+		ranges[1].setOffset(sizeof(glm::mat4x4))
+			.setSize(sizeof(float) * 4)
+			.setStageFlags(vk::ShaderStageFlagBits::eFragment);
+		vk::PipelineLayoutCreateInfo layoutInfo;
+		layoutInfo.setSetLayouts(setLayouts)
+			.setPushConstantRanges(ranges);
+		pipelineLayout_ = ctx.device.createPipelineLayout(layoutInfo);
+
+		vertModule_ = Shader::CreateModule(ReadWholeFile(GetShaderPath("virtual_texture_vert.spv")));
+		fragModule_ = Shader::CreateModule(ReadWholeFile(GetShaderPath("virtual_texture_frag.spv")));
+		std::vector<vk::PipelineShaderStageCreateInfo> stages(2);
+		stages[0].setStage(vk::ShaderStageFlagBits::eVertex)
+			.setModule(vertModule_)
+			.setPName("main");
+		stages[1].setStage(vk::ShaderStageFlagBits::eFragment)
+			.setModule(fragModule_)
+			.setPName("main");
+
+		VertexInput input;
+		input.bindings = { Vertex::GetBinding() };
+		input.attributes = Vertex::GetAttribute();
+		pipeline_ = ctx.renderProcess->CreateGraphicsPipeline(pipelineLayout_, stages, input);
+	}
+
+	void VirtualTexture::loadPinnedPage() {
+		// the coarsest level always stays resident, so there is something to show for every pixel
+		uint32_t level = levelCount_ - 1;
+		uint32_t levelPageTexels = pageSize_ << level;
+		uint32_t pagesX = (source_->Width() + levelPageTexels - 1) / levelPageTexels;
+		uint32_t pagesY = (source_->Height() + levelPageTexels - 1) / levelPageTexels;
+		if (pagesX * pagesY > MaxUploadsPerFrame || pagesX * pagesY > slots_.size() / 4) {
+			throw std::runtime_error("Virtual texture needs more levels, the coarsest one does not fit in the cache!");
+		}
+
+		std::vector<LoadedPage> loaded;
+		std::vector<uint32_t> slots;
+		for (uint32_t y = 0; y < pagesY; y++) {
+			for (uint32_t x = 0; x < pagesX; x++) {
+				LoadedPage page;
+				page.key = pageKey(level, x, y);
+				page.pixels.resize(size_t(pageSize_) * pageSize_ * 4);
+				page.ok = source_->LoadPage(level, x, y, page.pixels.data());
+				if (!page.ok) {
+					throw std::runtime_error("Load virtual texture page failed!");
+				}
+				PremultiplyAlpha(page.pixels.data(), page.pixels.data(), size_t(pageSize_) * pageSize_, PremultiplyMode::Srgb);
+
+				uint32_t slot = static_cast<uint32_t>(slots.size());
+				slots_[slot] = Slot{ page.key, 0, true };
+				pages_[page.key] = Page{ PageState::Resident, slot };
+				mapPage(page.key, slot);
+				slots.push_back(slot);
+				loaded.push_back(std::move(page));
+			}
+		}
+		stats_.residentPages = static_cast<uint32_t>(slots.size());
+
+		auto& ctx = Context::GetInstance();
+		ctx.commandManager->ExecuteCmd(ctx.graphics_queue,
+			[&](vk::CommandBuffer cmdBuf) {
+				recordUploads(cmdBuf, *stagingBuffers_[0], loaded, slots);
+			});
+	}
+
+	void VirtualTexture::workerLoop() {
+		while (true) {
+			uint64_t key;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				cond_.wait(lock, [&]() { return quit_ || !requests_.empty(); });
+				if (quit_) return;
+				key = requests_.front();
+				requests_.pop_front();
+			}
+
+			LoadedPage page;
+			page.key = key;
+			page.pixels.resize(size_t(pageSize_) * pageSize_ * 4);
+			page.ok = source_->LoadPage(keyLevel(key), keyX(key), keyY(key), page.pixels.data());
+			if (page.ok) {
+				PremultiplyAlpha(page.pixels.data(), page.pixels.data(), size_t(pageSize_) * pageSize_, PremultiplyMode::Srgb);
+			}
+
+			std::lock_guard<std::mutex> lock(mutex_);
+			loaded_.push_back(std::move(page));
+		}
+	}
+
+	void VirtualTexture::update(int flightIndex, uint64_t frame, const Rect& view, float pixelsPerUnit) {
+		requestVisiblePages(frame, view, pixelsPerUnit);
+
+		// a second DrawVirtualTexture in the same frame would reset the pending upload and its
+		// staging buffer, pages loaded since wait for the next frame
+		if (uploadFrame_ == frame) return;
+		uploadFrame_ = frame;
+
+		std::vector<LoadedPage> ready;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			size_t count = std::min<size_t>(loaded_.size(), MaxUploadsPerFrame);
+			std::move(loaded_.begin(), loaded_.begin() + count, std::back_inserter(ready));
+			loaded_.erase(loaded_.begin(), loaded_.begin() + count);
+		}
+
+		std::vector<LoadedPage> uploads;
+		std::vector<uint32_t> slots;
+		for (auto& page : ready) {
+			if (!page.ok) {
+				// keep the entry so a missing page is not requested again every frame
+				pages_[page.key] = Page{ PageState::Missing, NoSlot };
+				continue;
+			}
+			uint32_t slot = acquireSlot(frame);
+			if (slot == NoSlot) {
+				// everything is still in use by frames in flight, request it again later
+				pages_.erase(page.key);
+				continue;
+			}
+			slots_[slot] = Slot{ page.key, frame, false };
+			pages_[page.key] = Page{ PageState::Resident, slot };
+			mapPage(page.key, slot);
+			slots.push_back(slot);
+			uploads.push_back(std::move(page));
+			stats_.residentPages++;
+		}
+
+		if (uploads.empty() && dirtyMinY_ > dirtyMaxY_) {
+			return;
+		}
+
+		// submitted ahead of the frame's command buffer on the same queue, the barriers inside
+		// make the frame see the new pages. the frame fence covers this submit as well
+		auto& ctx = Context::GetInstance();
+		auto cmd = uploadCmds_[flightIndex];
+		cmd.reset();
+		vk::CommandBufferBeginInfo beginInfo;
+		beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+		cmd.begin(beginInfo);
+		recordUploads(cmd, *stagingBuffers_[flightIndex], uploads, slots);
+		cmd.end();
+
+		vk::SubmitInfo submitInfo;
+		submitInfo.setCommandBuffers(cmd);
+		ctx.graphics_queue.submit(submitInfo);
+		stats_.uploads += uploads.size();
+	}
+
+	void VirtualTexture::draw(vk::CommandBuffer cmd, vk::DescriptorSet globalSet) {
+		cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline_);
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout_, 0, { globalSet, set_ }, {});
+
+		glm::mat4x4 modelMat(1.0f);
+		modelMat = glm::translate(modelMat, { (rect_.minX + rect_.maxX) * 0.5f, (rect_.minY + rect_.maxY) * 0.5f, 0 });
+		modelMat = glm::scale(modelMat, { rect_.maxX - rect_.minX, rect_.maxY - rect_.minY, 1 });
+		cmd.pushConstants(pipelineLayout_, vk::ShaderStageFlagBits::eVertex, 0, sizeof(glm::mat4x4), (void*)&modelMat);
+
+		float params[4] = {
+			float(source_->Width()) / pageSize_,
+			float(source_->Height()) / pageSize_,
+			float(pageSize_),
+			float(cachePages_ * pageSize_),
+		};
+		cmd.pushConstants(pipelineLayout_, vk::ShaderStageFlagBits::eFragment, sizeof(glm::mat4x4), sizeof(params), (void*)params);
+		cmd.drawIndexed(6, 1, 0, 0, 0);
+	}
+
+	void VirtualTexture::requestVisiblePages(uint64_t frame, const Rect& view, float pixelsPerUnit) {
+		float rectW = rect_.maxX - rect_.minX;
+		float rectH = rect_.maxY - rect_.minY;
+		if (rectW <= 0 || rectH <= 0 || pixelsPerUnit <= 0 || !view.Intersects(rect_)) {
+			return;
+		}
+
+		float width = float(source_->Width());
+		float height = float(source_->Height());
+		float u0 = (std::max(view.minX, rect_.minX) - rect_.minX) / rectW;
+		float u1 = (std::min(view.maxX, rect_.maxX) - rect_.minX) / rectW;
+		float v0 = (std::max(view.minY, rect_.minY) - rect_.minY) / rectH;
+		float v1 = (std::min(view.maxY, rect_.maxY) - rect_.minY) / rectH;
+
+		// level 0 texels behind one screen pixel picks the level
+		float texelsPerPixel = width / (rectW * pixelsPerUnit);
+		uint32_t level = texelsPerPixel > 1 ? static_cast<uint32_t>(std::floor(std::log2(texelsPerPixel))) : 0;
+		level = std::min(level, levelCount_ - 1);
+
+		float levelPageTexels = float(pageSize_ << level);
+		uint32_t pagesX = static_cast<uint32_t>(std::ceil(width / levelPageTexels));
+		uint32_t pagesY = static_cast<uint32_t>(std::ceil(height / levelPageTexels));
+		uint32_t x0 = std::min(static_cast<uint32_t>(u0 * width / levelPageTexels), pagesX - 1);
+		uint32_t x1 = std::min(static_cast<uint32_t>(u1 * width / levelPageTexels), pagesX - 1);
+		uint32_t y0 = std::min(static_cast<uint32_t>(v0 * height / levelPageTexels), pagesY - 1);
+		uint32_t y1 = std::min(static_cast<uint32_t>(v1 * height / levelPageTexels), pagesY - 1);
+
+		std::vector<uint64_t> wanted;
+		for (uint32_t y = y0; y <= y1; y++) {
+			for (uint32_t x = x0; x <= x1; x++) {
+				uint64_t key = pageKey(level, x, y);
+				auto it = pages_.find(key);
+				if (it == pages_.end() || it->second.state == PageState::Loading) {
+					wanted.push_back(key);
+				} else if (it->second.state == PageState::Resident) {
+					slots_[it->second.slot].lastUsedFrame = frame;
+				}
+			}
+		}
+
+		// coarser pages are what shows while the wanted ones stream in, keep them alive
+		for (uint32_t l = level + 1; l < levelCount_; l++) {
+			uint32_t shift = l - level;
+			for (uint32_t y = y0 >> shift; y <= (y1 >> shift); y++) {
+				for (uint32_t x = x0 >> shift; x <= (x1 >> shift); x++) {
+					auto it = pages_.find(pageKey(l, x, y));
+					if (it != pages_.end() && it->second.state == PageState::Resident) {
+						slots_[it->second.slot].lastUsedFrame = frame;
+					}
+				}
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		// requests the worker has not started yet are dropped and queued again only if still visible
+		for (auto key : requests_) {
+			pages_.erase(key);
+		}
+		requests_.clear();
+		for (auto key : wanted) {
+			if (requests_.size() >= MaxPendingRequests) break;
+			if (pages_.find(key) != pages_.end()) continue;
+			pages_[key] = Page{ PageState::Loading, NoSlot };
+			requests_.push_back(key);
+			stats_.requests++;
+		}
+		if (!requests_.empty()) {
+			cond_.notify_one();
+		}
+	}
+
+	uint32_t VirtualTexture::acquireSlot(uint64_t frame) {
+		// a few hundred slots at most, a linear scan is cheaper than keeping a list sorted
+		uint32_t best = NoSlot;
+		uint64_t bestFrame = std::numeric_limits<uint64_t>::max();
+		for (uint32_t i = 0; i < slots_.size(); i++) {
+			auto& slot = slots_[i];
+			if (slot.page == NoPage) {
+				return i;
+			}
+			if (!slot.pinned && slot.lastUsedFrame + maxFlightCount_ <= frame && slot.lastUsedFrame < bestFrame) {
+				best = i;
+				bestFrame = slot.lastUsedFrame;
+			}
+		}
+		if (best != NoSlot) {
+			evictSlot(best);
+		}
+		return best;
+	}
+
+	void VirtualTexture::evictSlot(uint32_t slot) {
+		uint64_t key = slots_[slot].page;
+		unmapPage(key, slot);
+		pages_.erase(key);
+		slots_[slot].page = NoPage;
+		stats_.evictions++;
+		stats_.residentPages--;
+	}
+
+	void VirtualTexture::mapPage(uint64_t key, uint32_t slot) {
+		uint32_t level = keyLevel(key);
+		uint32_t x0 = keyX(key) << level;
+		uint32_t y0 = keyY(key) << level;
+		uint32_t x1 = std::min(tableWidth_, (keyX(key) + 1) << level);
+		uint32_t y1 = std::min(tableHeight_, (keyY(key) + 1) << level);
+		uint32_t entry = packEntry(slot % cachePages_, slot / cachePages_, level);
+
+		// finer resident pages keep their entries
+		for (uint32_t y = y0; y < y1; y++) {
+			for (uint32_t x = x0; x < x1; x++) {
+				uint32_t& cur = table_[size_t(y) * tableWidth_ + x];
+				if ((cur >> 24) == 0 || ((cur >> 16) & 0xFF) >= level) {
+					cur = entry;
+				}
+			}
+		}
+		markDirtyRows(y0, y1);
+	}
+
+	void VirtualTexture::unmapPage(uint64_t key, uint32_t slot) {
+		uint32_t level = keyLevel(key);
+		uint32_t x0 = keyX(key) << level;
+		uint32_t y0 = keyY(key) << level;
+		uint32_t x1 = std::min(tableWidth_, (keyX(key) + 1) << level);
+		uint32_t y1 = std::min(tableHeight_, (keyY(key) + 1) << level);
+		uint32_t entry = packEntry(slot % cachePages_, slot / cachePages_, level);
+
+		// every entry under this page shares the same ancestors, find the closest resident one
+		uint32_t fallback = 0;
+		for (uint32_t l = level + 1; l < levelCount_; l++) {
+			uint32_t shift = l - level;
+			auto it = pages_.find(pageKey(l, keyX(key) >> shift, keyY(key) >> shift));
+			if (it != pages_.end() && it->second.state == PageState::Resident) {
+				fallback = packEntry(it->second.slot % cachePages_, it->second.slot / cachePages_, l);
+				break;
+			}
+		}
+
+		for (uint32_t y = y0; y < y1; y++) {
+			for (uint32_t x = x0; x < x1; x++) {
+				uint32_t& cur = table_[size_t(y) * tableWidth_ + x];
+				if (cur == entry) {
+					cur = fallback;
+				}
+			}
+		}
+		markDirtyRows(y0, y1);
+	}
+
+	void VirtualTexture::markDirtyRows(uint32_t y0, uint32_t y1) {
+		if (y0 >= y1) return;
+		dirtyMinY_ = std::min(dirtyMinY_, y0);
+		dirtyMaxY_ = std::max(dirtyMaxY_, y1 - 1);
+	}
+
+	void VirtualTexture::recordUploads(vk::CommandBuffer cmd, Buffer& staging, std::vector<LoadedPage>& pages, const std::vector<uint32_t>& slots) {
+		auto* dst = static_cast<std::uint8_t*>(staging.map);
+		size_t pageBytes = size_t(pageSize_) * pageSize_ * 4;
+
+		if (!pages.empty()) {
+			std::vector<vk::BufferImageCopy> regions(pages.size());
+			for (size_t i = 0; i < pages.size(); i++) {
+				std::memcpy(dst + i * pageBytes, pages[i].pixels.data(), pageBytes);
+
+				vk::ImageSubresourceLayers subsource;
+				subsource.setAspectMask(vk::ImageAspectFlagBits::eColor)
+					.setBaseArrayLayer(0)
+					.setMipLevel(0)
+					.setLayerCount(1);
+				regions[i].setBufferOffset(i * pageBytes)
+					.setBufferRowLength(0)
+					.setBufferImageHeight(0)
+					.setImageOffset({ int32_t(slots[i] % cachePages_ * pageSize_), int32_t(slots[i] / cachePages_ * pageSize_), 0 })
+					.setImageExtent({ pageSize_, pageSize_, 1 })
+					.setImageSubresource(subsource);
+			}
+			// slots being written were last used by frames that already finished
+			imageBarrier(cmd, cacheImage_, vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageLayout::eTransferDstOptimal,
+				vk::PipelineStageFlagBits::eFragmentShader, vk::PipelineStageFlagBits::eTransfer,
+				{}, vk::AccessFlagBits::eTransferWrite);
+			cmd.copyBufferToImage(staging.buffer, cacheImage_, vk::ImageLayout::eTransferDstOptimal, regions);
+			imageBarrier(cmd, cacheImage_, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
+				vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader,
+				vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead);
+		}
+
+		if (dirtyMinY_ <= dirtyMaxY_) {
+			// the table region of the staging buffer mirrors table_, only dirty rows are refreshed
+			size_t tableOffset = MaxUploadsPerFrame * pageBytes;
+			size_t rowBytes = size_t(tableWidth_) * sizeof(uint32_t);
+			size_t dirtyOffset = tableOffset + dirtyMinY_ * rowBytes;
+			uint32_t rows = dirtyMaxY_ - dirtyMinY_ + 1;
+			std::memcpy(dst + dirtyOffset, table_.data() + size_t(dirtyMinY_) * tableWidth_, rows * rowBytes);
+
+			vk::ImageSubresourceLayers subsource;
+			subsource.setAspectMask(vk::ImageAspectFlagBits::eColor)
+				.setBaseArrayLayer(0)
+				.setMipLevel(0)
+				.setLayerCount(1);
+			vk::BufferImageCopy region;
+			region.setBufferOffset(dirtyOffset)
+				.setBufferRowLength(tableWidth_)
+				.setBufferImageHeight(0)
+				.setImageOffset({ 0, int32_t(dirtyMinY_), 0 })
+				.setImageExtent({ tableWidth_, rows, 1 })
+				.setImageSubresource(subsource);
+
+			// earlier frames may still sample the table, wait for them before overwriting
+			imageBarrier(cmd, tableImage_, vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageLayout::eTransferDstOptimal,
+				vk::PipelineStageFlagBits::eFragmentShader, vk::PipelineStageFlagBits::eTransfer,
+				{}, vk::AccessFlagBits::eTransferWrite);
+			cmd.copyBufferToImage(staging.buffer, tableImage_, vk::ImageLayout::eTransferDstOptimal, region);
+			imageBarrier(cmd, tableImage_, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal,
+				vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader,
+				vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead);
+
+			dirtyMinY_ = ~0u;
+			dirtyMaxY_ = 0;
+		}
+	}
+
+}
@@ -0,0 +1,198 @@
+#include "toy2d/cull.hpp"
+#include "toy2d/premultiply.hpp"
+#include "toy2d/radix_sort.hpp"
+#include "toy2d/spatial_grid.hpp"
+#include "toy2d/transform2d.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// RadixSort, CullBounds, SpatialGrid, TransformBatch and PremultiplyAlpha against brute force
+// versions of the same thing. prints every failed check and returns non zero if there was one
+
+namespace {
+
+	int failures = 0;
+
+	void check(bool ok, const char* what) {
+		if (!ok) {
+			std::printf("FAILED: %s\n", what);
+			failures++;
+		}
+	}
+
+	std::uint8_t referencePremultiply(std::uint8_t color, std::uint8_t alpha, toy2d::PremultiplyMode mode) {
+		double a = alpha / 255.0;
+		double v = color / 255.0;
+		if (mode == toy2d::PremultiplyMode::Srgb) {
+			v = v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4);
+			v *= a;
+			v = v <= 0.0031308 ? v * 12.92 : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055;
+		} else {
+			v *= a;
+		}
+		return static_cast<std::uint8_t>(std::lround(std::clamp(v, 0.0, 1.0) * 255.0));
+	}
+
+	void testPremultiply(std::mt19937& rng) {
+		// odd count so the scalar tail of the kernels runs too
+		const size_t pixels = 1003;
+		std::vector<std::uint8_t> src(pixels * 4), dst(pixels * 4);
+		for (auto& b : src) b = static_cast<std::uint8_t>(rng());
+		// the edges of the alpha range
+		src[3] = 0;
+		src[7] = 255;
+
+		for (auto mode : { toy2d::PremultiplyMode::Srgb, toy2d::PremultiplyMode::Fast }) {
+			toy2d::PremultiplyAlpha(src.data(), dst.data(), pixels, mode);
+			bool ok = true;
+			for (size_t i = 0; i < pixels; i++) {
+				std::uint8_t alpha = src[i * 4 + 3];
+				for (int c = 0; c < 3; c++) {
+					int expected = referencePremultiply(src[i * 4 + c], alpha, mode);
+					ok &= std::abs(expected - dst[i * 4 + c]) <= 1;
+				}
+				ok &= dst[i * 4 + 3] == alpha;
+			}
+			check(ok, mode == toy2d::PremultiplyMode::Srgb ? "premultiply srgb matches reference" : "premultiply fast matches reference");
+
+			std::vector<std::uint8_t> inPlace = src;
+			toy2d::PremultiplyAlpha(inPlace.data(), inPlace.data(), pixels, mode);
+			check(inPlace == dst, "premultiply in place equals out of place");
+		}
+	}
+
+	void testTransform(std::mt19937& rng) {
+		toy2d::TransformList list;
+		std::uniform_real_distribution<float> angle(-1000.0f, 1000.0f);
+		std::uniform_real_distribution<float> scale(-4.0f, 4.0f);
+		// odd count for the tail again
+		for (int i = 0; i < 1001; i++) {
+			list.Push(float(i), float(-i), angle(rng), scale(rng), scale(rng));
+		}
+		std::vector<toy2d::Affine2D> out(list.Size());
+
+		for (auto mode : { toy2d::SinCosMode::Precise, toy2d::SinCosMode::Fast }) {
+			toy2d::TransformBatch(list, out.data(), mode);
+			// per unit of scale
+			double tolerance = mode == toy2d::SinCosMode::Precise ? 1e-5 : 1e-3;
+			bool ok = true;
+			for (size_t i = 0; i < list.Size(); i++) {
+				double s = std::sin(double(list.rotation[i]));
+				double c = std::cos(double(list.rotation[i]));
+				double sx = list.scaleX[i], sy = list.scaleY[i];
+				const toy2d::Affine2D& m = out[i];
+				ok &= std::abs(m.a - sx * c) <= tolerance * std::abs(sx) + 1e-6;
+				ok &= std::abs(m.b - sx * s) <= tolerance * std::abs(sx) + 1e-6;
+				ok &= std::abs(m.c + sy * s) <= tolerance * std::abs(sy) + 1e-6;
+				ok &= std::abs(m.d - sy * c) <= tolerance * std::abs(sy) + 1e-6;
+				ok &= m.tx == list.x[i] && m.ty == list.y[i];
+			}
+			check(ok, mode == toy2d::SinCosMode::Precise ? "transform precise matches sin and cos" : "transform fast matches sin and cos");
+		}
+	}
+
+	void testRadixSort(std::mt19937& rng) {
+		std::vector<toy2d::SortItem> items, scratch;
+		// few distinct keys spread over the high and low bytes, so stability matters
+		for (std::uint32_t i = 0; i < 100000; i++) {
+			std::uint64_t key = (std::uint64_t(rng() % 50) << 40) | (rng() % 3);
+			items.push_back({ key, i });
+		}
+		auto expected = items;
+		std::stable_sort(expected.begin(), expected.end(), [](const toy2d::SortItem& a, const toy2d::SortItem& b) {
+			return a.key < b.key;
+		});
+		toy2d::RadixSort(items, scratch);
+		bool ok = items.size() == expected.size();
+		for (size_t i = 0; ok && i < items.size(); i++) {
+			ok &= items[i].key == expected[i].key && items[i].index == expected[i].index;
+		}
+		check(ok, "radix sort equals stable sort");
+
+		std::vector<toy2d::SortItem> empty;
+		toy2d::RadixSort(empty, scratch);
+		check(empty.empty(), "radix sort of nothing");
+	}
+
+	std::vector<toy2d::Rect> randomRects(std::mt19937& rng, size_t count) {
+		std::uniform_real_distribution<float> position(-3000.0f, 3000.0f);
+		std::uniform_real_distribution<float> size(0.0f, 400.0f);
+		std::vector<toy2d::Rect> rects;
+		for (size_t i = 0; i < count; i++) {
+			float x = position(rng), y = position(rng);
+			rects.push_back({ x, y, x + size(rng), y + size(rng) });
+		}
+		return rects;
+	}
+
+	std::vector<std::uint32_t> bruteForce(const std::vector<toy2d::Rect>& rects, const std::vector<bool>& alive, const toy2d::Rect& view) {
+		std::vector<std::uint32_t> result;
+		for (std::uint32_t i = 0; i < rects.size(); i++) {
+			if (alive[i] && rects[i].Intersects(view)) result.push_back(i);
+		}
+		return result;
+	}
+
+	void testCull(std::mt19937& rng) {
+		auto rects = randomRects(rng, 1003);
+		toy2d::BoundsList bounds;
+		for (auto& r : rects) bounds.Push(r);
+		std::vector<bool> alive(rects.size(), true);
+
+		for (toy2d::Rect view : { toy2d::Rect{ -500, -400, 500, 400 }, toy2d::Rect{ 1e5f, 1e5f, 2e5f, 2e5f } }) {
+			// appends, so start with something in it
+			std::vector<std::uint32_t> visible = { 12345 };
+			size_t count = toy2d::CullBounds(bounds, view, visible);
+			auto expected = bruteForce(rects, alive, view);
+			expected.insert(expected.begin(), 12345);
+			check(count == expected.size() - 1 && visible == expected, "cull equals brute force");
+		}
+	}
+
+	void testSpatialGrid(std::mt19937& rng) {
+		auto rects = randomRects(rng, 1003);
+		std::vector<bool> alive(rects.size(), true);
+		toy2d::SpatialGrid grid(256.0f);
+		for (std::uint32_t i = 0; i < rects.size(); i++) grid.Insert(i, rects[i]);
+
+		// moves, some of them across many cells
+		std::uniform_real_distribution<float> position(-3000.0f, 3000.0f);
+		for (std::uint32_t i = 0; i < rects.size(); i += 3) {
+			float x = position(rng), y = position(rng);
+			rects[i] = { x, y, x + 50, y + 900 };
+			grid.Update(i, rects[i]);
+		}
+		for (std::uint32_t i = 1; i < rects.size(); i += 7) {
+			grid.Remove(i);
+			alive[i] = false;
+		}
+
+		for (toy2d::Rect view : { toy2d::Rect{ -500, -400, 500, 400 }, toy2d::Rect{ -1e5f, -1e5f, 1e5f, 1e5f }, toy2d::Rect{ 1e5f, 1e5f, 2e5f, 2e5f } }) {
+			std::vector<std::uint32_t> found;
+			grid.Query(view, found);
+			std::sort(found.begin(), found.end());
+			check(found == bruteForce(rects, alive, view), "spatial grid query equals brute force");
+		}
+	}
+
+}
+
+int main() {
+	std::mt19937 rng(1);
+	testPremultiply(rng);
+	testTransform(rng);
+	testRadixSort(rng);
+	testCull(rng);
+	testSpatialGrid(rng);
+
+	if (failures) {
+		std::printf("%d checks failed\n", failures);
+		return 1;
+	}
+	std::printf("all checks passed\n");
+	return 0;
+}
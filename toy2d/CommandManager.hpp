@@ -12,7 +12,7 @@ namespace toy2d {
 		void resetCmds();
 		void freeCmds(vk::CommandBuffer buffer);
 
-		std::vector<vk::CommandBuffer> CreateCommandBuffers(std::uint32_t count);
+		std::vector<vk::CommandBuffer> CreateCommandBuffers(std::uint32_t count, vk::CommandBufferLevel level = vk::CommandBufferLevel::ePrimary);
 		vk::CommandBuffer CreateOneCommandBuffer();
 
 		using RecordCmdFunc = std::function<void(vk::CommandBuffer&)>;
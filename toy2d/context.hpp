@@ -42,6 +42,19 @@ namespace toy2d {
 		std::unique_ptr<CommandManager> commandManager;
 		vk::Sampler sampler;
 		QueueFamilyIndices queueInfo;
+		bool memoryBudgetSupported = false;	// VK_EXT_memory_budget enabled on device
+		bool pushDescriptorSupported = false;	// VK_KHR_push_descriptor enabled on device
+		bool dynamicRenderingSupported = false;	// Vulkan 1.3 dynamicRendering enabled on device
+		// pipelineStatisticsQuery and inheritedQueries enabled, queries may span secondaries
+		bool pipelineStatisticsSupported = false;
+		// textures are pushed inline instead of owning a descriptor set, set by toy2d::Init
+		bool usePushDescriptors = false;
+		// the render pass gets a depth attachment, set by toy2d::Init
+		bool useDepthBuffer = false;
+		// the frame is drawn with beginRendering on the swapchain image views, there is no
+		// RenderProcess::renderPass and no swapchain framebuffer. set by toy2d::Init
+		bool useDynamicRendering = false;
+		PFN_vkCmdPushDescriptorSetKHR cmdPushDescriptorSet = nullptr;
 
 		void InitSwapchain(int W, int H);
 		void InitRenderProcess();
@@ -67,6 +80,7 @@ namespace toy2d {
 		void getQueues();
 
 		void queryQueueInfo();
+		bool isDeviceExtensionSupported(const char* name) const;
 
 	};
 }
\ No newline at end of file
@@ -0,0 +1,20 @@
+#pragma once
+
+// x86-64 builds can always use SSE2, AVX2 functions are compiled with TOY2D_TARGET_AVX2
+// and only called when CpuHasAvx2() says so
+#if defined(__x86_64__) || defined(_M_X64)
+#define TOY2D_SIMD_X64
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define TOY2D_TARGET_AVX2
+#else
+#define TOY2D_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace toy2d {
+
+	// checked once, false on anything that is not x86-64
+	bool CpuHasAvx2();
+
+}
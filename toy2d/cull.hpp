@@ -0,0 +1,35 @@
+#pragma once
+
+#include "toy2d/tool.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace toy2d {
+
+	// boxes stored one array per edge, so several can be tested at once
+	struct BoundsList final {
+		std::vector<float> minX, minY, maxX, maxY;
+
+		void Push(const Rect& rect) {
+			minX.push_back(rect.minX);
+			minY.push_back(rect.minY);
+			maxX.push_back(rect.maxX);
+			maxY.push_back(rect.maxY);
+		}
+		void Clear() {
+			minX.clear();
+			minY.clear();
+			maxX.clear();
+			maxY.clear();
+		}
+		size_t Size() const { return minX.size(); }
+	};
+
+	// axis aligned box around a w * h rectangle centered at (cx, cy) and rotated by `radians`
+	Rect RotatedBounds(float cx, float cy, float w, float h, float radians);
+
+	// appends the index of every box overlapping view to visible (same test as Rect::Intersects),
+	// 4 boxes per step with SSE2 or NEON. returns how many were appended
+	size_t CullBounds(const BoundsList& bounds, const Rect& view, std::vector<uint32_t>& visible);
+
+}
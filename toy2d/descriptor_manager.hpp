@@ -11,6 +11,7 @@ public:
     struct SetInfo {
         vk::DescriptorSet set;
         vk::DescriptorPool pool;
+        uint32_t poolIndex = 0;    // into the image set pools, FreeImageSet goes straight to it
     };
 
     static void Init(uint32_t maxFlight) {
@@ -33,21 +34,36 @@ public:
 
     void FreeImageSet(const SetInfo&);
 
+    // sets that only live for the current frame, never freed one by one. the pools of a frame
+    // slot are reset together in BeginFrame, so allocating one costs about a pointer bump
+    vk::DescriptorSet AllocTransientSet(vk::DescriptorSetLayout layout);
+    // called by Renderer once the fence of the frame slot has signaled
+    void BeginFrame(uint32_t frameIndex);
+
 private:
     struct PoolInfo {
         vk::DescriptorPool pool_;
         uint32_t remainNum_;
     };
 
+    struct TransientFrame {
+        std::vector<vk::DescriptorPool> pools_;
+        uint32_t current_ = 0;
+    };
+
     PoolInfo bufferSetPool_;
 
-    std::vector<PoolInfo> fulledImageSetPool_;
-    std::vector<PoolInfo> avalibleImageSetPool_;
+    std::vector<PoolInfo> imageSetPools_;
+    // indices of the image set pools with sets left, each listed once
+    std::vector<uint32_t> avalibleImageSetPools_;
 
     void addImageSetPool();
-    PoolInfo& getAvaliableImagePoolInfo();
+    uint32_t getAvaliableImagePool();
+    vk::DescriptorPool createTransientPool();
 
     uint32_t maxFlight_;
+    std::vector<TransientFrame> transientFrames_;
+    uint32_t transientFrame_ = 0;
 
     static std::unique_ptr<DescriptorSetManager> instance_;
 };
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+#include "toy2d/buffer.hpp"
+#include "toy2d/descriptor_manager.hpp"
+#include "toy2d/pipeline_cache.hpp"
+#include "toy2d/vertex.hpp"
+#include "toy2d/tool.hpp"
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace toy2d {
+
+	// coverage of one glyph, in pixels of the source's RasterSize
+	struct GlyphBitmap {
+		uint32_t width = 0;
+		uint32_t height = 0;
+		std::vector<std::uint8_t> coverage;	// width * height, 255 is inside
+		float bearingX = 0;	// pen to the left edge
+		float bearingY = 0;	// baseline up to the top edge
+		float advance = 0;
+	};
+
+	class GlyphSource {
+	public:
+		virtual ~GlyphSource() = default;
+
+		// em size of the bitmaps in pixels, larger bitmaps are cut to it
+		virtual float RasterSize() const = 0;
+		virtual float LineHeight() const = 0;
+		// false for a codepoint the font doesn't have
+		virtual bool Rasterize(uint32_t codepoint, GlyphBitmap& out) = 0;
+	};
+
+	// monospace glyph sheet: columns x rows equal cells starting at firstCodepoint, row by row.
+	// coverage is the alpha channel, or the luminance of images without one. the bottom of a
+	// cell sits on the baseline
+	class GridFontSource final : public GlyphSource {
+	public:
+		GridFontSource(const std::string& filename, uint32_t columns, uint32_t rows, uint32_t firstCodepoint = 32);
+
+		float RasterSize() const override { return float(cellHeight_); }
+		float LineHeight() const override { return float(cellHeight_); }
+		bool Rasterize(uint32_t codepoint, GlyphBitmap& out) override;
+
+	private:
+		std::vector<std::uint8_t> coverage_;
+		uint32_t width_ = 0;
+		uint32_t cellWidth_ = 0;
+		uint32_t cellHeight_ = 0;
+		uint32_t columns_ = 0;
+		uint32_t count_ = 0;
+		uint32_t firstCodepoint_ = 0;
+	};
+
+	// glyphs are turned into signed distance fields the first time they are drawn and kept in
+	// fixed size cells of a dynamic atlas. when it is full the least recently used glyph no frame
+	// in flight still draws is replaced. draw it with Renderer::DrawText
+	class Font final {
+	public:
+		friend class Renderer;
+
+		Font(std::unique_ptr<GlyphSource> source, int maxFlightCount = 2, uint32_t atlasSize = 1024);
+		~Font();
+
+		struct Stats {
+			uint64_t rasterized = 0;
+			uint64_t evictions = 0;
+			uint64_t dropped = 0;	// glyphs skipped for a full atlas or the per frame upload limit
+			uint32_t residentGlyphs = 0;
+			uint32_t cells = 0;
+		};
+		const Stats& GetStats() const { return stats_; }
+
+	private:
+		// distance in source pixels covered by the field on each side of an edge
+		static constexpr uint32_t Spread = 4;
+		static constexpr uint32_t MaxUploadsPerFrame = 64;
+		static constexpr uint32_t NoCell = ~0u;
+
+		struct Glyph {
+			uint32_t cell = NoCell;	// NoCell for a missing or empty glyph
+			float x0, y0, x1, y1;	// quad relative to the pen, y down, in source pixels
+			float advance = 0;
+		};
+		struct Cell {
+			uint32_t codepoint;
+			uint64_t lastUsedFrame = 0;
+			std::list<uint32_t>::iterator lruIt;
+		};
+
+		std::unique_ptr<GlyphSource> source_;
+		int maxFlightCount_;
+		uint32_t id_;
+		uint32_t atlasSize_;
+		uint32_t cellSize_;
+		uint32_t cellsPerSide_;
+
+		vk::Image image_;
+		vk::DeviceMemory memory_;
+		vk::ImageView view_;
+		DescriptorSetManager::SetInfo set_;	// empty with Context::usePushDescriptors
+
+		vk::ShaderModule vertModule_;
+		vk::ShaderModule fragModule_;
+		VertexInput input_;
+
+		std::unordered_map<uint32_t, Glyph> glyphs_;
+		std::vector<Cell> cells_;
+		std::vector<uint32_t> freeCells_;
+		std::list<uint32_t> lru_;	// occupied cells, least recently used first
+		Stats stats_;
+
+		std::vector<vk::CommandBuffer> uploadCmds_;
+		std::vector<std::unique_ptr<Buffer>> stagingBuffers_;
+		std::vector<vk::BufferImageCopy> uploads_;
+		uint64_t frame_ = 0;
+		int flightIndex_ = 0;
+
+		static uint32_t nextId_;
+
+		void createAtlas();
+		void createPipelineState();
+		// the glyph made resident for this frame, null if it can't be drawn
+		const Glyph* acquire(uint32_t codepoint);
+		uint32_t acquireCell();
+		// false when no cell can be freed this frame
+		bool rasterize(uint32_t codepoint, Glyph& glyph);
+
+		// called by Renderer: layout appends one instance per visible glyph, y is the first baseline
+		void beginFrame(uint64_t frame, int flightIndex);
+		void layout(std::string_view utf8, float x, float y, float size, PackedColor color, float depth,
+			std::vector<GlyphInstance>& out, Rect& bounds);
+		// submits this frame's glyph uploads ahead of the frame's command buffer
+		void flush();
+		vk::Pipeline pipeline();
+		void bind(vk::CommandBuffer cmd, vk::PipelineLayout layout) const;
+	};
+
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+#include "toy2d/render_target.hpp"
+#include <array>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace toy2d {
+
+	// how a pass uses an image, decides the layout and the stages and access of its barriers
+	enum class ImageAccess {
+		ColorAttachment,	// write, the graph begins a render pass around the pass
+		DepthAttachment,	// write, same
+		Sampled,			// read by fragment or compute shaders
+		StorageRead,		// compute, eGeneral
+		StorageWrite,
+		TransferSrc,
+		TransferDst,
+	};
+
+	// the offscreen passes of a frame. passes declare the images they read and write, the graph
+	// drops passes nothing needs, orders the rest, puts one barrier batch in front of every pass
+	// and lets transient images whose lifetimes don't overlap share memory. it is declared anew
+	// every frame between Renderer::StartRender and EndRender and recorded ahead of the frame's
+	// render pass
+	class FrameGraph final {
+	public:
+		friend class Renderer;
+
+		using Handle = uint32_t;
+
+		class Builder final {
+		public:
+			friend class FrameGraph;
+
+			// a pass touches an image once, with one access
+			void Read(Handle image, ImageAccess access = ImageAccess::Sampled);
+			void Write(Handle image, ImageAccess access);
+			// the attachment is cleared when the pass begins, color to clear, depth to 0. an
+			// attachment written without a clear keeps what the passes before wrote
+			void Clear(Handle image, const std::array<float, 4>& clear = {});
+			// the pass is kept even when nothing reads what it writes
+			void SideEffect();
+
+		private:
+			Builder(FrameGraph& graph, uint32_t pass) : graph_(graph), pass_(pass) {}
+			FrameGraph& graph_;
+			uint32_t pass_;
+		};
+
+		using SetupFunc = std::function<void(Builder&)>;
+		using ExecuteFunc = std::function<void(vk::CommandBuffer, const FrameGraph&)>;
+
+		// imported targets are touched in pool so it doesn't recycle them under the frame
+		FrameGraph(RenderTargetPool& pool, int maxFlightCount);
+		~FrameGraph();
+
+		// an image that only lives inside the graph, its usage follows from the passes using it
+		Handle CreateImage(std::string name, vk::Extent2D extent, vk::Format format);
+		// a pooled target that outlives the frame, passes writing it are what keeps the graph alive.
+		// it enters the graph undefined, or shader readable when a read comes first, and leaves
+		// it shader readable when sampled
+		Handle Import(std::string name, RenderTarget& target);
+		// setup runs right away, execute when the graph is recorded. pipelines of attachment passes
+		// are made for RenderTargetPool::GetRenderPass with the same formats and have viewport and
+		// scissor set to the attachment's extent
+		void AddPass(std::string name, SetupFunc setup, ExecuteFunc execute);
+
+		// valid inside execute
+		vk::Image GetImage(Handle image) const;
+		vk::ImageView GetView(Handle image) const;
+		vk::Extent2D GetExtent(Handle image) const;
+		// binds a sampled image as the set layout's binding 0 at setIndex, like Texture::Bind
+		void Bind(vk::CommandBuffer cmd, Handle image, vk::PipelineLayout layout, uint32_t setIndex = 1) const;
+
+		struct Stats {
+			uint32_t passes = 0;			// recorded
+			uint32_t culled = 0;
+			uint32_t barriers = 0;			// image barriers
+			uint32_t barrierBatches = 0;	// pipelineBarrier calls
+			uint32_t transientImages = 0;
+			uint32_t memoryBlocks = 0;		// the transient images share these
+			vk::DeviceSize transientMemory = 0;	// allocated for the frame slot
+			vk::DeviceSize unaliasedMemory = 0;	// what one allocation per image would take
+		};
+		// of the last recorded graph
+		const Stats& GetStats() const { return stats_; }
+
+	private:
+		static constexpr uint32_t None = ~0u;
+		// shorter than RenderTargetPool::MaxIdleFrames, so a framebuffer is gone before the pool
+		// frees a view it references
+		static constexpr uint64_t MaxFramebufferIdleFrames = 60;
+
+		struct State {
+			vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+			vk::PipelineStageFlags writeStages;
+			vk::AccessFlags writeAccess;
+			vk::PipelineStageFlags readStages;		// since the last write
+			vk::PipelineStageFlags visibleStages;	// readers that already waited for the last write
+		};
+		struct Resource {
+			std::string name;
+			RenderTargetDesc desc;		// usage gathered from the kept passes
+			RenderTarget* imported = nullptr;
+			vk::Image image;
+			vk::ImageView view;
+			uint32_t first = None;		// positions in order_
+			uint32_t last = None;
+			uint32_t aliasOf = None;	// resource that used the memory before
+			State state;
+		};
+		struct Access {
+			Handle image;
+			ImageAccess access;
+			bool clear = false;
+		};
+		struct Pass {
+			std::string name;
+			ExecuteFunc execute;
+			std::vector<Access> accesses;
+			std::array<float, 4> clearColor = {};
+			bool sideEffect = false;
+			bool kept = false;
+			std::vector<uint32_t> dataDeps;		// passes whose results this pass uses
+			std::vector<uint32_t> orderDeps;	// passes it has to follow, data and write after read
+		};
+
+		// the transient images of a frame slot with their memory, kept while the graph's
+		// transient images and lifetimes stay the same
+		struct Lifetime {
+			RenderTargetDesc desc;
+			uint32_t first, last;
+			bool operator==(const Lifetime& o) const { return desc == o.desc && first == o.first && last == o.last; }
+		};
+		struct Transient {
+			vk::Image image;
+			vk::ImageView view;
+			vk::DeviceSize size;
+			uint32_t block;
+			uint32_t aliasOf;	// index into images
+		};
+		struct Block {
+			vk::DeviceMemory memory;
+			vk::DeviceSize size;
+		};
+		struct Slot {
+			std::vector<Lifetime> lifetimes;
+			std::vector<Transient> images;
+			std::vector<Block> blocks;
+		};
+
+		struct RenderPassKey {
+			vk::Format color, depth;
+			vk::AttachmentLoadOp colorLoad, depthLoad;
+			vk::AttachmentStoreOp colorStore, depthStore;
+			bool operator==(const RenderPassKey& o) const {
+				return color == o.color && depth == o.depth && colorLoad == o.colorLoad && depthLoad == o.depthLoad &&
+					colorStore == o.colorStore && depthStore == o.depthStore;
+			}
+		};
+		struct CachedPass {
+			RenderPassKey key;
+			vk::RenderPass renderPass;
+		};
+		struct CachedFramebuffer {
+			vk::RenderPass renderPass;
+			vk::ImageView color, depth;
+			vk::Framebuffer framebuffer;
+			uint64_t lastUsedFrame;
+		};
+
+		RenderTargetPool& pool_;
+		std::vector<Resource> resources_;
+		std::vector<Pass> passes_;
+		std::vector<uint32_t> order_;
+		std::vector<Slot> slots_;
+		int slot_ = 0;
+		uint64_t frame_ = 0;
+		std::vector<CachedPass> renderPasses_;
+		std::vector<CachedFramebuffer> framebuffers_;
+		Stats stats_;
+
+		void addAccess(uint32_t pass, Handle image, ImageAccess access);
+
+		// called by Renderer once the fence of the frame slot was waited, forgets the last graph
+		void beginFrame(int slot, uint64_t frame);
+		// compiles the declared graph and records it, nothing is recorded without passes
+		void record(vk::CommandBuffer cmd);
+
+		void cull();
+		void schedule();
+		void allocate();
+		void destroySlot(Slot& slot);
+		void transition(Handle image, ImageAccess access, std::vector<vk::ImageMemoryBarrier>& barriers,
+			vk::PipelineStageFlags& srcStages, vk::PipelineStageFlags& dstStages);
+		void recordPass(vk::CommandBuffer cmd, uint32_t position);
+		vk::RenderPass renderPass(const RenderPassKey& key);
+		vk::Framebuffer framebuffer(vk::RenderPass pass, vk::ImageView color, vk::ImageView depth, vk::Extent2D extent);
+	};
+
+}
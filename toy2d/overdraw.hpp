@@ -0,0 +1,83 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+#include "toy2d/buffer.hpp"
+#include "toy2d/pipeline_cache.hpp"
+#include <memory>
+#include <vector>
+
+namespace toy2d {
+
+	struct OverdrawStats {
+		uint64_t frame = 0;				// the frame the numbers were measured in, 0 for none yet
+		float averageOverdraw = 0;		// heat pass fragments per pixel
+		uint32_t maxOverdraw = 0;		// most fragments on a single pixel
+		uint64_t fragmentInvocations = 0;	// of the real render pass, 0 without pipelineStatisticsSupported
+	};
+
+	// diagnostics for fill rate. the renderer draws its geometry a second time into an offscreen
+	// target with additive blending, so every pixel ends up with the number of fragments covering
+	// it, and a compute pass sums it up. a pipeline statistics query counts the fragment shader
+	// invocations of the real pass around it. results are read back once the frame's fence was waited
+	class OverdrawMeter final {
+	public:
+		OverdrawMeter(int maxFlightCount);
+		~OverdrawMeter();
+
+		// results of the frame that last used the slot, false if it measured nothing yet
+		bool ReadResults(int slot, OverdrawStats& stats);
+
+		// around the real render pass, outside of it
+		void BeginStatistics(vk::CommandBuffer cmd, int slot, uint64_t frame);
+		void EndStatistics(vk::CommandBuffer cmd, int slot);
+
+		// clears the heat target and begins its render pass
+		void BeginHeatPass(vk::CommandBuffer cmd);
+		// ends the pass and sums the heat into the slot's result
+		void EndHeatPass(vk::CommandBuffer cmd, int slot);
+		// additive pipeline counting the fragments of the given vertex stage, for the heat pass
+		vk::Pipeline GetHeatPipeline(vk::PipelineLayout layout, vk::ShaderModule vertex, const VertexInput& input);
+
+	private:
+		// matches Result in overdraw_reduce.comp
+		struct Result {
+			uint32_t sum;
+			uint32_t maxCount;
+		};
+		struct Frame {
+			std::unique_ptr<Buffer> result;
+			vk::DescriptorSet set;
+			uint64_t frame = 0;
+			bool queried = false;
+		};
+
+		int maxFlightCount_;
+		std::vector<Frame> frames_;
+
+		vk::Extent2D extent_;
+		vk::Image image_;
+		vk::DeviceMemory memory_;
+		vk::ImageView view_;
+		vk::Framebuffer framebuffer_;
+		vk::RenderPass renderPass_;
+		vk::ShaderModule fragModule_;
+		PipelineCache pipelines_;
+
+		vk::DescriptorSetLayout setLayout_;
+		vk::DescriptorPool descriptorPool_;
+		vk::PipelineLayout reduceLayout_;
+		vk::Pipeline reducePipeline_;
+		vk::ShaderModule reduceModule_;
+
+		vk::QueryPool queryPool_;
+
+		void createRenderPass();
+		void createReducePipeline();
+		void createDescriptors();
+		// (re)creates the heat image for the swapchain extent
+		void createTarget();
+		void destroyTarget();
+		void writeSets();
+	};
+
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+#include "toy2d/buffer.hpp"
+#include "toy2d/texture.hpp"
+#include "toy2d/pipeline_cache.hpp"
+#include <memory>
+#include <vector>
+
+namespace toy2d {
+
+	// where and how new particles start, angles in degrees, 0 points along +x
+	struct ParticleEmitter {
+		float x = 0, y = 0;
+		float radius = 0;		// particles start anywhere inside this disc
+		float rate = 0;			// particles per second
+		float direction = 0;
+		float spread = 360;		// the start velocity points into direction +- spread / 2
+		float minSpeed = 0, maxSpeed = 100;
+		float minLifetime = 1, maxLifetime = 1;	// seconds
+		float gravityX = 0, gravityY = 0;
+		float drag = 0;			// fraction of the velocity lost per second
+		// interpolated over the lifetime
+		float startSize = 8, endSize = 8;
+		PackedColor startColor = { 255, 255, 255, 255 };
+		PackedColor endColor = { 255, 255, 255, 0 };
+	};
+
+	// particles live in device local storage buffers and never come back to the cpu. each frame a
+	// compute pass ages the live ones and compacts the survivors into the other buffer, new ones
+	// are appended behind them, and the count it ends with feeds an indirect dispatch and draw.
+	// the recorded commands are the same for any particle count. draw it with Renderer::DrawParticles
+	class ParticleSystem final {
+	public:
+		friend class Renderer;
+
+		ParticleSystem(Texture& texture, uint32_t capacity, int maxFlightCount = 2);
+		~ParticleSystem();
+
+		void SetEmitter(const ParticleEmitter& emitter) { emitter_ = emitter; }
+		const ParticleEmitter& GetEmitter() const { return emitter_; }
+		void SetTexture(Texture& texture) { texture_ = &texture; }
+		void SetBlend(BlendMode blend) { blend_ = blend; }
+
+		// advances the simulation time, it runs in the next DrawParticles
+		void Update(float dt);
+		// emits count particles at once besides the rate
+		void Burst(uint32_t count) { burst_ += count; }
+
+		// live particles maxFlightCount frames ago, read back without stalling
+		uint32_t GetAliveCount() const { return aliveCount_; }
+		uint32_t GetCapacity() const { return capacity_; }
+
+	private:
+		// std430 layout of Particle in shader/particles.comp and shader/particles.vert
+		struct Particle {
+			float x, y;
+			float vx, vy;
+			float age;
+			float lifetime;
+			float rotation;
+			float spin;
+		};
+		static_assert(sizeof(Particle) == 32, "Particle must match the std430 layout");
+
+		// matches the push constants of shader/particles.vert
+		struct DrawParams {
+			PackedColor startColor;
+			PackedColor endColor;
+			float startSize;
+			float endSize;
+			float depth;
+		};
+
+		// matches State in shader/particles.comp, the indirect commands are read from it directly
+		struct State {
+			uint32_t alive[2];	// particles in each of the two buffers
+			vk::DispatchIndirectCommand simulate;	// over the live particles of the next source
+			vk::DrawIndexedIndirectCommand draw;	// one instance per live particle of the last target
+		};
+		static_assert(sizeof(State) == 40, "State must match the std430 layout");
+
+		enum Stage : uint32_t {
+			SimulateStage = 0,
+			EmitStage = 1,
+			FinishStage = 2,
+		};
+
+		Texture* texture_;
+		uint32_t capacity_;
+		int maxFlightCount_;
+		ParticleEmitter emitter_;
+		BlendMode blend_ = BlendMode::Additive;
+
+		float dt_ = 0;
+		float emitCarry_ = 0;	// fraction of a particle the rate left over
+		uint32_t burst_ = 0;
+		uint32_t seed_ = 0;
+		uint32_t source_ = 0;	// buffer holding the live particles
+		uint32_t aliveCount_ = 0;
+		uint64_t frame_ = 0;
+
+		std::unique_ptr<Buffer> particles_[2];
+		std::unique_ptr<Buffer> state_;
+		std::vector<std::unique_ptr<Buffer>> readbacks_;	// alive count per frame slot
+		std::vector<bool> readbackValid_;
+
+		vk::DescriptorPool descriptorPool_;
+		vk::DescriptorSetLayout computeSetLayout_;
+		vk::DescriptorSetLayout drawSetLayout_;
+		vk::DescriptorSet computeSets_[2];	// indexed by the source buffer
+		vk::DescriptorSet drawSets_[2];		// indexed by the buffer drawn from
+		vk::PipelineLayout computeLayout_;
+		vk::Pipeline computePipeline_;
+		vk::ShaderModule computeModule_;
+		vk::PipelineLayout pipelineLayout_;
+		vk::ShaderModule vertModule_;
+		VertexInput input_;
+
+		void createBuffers();
+		void createDescriptors();
+		void createPipelines();
+
+		// called by Renderer: records this frame's passes ahead of the render pass, once per frame
+		void simulate(vk::CommandBuffer cmd, int flightIndex, uint64_t frame);
+		vk::Pipeline pipeline();
+		// binds everything but the pipeline and draws the live particles
+		void draw(vk::CommandBuffer cmd, vk::DescriptorSet globalSet, float depth);
+	};
+
+}
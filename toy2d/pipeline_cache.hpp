@@ -0,0 +1,116 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace toy2d {
+
+	struct VertexInput {
+		std::vector<vk::VertexInputBindingDescription> bindings;
+		std::vector<vk::VertexInputAttributeDescription> attributes;
+	};
+
+	// colors are premultiplied everywhere, the factors assume it
+	enum class BlendMode : uint8_t {
+		Premultiplied = 0,	// src + dst * (1 - srcA)
+		Additive = 1,		// src + dst
+		Multiply = 2,		// src * dst + dst * (1 - srcA)
+		Opaque = 3,			// src, no blending
+	};
+
+	// greater depth is in front, see Renderer
+	enum class DepthMode : uint8_t {
+		None = 0,
+		Test = 1,		// translucent, tested against what opaque draws wrote
+		TestWrite = 2,	// opaque
+	};
+
+	// everything a graphics pipeline is built from besides the render pass state
+	struct PipelineKey {
+		vk::PipelineLayout layout;
+		vk::ShaderModule vertex;
+		vk::ShaderModule fragment;
+		const VertexInput* input = nullptr;	// compared by address, must outlive the cache
+		BlendMode blend = BlendMode::Premultiplied;
+		vk::PrimitiveTopology topology = vk::PrimitiveTopology::eTriangleList;
+		DepthMode depth = DepthMode::None;
+		// null for RenderProcess::renderPass, offscreen passes name their own
+		vk::RenderPass renderPass;
+		// uint constants with constant_id 0..count-1, given to both stages
+		uint32_t specializationCount = 0;
+		std::array<uint32_t, 4> specialization = {};
+
+		bool operator==(const PipelineKey& o) const;
+	};
+
+	// pipelines created on first use and looked up by their state, open addressing with
+	// linear probing so a lookup is a hash and usually one compare. TryGet hands creation to a
+	// worker thread instead, the table itself is only touched by the thread calling Get/TryGet
+	class PipelineCache final {
+	public:
+		PipelineCache() = default;
+		~PipelineCache();
+		PipelineCache(const PipelineCache&) = delete;
+		PipelineCache& operator=(const PipelineCache&) = delete;
+
+		// creates the pipeline right away if needed, even when it is queued on the worker or its
+		// background compile failed. throws when creating fails
+		vk::Pipeline Get(const PipelineKey& key);
+		// never blocks: null until the worker has compiled it, the first call queues it. a failed
+		// compile is reported once on stderr and stays null, it is not queued again until Clear
+		vk::Pipeline TryGet(const PipelineKey& key);
+		// destroys every pipeline, e.g. when the swapchain extent they bake in changed.
+		// drops the queued jobs and waits for the one being compiled
+		void Clear();
+		size_t Size() const { return count_; }
+
+	private:
+		struct Slot {
+			PipelineKey key;
+			vk::Pipeline pipeline;	// null for an empty or pending slot
+			uint64_t hash = 0;
+			bool pending = false;	// queued on the worker
+			bool failed = false;	// the worker could not create it
+
+			bool occupied() const { return pipeline || pending || failed; }
+		};
+		struct Job {
+			PipelineKey key;
+			uint64_t hash;
+			vk::Pipeline pipeline;
+			std::string error;	// empty when created
+		};
+
+		std::vector<Slot> slots_;
+		size_t count_ = 0;	// pending slots included
+
+		std::thread worker_;	// started by the first TryGet
+		std::mutex mutex_;
+		// guarded by mutex_
+		std::condition_variable wake_;
+		std::condition_variable idle_;
+		std::deque<Job> queue_;
+		std::vector<Job> done_;
+		bool busy_ = false;
+		bool stop_ = false;
+		std::atomic<bool> hasDone_{ false };
+
+		static uint64_t hashKey(const PipelineKey& key);
+		// slot holding key, or the empty slot where it belongs
+		size_t find(const PipelineKey& key, uint64_t hash) const;
+		void grow();
+		// moves finished jobs into their slots
+		void collect();
+		void workerLoop();
+		static vk::Pipeline create(const PipelineKey& key);
+	};
+
+}
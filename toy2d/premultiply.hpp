@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace toy2d {
+
+	// how straight alpha RGBA8 pixels are converted to premultiplied alpha
+	enum class PremultiplyMode {
+		// decode sRGB -> linear, multiply, encode back. matches eR8G8B8A8Srgb sampling
+		Srgb,
+		// multiply the stored bytes directly, cheaper but darkens soft edges slightly
+		Fast,
+	};
+
+	// premultiply `pixelCount` RGBA8 pixels from src into dst (dst may equal src).
+	// picks AVX2/SSE2 at runtime when available, falls back to scalar code
+	void PremultiplyAlpha(const std::uint8_t* src, std::uint8_t* dst, size_t pixelCount, PremultiplyMode mode);
+
+}
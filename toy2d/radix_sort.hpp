@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace toy2d {
+
+	struct SortItem {
+		uint64_t key;
+		uint32_t index;
+	};
+
+	// stable LSD radix sort on the 64bit key, 8 bits per pass. digits that are the same
+	// in every key are skipped, big inputs build histograms and scatter on several threads.
+	// scratch is resized as needed and can be kept between calls
+	void RadixSort(std::vector<SortItem>& items, std::vector<SortItem>& scratch);
+
+}
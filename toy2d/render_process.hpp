@@ -1,27 +1,53 @@
 #pragma once
 
 #include "vulkan/vulkan.hpp"
+#include "toy2d/pipeline_cache.hpp"
 #include <memory>
 
 namespace toy2d {
+
 	class RenderProcess final {
 	public:
-		vk::Pipeline graphicsPipeline;
+		vk::Pipeline graphicsPipeline;	// the premultiplied sprite pipeline, owned by pipelines
 		vk::PipelineLayout layout;
 		vk::RenderPass renderPass;
 		vk::DescriptorSetLayout setLayout;
+		// eUndefined without Context::useDepthBuffer
+		vk::Format depthFormat = vk::Format::eUndefined;
+		bool HasDepth() const { return depthFormat != vk::Format::eUndefined; }
 
 		void recreateGraphicsPipeline();
 		void recreateRenderPass();
 
+		// same fixed state as the sprite pipeline, for passes that bring their own layout and shaders
+		vk::Pipeline CreateGraphicsPipeline(vk::PipelineLayout layout, const std::vector<vk::PipelineShaderStageCreateInfo>& stages, const VertexInput& input,
+			BlendMode blend = BlendMode::Premultiplied, vk::PrimitiveTopology topology = vk::PrimitiveTopology::eTriangleList,
+			DepthMode depth = DepthMode::None, vk::RenderPass pass = nullptr);
+		// quad vertices plus one Instance per sprite
+		static VertexInput GetSpriteVertexInput();
+		const VertexInput& GetSpriteInput() const { return spriteInput_; }
+
+		// the sprite shaders with the given blending, created on first use. with a depth buffer
+		// opaque sprites write depth and the others only test it
+		vk::Pipeline GetSpritePipeline(BlendMode blend);
+		// same without blocking, null while the variant compiles in the background
+		vk::Pipeline TryGetSpritePipeline(BlendMode blend);
+		PipelineCache pipelines;
+
 
 		RenderProcess();
 		~RenderProcess();
 
 	private:
+		VertexInput spriteInput_;
+		// driver side cache shared by every pipeline creation, the background ones included
+		vk::PipelineCache driverCache_;
+
 		vk::Pipeline createGraphicsPipeline();
+		PipelineKey spriteKey(BlendMode blend);
 		vk::PipelineLayout createLayout();
 		vk::RenderPass createRenderPass();
+		vk::Format pickDepthFormat();
 		vk::DescriptorSetLayout createSetLayout();
 
 	};
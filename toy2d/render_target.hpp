@@ -0,0 +1,112 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+#include <memory>
+#include <vector>
+
+namespace toy2d {
+
+	bool IsDepthFormat(vk::Format format);
+
+	struct RenderTargetDesc {
+		vk::Extent2D extent;
+		vk::Format format;
+		// eTransientAttachment asks for lazily allocated memory, such a target only lives inside
+		// the pass that clears it. eSampled targets can be bound like a Texture once written
+		vk::ImageUsageFlags usage;
+
+		bool operator==(const RenderTargetDesc& o) const {
+			return extent == o.extent && format == o.format && usage == o.usage;
+		}
+	};
+
+	// an offscreen image handed out by RenderTargetPool
+	class RenderTarget final {
+	public:
+		friend class RenderTargetPool;
+		~RenderTarget();
+
+		const RenderTargetDesc& GetDesc() const { return desc_; }
+		vk::Image GetImage() const { return image_; }
+		vk::ImageView GetView() const { return view_; }
+		bool IsDepth() const;
+		// the memory is only backed on demand, on tiled gpus the contents never leave tile memory
+		bool IsLazilyAllocated() const { return lazy_; }
+		// binds a sampled color target as the set layout's binding 0 at setIndex, like Texture::Bind.
+		// without push descriptors the set only lives for the frame being recorded
+		void Bind(vk::CommandBuffer cmd, vk::PipelineLayout layout, uint32_t setIndex = 1) const;
+
+	private:
+		explicit RenderTarget(const RenderTargetDesc& desc);
+
+		struct Framebuffer {
+			vk::RenderPass renderPass;
+			vk::ImageView depth;	// null for none
+			vk::Framebuffer framebuffer;
+		};
+
+		RenderTargetDesc desc_;
+		vk::Image image_;
+		vk::DeviceMemory memory_;
+		vk::ImageView view_;
+		vk::DeviceSize memorySize_ = 0;
+		bool lazy_ = false;
+		bool inUse_ = false;
+		uint64_t lastUsedFrame_ = 0;
+		// of passes this target was the color attachment of
+		std::vector<Framebuffer> framebuffers_;
+	};
+
+	// offscreen targets recycled by extent, format and usage. a released target is handed out
+	// again once the frames in flight that used it are done, targets idle for a while are freed
+	class RenderTargetPool final {
+	public:
+		RenderTargetPool(int maxFlightCount);
+		~RenderTargetPool();
+
+		// a free target matching desc, created if there is none. it stays the caller's until Release
+		RenderTarget* Acquire(const RenderTargetDesc& desc);
+		void Release(RenderTarget* target);
+		// marks the target as used by the current frame, Renderer::DrawToTarget does it
+		void Touch(RenderTarget& target);
+
+		// color is cleared and stored for sampling, depth is cleared and never stored. pipelines for
+		// the pass are created with it, their viewport and scissor are dynamic
+		vk::RenderPass GetRenderPass(vk::Format color, vk::Format depth = vk::Format::eUndefined);
+		// created on first use and kept with the color target. pass is the one to begin it with,
+		// compatible with GetRenderPass but not storing color nobody samples
+		vk::Framebuffer GetFramebuffer(RenderTarget& color, RenderTarget* depth, vk::RenderPass& pass);
+
+		struct Stats {
+			uint32_t targets = 0;
+			uint32_t inUse = 0;
+			uint32_t lazilyAllocated = 0;
+			uint64_t created = 0;		// since the pool was made, stays flat while recycling works
+			vk::DeviceSize memory = 0;	// lazily allocated targets count their full size
+		};
+		const Stats& GetStats() const { return stats_; }
+
+		// called by Renderer once the fence of the frame slot was waited
+		void BeginFrame(uint64_t frame);
+
+	private:
+		static constexpr uint64_t MaxIdleFrames = 120;
+
+		struct Pass {
+			vk::Format color;
+			vk::Format depth;
+			bool storeColor;
+			vk::RenderPass renderPass;
+		};
+
+		int maxFlightCount_;
+		uint64_t frame_ = 0;
+		std::vector<std::unique_ptr<RenderTarget>> targets_;
+		std::vector<Pass> passes_;
+		Stats stats_;
+
+		vk::RenderPass renderPass(vk::Format color, vk::Format depth, bool storeColor);
+		void destroy(size_t index);
+	};
+
+}
@@ -6,7 +6,21 @@
 #include "toy2d/tool.hpp"
 #include "toy2d/CommandManager.hpp"
 #include "toy2d/texture.hpp"
+#include "toy2d/virtual_texture.hpp"
+#include "toy2d/scene.hpp"
+#include "toy2d/radix_sort.hpp"
+#include "toy2d/cull.hpp"
+#include "toy2d/transform2d.hpp"
+#include "toy2d/pipeline_cache.hpp"
+#include "toy2d/overdraw.hpp"
+#include "toy2d/font.hpp"
+#include "toy2d/particles.hpp"
+#include "toy2d/tilemap.hpp"
+#include "toy2d/render_target.hpp"
+#include "toy2d/frame_graph.hpp"
 #include "glm/glm.hpp"
+#include <functional>
+#include <array>
 
 namespace toy2d {
 	class Renderer final {
@@ -17,19 +31,83 @@ namespace toy2d {
 
 		void SetProject(int right, int left, int bottom, int top, int far, int near);
 		void SetDrawColor(const Color& color);
+		// accuracy of the sin/cos used for sprite rotations, Precise by default
+		void SetSinCosMode(SinCosMode mode) { sinCosMode_ = mode; }
 
-		void DrawTexture(int x, int y, float rot, Texture& texture);
+		// draws are buffered until EndRender, sprites outside the projection are culled there.
+		// the rest are sorted by layer first, higher layers on top.
+		// inside a layer draws are grouped by state, draws with the same state keep their order
+		void DrawTexture(int x, int y, float rot, Texture& texture, uint8_t layer = 0, PackedColor tint = { 255, 255, 255, 255 },
+			BlendMode blend = BlendMode::Premultiplied);
+		// streams the pages visible under the current projection and draws the image
+		void DrawVirtualTexture(VirtualTexture& texture, uint8_t layer = 0);
+		// uploads the scene's changed sprites and draws the ones under the current projection
+		void DrawScene(Scene& scene);
+		// lays the utf8 text out from the baseline at x, y, size is the em height in world units and
+		// newlines start a new line. the glyphs of every label of a font end up in one instanced draw
+		void DrawText(Font& font, std::string_view text, float x, float y, float size,
+			PackedColor color = { 255, 255, 255, 255 }, uint8_t layer = 0);
+		// runs the system's simulation on the gpu ahead of the render pass and draws all its
+		// particles with one indirect draw, the system is not culled
+		void DrawParticles(ParticleSystem& particles, uint8_t layer = 0);
+		// uploads the map's changed chunks and draws the ones under the current projection,
+		// binding the tileset once
+		void DrawTilemap(Tilemap& map, uint8_t layer = 0);
+		// immediate mode shapes for overlays, shaded from their signed distance so circles need no
+		// tessellation. consecutive calls on a layer share one instanced draw. width 0 draws a one
+		// pixel hairline, outlines are centered on the edge and 0 fills the shape
+		void DrawLine(float x0, float y0, float x1, float y1, PackedColor color, float width = 0, uint8_t layer = 0);
+		void DrawRect(float x, float y, float w, float h, PackedColor color, float outline = 0, uint8_t layer = 0);
+		void DrawCircle(float x, float y, float radius, PackedColor color, float outline = 0, uint8_t layer = 0);
+		// records a pass into color, and depth if not null, right away, ahead of the frame's render
+		// pass. draw binds its own pipelines, made for GetRenderTargets().GetRenderPass, and may
+		// assume viewport and scissor cover the target. the target can be bound in the same frame
+		void DrawToTarget(RenderTarget& color, RenderTarget* depth, const std::array<float, 4>& clear,
+			std::function<void(vk::CommandBuffer)> draw);
+		RenderTargetPool& GetRenderTargets() { return *renderTargets_; }
+		// declared fresh every frame after StartRender, recorded in EndRender after the DrawToTarget
+		// passes and ahead of the frame's render pass
+		FrameGraph& GetFrameGraph() { return *frameGraph_; }
 		void StartRender();
 		void EndRender();
 
+		// the sprites of a static layer are recorded once into secondary command buffers and
+		// replayed with executeCommands. while the cache is valid DrawTexture calls for the layer
+		// are dropped, virtual textures and scene sprites stay live. static sprites are not culled
+		void SetLayerStatic(uint8_t layer, bool isStatic);
+		// rebuilds the layer from the DrawTexture calls of the current frame, call it before them.
+		// needed too before destroying a texture the layer draws
+		void InvalidateLayer(uint8_t layer);
+
+		struct FrameStats {
+			uint32_t draws = 0;				// draws left after culling
+			uint32_t culled = 0;
+			uint32_t batches = 0;				// draw calls recorded
+			uint32_t stateChanges = 0;			// pipeline and texture binds after sorting
+			uint32_t stateChangesAvoided = 0;	// binds submission order would have needed on top
+			uint32_t cachedLayers = 0;			// static layers replayed without recording
+			uint32_t pipelineFallbacks = 0;		// sprite runs drawn with a stand-in or skipped while their pipeline compiles
+		};
+		// stats of the last EndRender
+		const FrameStats& GetFrameStats() const { return stats_; }
+
+		// diagnostic, every frame is drawn a second time into an offscreen heat target counting the
+		// fragments per pixel, and the fragment shader invocations of the render pass are queried.
+		// virtual textures and other custom draws are left out of the heat target
+		void SetOverdrawMode(bool enable);
+		// refreshed every frame, the numbers are maxFlightCount frames old
+		const OverdrawStats& GetOverdrawStats() const { return overdrawStats_; }
+
 
 	private:
 		int maxFlightCount;
 		int curFrame;
+		uint64_t frameCounter;	// total frames started, drives texture residency
 		uint32_t imageIndex;
 
 		glm::mat4x4 projectMat;
 		glm::mat4x4 viewMat;
+		Rect viewRect;	// world area covered by the projection
 
 
 		std::vector<vk::CommandBuffer> cmdBuffers;
@@ -50,9 +128,125 @@ namespace toy2d {
 
 		std::vector<DescriptorSetManager::SetInfo> descriptorManagers;
 
+		struct SpriteDraw {
+			Texture* texture;
+			uint64_t key;
+			PackedColor tint;
+		};
+		struct SceneDraw {
+			Scene* scene;
+			uint32_t slot;
+			Texture* texture;
+		};
+		// a layer/texture group of a gpu culled scene, drawn indirectly
+		struct SceneGroupDraw {
+			Scene* scene;
+			uint32_t group;
+			Texture* texture;
+		};
+		// one DrawText call, its glyphs are glyphs_[firstGlyph, firstGlyph + glyphCount)
+		struct TextDraw {
+			Font* font;
+			uint32_t firstGlyph;
+			uint32_t glyphCount;
+		};
+		// one DrawTilemap call, its chunks are visibleChunks_[firstChunk, firstChunk + chunkCount)
+		struct TilemapDraw {
+			Tilemap* map;
+			uint32_t firstChunk;
+			uint32_t chunkCount;
+		};
+		// consecutive primitive calls of a layer, primitives_[first, first + count)
+		struct PrimitiveRun {
+			uint32_t first;
+			uint32_t count;
+		};
+		using CustomDrawFunc = std::function<void(vk::CommandBuffer)>;
+
+		// this frame's draws, SortItem::index points into sprites_, sceneDraws_, sceneGroups_, textDraws_,
+		// particleDraws_, tilemapDraws_, primitiveRuns_ or customDraws_
+		std::vector<SortItem> drawItems_;
+		// opaque sprites drawn front to back ahead of drawItems_ when there is a depth buffer
+		std::vector<SortItem> opaqueItems_;
+		std::array<uint32_t, 256> layerOrder_ = {};
+		std::vector<SortItem> sortScratch_;
+		std::vector<SpriteDraw> sprites_;
+		// parallel to sprites_, transforms are turned into affines in one batch at EndRender
+		TransformList spriteTransforms_;
+		std::vector<Affine2D> spriteAffines_;
+		BoundsList spriteBounds_;
+		SinCosMode sinCosMode_ = SinCosMode::Precise;
+		std::vector<uint32_t> visibleSprites_;
+		std::vector<SceneDraw> sceneDraws_;
+		std::vector<SceneGroupDraw> sceneGroups_;
+		uint32_t sceneCulled_ = 0;
+		std::vector<CustomDrawFunc> customDraws_;
+		std::vector<TextDraw> textDraws_;
+		std::vector<GlyphInstance> glyphs_;
+		std::vector<Font*> frameFonts_;	// fonts drawn this frame, their uploads go out in EndRender
+		std::vector<Scene*> frameScenes_;	// same for scenes
+		uint32_t textCulled_ = 0;
+		std::vector<ParticleSystem*> particleDraws_;
+		std::vector<TilemapDraw> tilemapDraws_;
+		std::vector<uint32_t> visibleChunks_;
+		std::vector<PrimitiveInstance> primitives_;
+		std::vector<PrimitiveRun> primitiveRuns_;
+		uint64_t primitiveRunKey_ = 0;	// of primitiveRuns_.back()
+		// per frame instance data, grown on demand
+		std::vector<std::unique_ptr<Buffer>> instanceBuffers_;
+		std::vector<std::unique_ptr<Buffer>> sceneSlotBuffers_;
+		std::vector<std::unique_ptr<Buffer>> glyphBuffers_;
+		std::vector<std::unique_ptr<Buffer>> primitiveBuffers_;
+		uint32_t frameInstanceCount_ = 0;
+		uint32_t sceneSlotCount_ = 0;
+		FrameStats stats_;
+		std::unique_ptr<OverdrawMeter> overdraw_;
+		std::unique_ptr<RenderTargetPool> renderTargets_;
+		std::unique_ptr<FrameGraph> frameGraph_;
+		OverdrawStats overdrawStats_;
+
+		struct CachedBatch {
+			Texture* texture;
+			BlendMode blend;
+			uint32_t firstInstance;
+			uint32_t instanceCount;
+		};
+		struct LayerCache {
+			bool isStatic = false;
+			bool valid = false;
+			// one per frame slot, each binds the uniform set of its slot
+			std::vector<vk::CommandBuffer> cmds;
+			std::unique_ptr<Buffer> instances;
+			std::vector<CachedBatch> batches;
+			// what cmds were recorded against, a change means re-recording
+			vk::Pipeline pipeline;
+			vk::RenderPass renderPass;
+			uint64_t recordedFrame = 0;
+			bool provisional = false;	// some batches drawn with a stand-in pipeline
+
+		};
+		// command buffers replaced while frames in flight may still execute them
+		struct RetiredCache {
+			std::vector<vk::CommandBuffer> cmds;
+			std::unique_ptr<Buffer> instances;
+			uint64_t frame;
+		};
+		std::array<LayerCache, 256> layerCaches_;
+		uint32_t staticLayerCount_ = 0;
+		std::vector<RetiredCache> retiredCaches_;
+		// secondaries for the live draws between static layers, reused per frame slot
+		std::vector<std::vector<vk::CommandBuffer>> liveSecondaries_;
+		uint32_t liveSecondaryCount_ = 0;
+		std::vector<vk::CommandBuffer> executes_;
+
 		std::unique_ptr<Texture> texture;
 		vk::Sampler sampler;
 
+		// created by the first primitive draw
+		vk::ShaderModule primitiveVert_;
+		vk::ShaderModule primitiveFrag_;
+		VertexInput primitiveInput_;
+
 		void createSemaphores();
 		void createFences();
 		void createCmdBuffers();
@@ -61,6 +255,25 @@ namespace toy2d {
 		void createIndicesBuffer();
 		void bufferIndicesData();
 		void createUniformBuffers();
+		void reserveFrameBuffer(std::unique_ptr<Buffer>& buffer, size_t size);
+		// the frame's pass on the swapchain image, a render pass or dynamic rendering
+		void beginMainPass(vk::CommandBuffer cmd, bool secondaries);
+		void endMainPass(vk::CommandBuffer cmd);
+		// the main pipelines have a dynamic viewport with dynamic rendering
+		void setMainViewport(vk::CommandBuffer cmd);
+		void recordDraws(vk::CommandBuffer cmd, const SortItem* items, size_t count);
+		void recordLayers(vk::CommandBuffer cmd);
+		void recordLive(const SortItem* items, size_t count);
+		void recordOverdraw(vk::CommandBuffer cmd);
+		void addPrimitive(PrimitiveInstance primitive, uint8_t layer);
+		vk::Pipeline primitivePipeline();
+		// world units per pixel under the current projection
+		void pushPixelSize(vk::CommandBuffer cmd, vk::PipelineLayout layout);
+		void buildLayerCache(LayerCache& cache, const SortItem* items, size_t count);
+		void recordLayerCache(LayerCache& cache);
+		void beginSecondary(vk::CommandBuffer cmd, vk::CommandBufferUsageFlags flags);
+		void retireLayerCache(LayerCache& cache, bool keepInstances);
+		void freeRetiredCaches();
 
 
 		void createDescriptorPool();
@@ -0,0 +1,186 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+#include "toy2d/buffer.hpp"
+#include "toy2d/texture.hpp"
+#include "toy2d/spatial_grid.hpp"
+#include "toy2d/pipeline_cache.hpp"
+#include "glm/glm.hpp"
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+namespace toy2d {
+
+	// retained sprites with parent/child transforms. setters only mark nodes dirty, the world
+	// transforms of dirty subtrees are recomputed once per frame and only the sprite records that
+	// changed are copied to the gpu. draw it with Renderer::DrawScene
+	class Scene final {
+	public:
+		friend class Renderer;
+
+		using NodeId = uint32_t;
+		static constexpr NodeId InvalidNode = ~0u;
+
+		Scene(int maxFlightCount = 2, float cellSize = 512.0f);
+		~Scene();
+
+		// a node without an image, used to move its children together
+		NodeId CreateNode(NodeId parent = InvalidNode);
+		// w, h is the size of the image in the node's local space
+		NodeId CreateSprite(Texture& texture, float w, float h, NodeId parent = InvalidNode, uint8_t layer = 0);
+		// destroys the node together with all its children
+		void Destroy(NodeId);
+
+		void SetPosition(NodeId, float x, float y);
+		void SetRotation(NodeId, float degrees);
+		void SetScale(NodeId, float sx, float sy);
+		void SetParent(NodeId node, NodeId parent);
+		void SetTexture(NodeId, Texture& texture);
+		void SetLayer(NodeId, uint8_t layer);
+		void SetTint(NodeId, PackedColor tint);
+
+		// culls the records with a compute pass instead of the spatial grid and draws every
+		// layer/texture group with one indirect draw, the cpu cost no longer grows with the
+		// sprite count. culled sprites are not counted in Renderer::FrameStats then
+		void SetGpuCulling(bool enable) { gpuCulling_ = enable; }
+		bool GetGpuCulling() const { return gpuCulling_; }
+
+		struct Stats {
+			uint32_t nodes = 0;
+			uint32_t sprites = 0;
+			uint32_t transformsUpdated = 0;	// world transforms recomputed last frame
+			uint32_t recordsUploaded = 0;	// sprite records copied last frame
+		};
+		const Stats& GetStats() const { return stats_; }
+
+	private:
+		struct Node {
+			NodeId parent = InvalidNode;
+			NodeId firstChild = InvalidNode;
+			NodeId prevSibling = InvalidNode;
+			NodeId nextSibling = InvalidNode;
+
+			glm::vec2 position = { 0, 0 };
+			float rotation = 0;	// radians
+			glm::vec2 scale = { 1, 1 };
+			glm::mat4x4 world = glm::mat4x4(1.0f);
+
+			uint32_t slot = NoSlot;	// sprite record, NoSlot for plain nodes
+			bool alive = false;
+			bool dirty = false;
+		};
+
+		struct Sprite {
+			NodeId node;
+			Texture* texture;
+			glm::vec2 size;
+			uint8_t layer;
+			PackedColor tint;
+			uint32_t group;
+		};
+
+		// one sprite on the gpu, std430 layout of Record in shader/scene.vert
+		struct Record {
+			float a, b, c, d;	// 2x3 affine, column major
+			float tx, ty;
+			PackedColor tint;
+			uint32_t group;	// NoGroup for free slots
+		};
+		static_assert(sizeof(Record) == 32, "Record must match the std430 layout");
+
+		// a record buffer replaced by a bigger one, kept until the frames using it are done
+		struct Retired {
+			std::unique_ptr<Buffer> buffer;
+			vk::DescriptorSet set;
+			uint64_t frame;
+		};
+
+		// sprites sharing layer and texture, drawn by one indirect draw with gpu culling
+		struct Group {
+			Texture* texture;
+			uint8_t layer;
+			uint32_t count;
+		};
+
+		// per frame slot output of the cull pass
+		struct CullFrame {
+			std::unique_ptr<Buffer> commands;	// one VkDrawIndexedIndirectCommand per group
+			std::unique_ptr<Buffer> visible;	// slots of the visible sprites, grouped
+			vk::DescriptorSet set;
+			vk::Buffer records;	// record buffer the set points at
+			uint64_t frame = 0;
+		};
+
+		static constexpr uint32_t NoSlot = ~0u;
+		static constexpr uint32_t NoGroup = ~0u;
+
+		int maxFlightCount_;
+		std::vector<Node> nodes_;
+		std::vector<NodeId> freeNodes_;
+		std::vector<NodeId> dirtyNodes_;
+
+		// sprite data indexed by slot, records_ is the cpu copy of the gpu buffer
+		std::vector<Sprite> sprites_;
+		std::vector<Record> records_;
+		std::vector<uint32_t> freeSlots_;
+		std::vector<uint32_t> dirtySlots_;
+		std::vector<bool> slotDirty_;
+		SpatialGrid grid_;
+
+		uint32_t capacity_ = 0;
+		std::unique_ptr<Buffer> recordBuffer_;
+		std::vector<std::unique_ptr<Buffer>> stagingBuffers_;
+		std::vector<vk::CommandBuffer> uploadCmds_;
+		std::vector<Retired> retired_;
+		uint64_t frame_ = 0;	// last frame update ran in
+		int flightIndex_ = 0;
+		std::vector<NodeId> stack_;
+		Stats stats_;
+
+		std::vector<Group> groups_;
+		std::vector<uint32_t> freeGroups_;
+		std::unordered_map<uint64_t, uint32_t> groupIndex_;
+		bool gpuCulling_ = false;
+		std::vector<CullFrame> cullFrames_;
+
+		vk::DescriptorSetLayout setLayout_;
+		vk::DescriptorPool descriptorPool_;
+		vk::DescriptorSet set_;
+		vk::PipelineLayout pipelineLayout_;
+		vk::Pipeline pipeline_;
+		vk::ShaderModule vertModule_;
+		VertexInput input_;	// kept for pipelines built later from vertModule_
+
+		vk::DescriptorSetLayout cullSetLayout_;
+		vk::PipelineLayout cullLayout_;
+		vk::Pipeline cullPipeline_;
+		vk::ShaderModule cullModule_;
+
+		void createDescriptors();
+		void createPipeline();
+		vk::DescriptorSet allocateSet(vk::Buffer buffer);
+		void createCullPipeline();
+		void writeCullSet(CullFrame& frame);
+
+		NodeId allocNode(NodeId parent);
+		Node& node(NodeId id);
+		void link(NodeId id, NodeId parent);
+		void unlink(NodeId id);
+		void markDirty(NodeId id);
+		void markSlotDirty(uint32_t slot);
+		void updateSubtree(NodeId root);
+		void growRecords(uint64_t frame);
+		uint32_t acquireGroup(Texture* texture, uint8_t layer);
+		void releaseGroup(uint32_t group);
+		void moveToGroup(uint32_t slot);
+
+		// recomputes dirty transforms, runs for every DrawScene so later changes are drawn too
+		void update(int flightIndex, uint64_t frame);
+		// called by Renderer once per frame in EndRender, uploads the changed records ahead of the frame
+		void flush();
+		// fills this frame's indirect commands on the gpu, recorded before the render pass
+		void cull(vk::CommandBuffer cmd, int flightIndex, uint64_t frame, const Rect& view);
+	};
+
+}
@@ -9,6 +9,8 @@ namespace toy2d {
 		static void Init(const std::string& vertexSource, const std::string& fragSource);
 		static void Quit();
 		static Shader& GetInstance();
+		// wraps SPIR-V code (e.g. from ReadWholeFile) into a module, the caller destroys it
+		static vk::ShaderModule CreateModule(const std::string& code);
 		Shader(const std::string& vertexSource, const std::string& fragSource);
 		~Shader();
 
@@ -18,11 +20,21 @@ namespace toy2d {
 		std::vector<vk::PipelineShaderStageCreateInfo> GetStage();
 		vk::PushConstantRange GetPushConstantRange() const;
 		const std::vector<vk::DescriptorSetLayout>& GetDescriptorSetLayouts() const { return layouts; }
+
+		// one entry per binding of a set layout, binding n is read from data[n]
+		union DescriptorData {
+			VkDescriptorBufferInfo buffer;
+			VkDescriptorImageInfo image;
+		};
+		// writes the whole set through the update template of GetDescriptorSetLayouts()[layoutIndex]
+		void UpdateDescriptorSet(vk::DescriptorSet set, uint32_t layoutIndex, const DescriptorData* data) const;
 		
 	private:
 		static std::unique_ptr<Shader> instance_;
 		std::vector<vk::PipelineShaderStageCreateInfo> shaderStageInfo;
 		std::vector<vk::DescriptorSetLayout> layouts;
+		std::vector<vk::DescriptorUpdateTemplate> updateTemplates;
+		void addDescriptorSetLayout(const std::vector<vk::DescriptorSetLayoutBinding>& bindings, vk::DescriptorSetLayoutCreateFlags flags = {});
 		void initDescriptorSetLayouts();
 		void InitStage();
 	};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "toy2d/tool.hpp"
+#include "toy2d/cull.hpp"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace toy2d {
+
+	// uniform grid over an unbounded world. every id is listed in each cell its bounds touch,
+	// so queries only look at the cells under the view. ids are small dense numbers chosen by the caller
+	class SpatialGrid final {
+	public:
+		explicit SpatialGrid(float cellSize = 512.0f);
+
+		void Insert(uint32_t id, const Rect& bounds);
+		// cheap when the bounds stay inside the same cells
+		void Update(uint32_t id, const Rect& bounds);
+		void Remove(uint32_t id);
+		void Clear();
+
+		bool Contains(uint32_t id) const { return id < items_.size() && items_[id].alive; }
+		const Rect& GetBounds(uint32_t id) const { return items_[id].bounds; }
+		size_t Size() const { return size_; }
+
+		// appends every id whose bounds overlap view, each at most once
+		void Query(const Rect& view, std::vector<uint32_t>& out);
+
+	private:
+		struct CellRange {
+			int32_t x0, y0, x1, y1;
+			bool operator==(const CellRange& o) const { return x0 == o.x0 && y0 == o.y0 && x1 == o.x1 && y1 == o.y1; }
+		};
+		struct Item {
+			Rect bounds;
+			CellRange cells;
+			uint32_t queryStamp = 0;
+			bool alive = false;
+		};
+
+		float cellSize_;
+		float invCellSize_;
+		size_t size_ = 0;
+		std::vector<Item> items_;
+		std::unordered_map<uint64_t, std::vector<uint32_t>> cells_;
+		uint32_t queryStamp_ = 0;
+
+		// reused by Query
+		std::vector<uint32_t> candidates_;
+		std::vector<uint32_t> visible_;
+		BoundsList candidateBounds_;
+
+		CellRange cellRange(const Rect& bounds) const;
+		static uint64_t cellKey(int32_t x, int32_t y) { return (uint64_t(uint32_t(x)) << 32) | uint32_t(y); }
+		void link(uint32_t id, const CellRange& range);
+		void unlink(uint32_t id, const CellRange& range);
+	};
+
+}
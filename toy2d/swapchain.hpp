@@ -24,10 +24,15 @@ namespace toy2d {
 		SwapchainInfo info;
 		std::vector<vk::Image> images;
 		std::vector<vk::ImageView> imageViews;
-		std::vector<vk::Framebuffer> frameBuffers;
+		std::vector<vk::Framebuffer> frameBuffers;	// empty with Context::useDynamicRendering
+		// shared by every framebuffer, only with RenderProcess::HasDepth
+		vk::Image depthImage;
+		vk::DeviceMemory depthMemory;
+		vk::ImageView depthView;
 		void queryInfo(int W, int H);
 		void getImages();
 		void createImageViews();
 		void createFramebuffers(int W, int H);
+		void createDepthImage(int W, int H);
 	};
 }
\ No newline at end of file
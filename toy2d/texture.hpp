@@ -2,7 +2,10 @@
 
 #include "toy2d/buffer.hpp"
 #include "toy2d/descriptor_manager.hpp"
+#include "toy2d/premultiply.hpp"
 #include "vulkan/vulkan.hpp"
+#include <unordered_map>
+#include <list>
 
 namespace toy2d {
 	class TextureManager;
@@ -10,15 +13,30 @@ namespace toy2d {
 	class Texture final {
 	public:
 		friend class TextureManager;
-		Texture(std::string_view filename);
+		// pixels are converted to premultiplied alpha while they are copied into the staging buffer
+		Texture(std::string_view filename, PremultiplyMode mode = PremultiplyMode::Srgb);
 		~Texture();
 
 		vk::Image image;
 		vk::ImageView imageView;
 		vk::DeviceMemory memory;
-		DescriptorSetManager::SetInfo set;
+		DescriptorSetManager::SetInfo set;	// empty with Context::usePushDescriptors
+
+		// binds the image as the set layout's binding 0 at setIndex, pushed inline in push mode
+		void Bind(vk::CommandBuffer cmd, vk::PipelineLayout layout, uint32_t setIndex = 1) const;
+
+		// false after TextureManager evicted the image, the descriptor set is kept
+		bool IsResident() const { return resident_; }
+		vk::DeviceSize GetMemorySize() const { return memorySize_; }
+		uint32_t GetWidth() const { return width_; }
+		uint32_t GetHeight() const { return height_; }
+		// small unique number, packed into the renderer's draw sort key
+		uint32_t GetId() const { return id_; }
 
 	private:
+		void load();
+		void release();
+
 		void createImage(uint32_t w, uint32_t h);
 		void allocMemory();
 		void createImageView();
@@ -28,6 +46,21 @@ namespace toy2d {
 		void transformData2Image(Buffer& buffer, uint32_t w, uint32_t h);
 		void updateDescriptorSet();
 
+		static uint32_t nextId_;
+
+		std::string filename_;
+		PremultiplyMode mode_;
+		uint32_t id_;
+		uint32_t width_ = 0;
+		uint32_t height_ = 0;
+		vk::DeviceSize memorySize_ = 0;
+		bool resident_ = false;
+
+		// key inside TextureManager, lets Destroy find the entry without a search
+		std::string key_;
+		// residency bookkeeping, owned by TextureManager
+		uint64_t lastUsedFrame_ = 0;
+		std::list<Texture*>::iterator lruIt_;
 	};
 
 	class TextureManager final {
@@ -39,14 +72,54 @@ namespace toy2d {
 			return *instance_;
 		}
 
-		Texture* Load(const std::string& filename);
+		// returns the already loaded texture for the same file and adds a reference,
+		// every Load must be paired with one Destroy
+		Texture* Load(const std::string& filename, PremultiplyMode mode = PremultiplyMode::Srgb);
+		// drops one reference, the texture is destroyed with its last reference
 		void Destroy(Texture*);
 		void Clear();
 
+		uint32_t GetRefCount(const Texture*) const;
+		size_t Size() const { return datas.size(); }
+
+		struct ResidencyStats {
+			uint64_t evictions = 0;
+			uint64_t reloads = 0;
+			vk::DeviceSize residentBytes = 0;
+			vk::DeviceSize budget = 0;	// 0 means unlimited
+		};
+
+		// 0 disables the user budget, VK_EXT_memory_budget still applies when available
+		void SetMemoryBudget(vk::DeviceSize bytes);
+		// called by Renderer once the fence of the reused frame slot has signaled
+		void BeginFrame(uint64_t frame, uint32_t framesInFlight);
+		// marks the texture as used this frame and reloads it if it was evicted
+		void Touch(Texture&);
+		const ResidencyStats& GetResidencyStats() const { return stats_; }
+
 	private:
+		struct Entry {
+			std::unique_ptr<Texture> texture;
+			uint32_t refCount;
+		};
+
 		static std::unique_ptr<TextureManager> instance_;
 
-		std::vector<std::unique_ptr<Texture>> datas;
+		std::unordered_map<std::string, Entry> datas;
+
+		// least recently used first
+		std::list<Texture*> lru_;
+		ResidencyStats stats_;
+		vk::DeviceSize userBudget_ = 0;
+		vk::DeviceSize deviceBudget_ = 0;
+		uint64_t frame_ = 0;
+		uint32_t framesInFlight_ = 1;
+
+		static std::string makeKey(const std::string& filename, PremultiplyMode mode);
+		void track(Texture&);
+		void untrack(Texture&);
+		void evictOverBudget();
+		void queryDeviceBudget();
 	};
 
 }
\ No newline at end of file
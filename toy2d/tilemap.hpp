@@ -0,0 +1,105 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+#include "toy2d/buffer.hpp"
+#include "toy2d/texture.hpp"
+#include "toy2d/pipeline_cache.hpp"
+#include "toy2d/tool.hpp"
+#include "toy2d/vertex.hpp"
+#include <memory>
+#include <vector>
+
+namespace toy2d {
+
+	// a grid of tiles cut from one tileset atlas. the map is split into square chunks whose quads
+	// are built once into device local vertex buffers and only rebuilt when one of their tiles
+	// changes, so a frame costs a draw per visible chunk whatever the map size. draw it with
+	// Renderer::DrawTilemap
+	class Tilemap final {
+	public:
+		friend class Renderer;
+
+		static constexpr uint16_t EmptyTile = 0xFFFF;
+
+		// the atlas holds atlasColumns x atlasRows tiles, numbered row by row. chunkSize is in
+		// tiles and at most 128, the quads of a chunk are indexed with 16 bits
+		Tilemap(Texture& tileset, uint32_t atlasColumns, uint32_t atlasRows,
+			uint32_t columns, uint32_t rows, float tileSize, int maxFlightCount = 2, uint32_t chunkSize = 32);
+		~Tilemap();
+
+		void SetTile(uint32_t x, uint32_t y, uint16_t tile);
+		uint16_t GetTile(uint32_t x, uint32_t y) const;
+		// world position of the top left corner of tile 0, 0
+		void SetPosition(float x, float y) { x_ = x; y_ = y; }
+		void SetTint(PackedColor tint) { tint_ = tint; }
+
+		uint32_t GetColumns() const { return columns_; }
+		uint32_t GetRows() const { return rows_; }
+
+		struct Stats {
+			uint32_t chunks = 0;
+			uint32_t chunksRebuilt = 0;	// last frame
+			uint32_t verticesUploaded = 0;	// last frame
+		};
+		const Stats& GetStats() const { return stats_; }
+
+	private:
+		struct Chunk {
+			std::unique_ptr<Buffer> vertices;	// device local, quadCount quads
+			uint32_t quadCount = 0;
+			bool dirty = true;
+		};
+		// a vertex buffer replaced by a bigger one, kept until the frames using it are done
+		struct Retired {
+			std::unique_ptr<Buffer> buffer;
+			uint64_t frame;
+		};
+		// matches the push constants of shader/tilemap.vert
+		struct DrawParams {
+			float x, y;
+			PackedColor tint;
+			float depth;
+		};
+
+		Texture* tileset_;
+		uint32_t atlasColumns_;
+		uint32_t atlasRows_;
+		uint32_t columns_;
+		uint32_t rows_;
+		float tileSize_;
+		int maxFlightCount_;
+		uint32_t chunkSize_;
+		uint32_t chunkColumns_;
+		uint32_t chunkRows_;
+		float x_ = 0, y_ = 0;
+		PackedColor tint_ = { 255, 255, 255, 255 };
+
+		std::vector<uint16_t> tiles_;
+		std::vector<Chunk> chunks_;
+		std::vector<uint32_t> dirtyChunks_;
+		std::vector<Retired> retired_;
+		uint64_t frame_ = 0;	// last frame update ran in
+		Stats stats_;
+
+		// the same quad pattern serves every chunk
+		std::unique_ptr<Buffer> indices_;
+		std::vector<std::unique_ptr<Buffer>> stagingBuffers_;
+		std::vector<vk::CommandBuffer> uploadCmds_;
+
+		vk::ShaderModule vertModule_;
+		VertexInput input_;
+
+		void createIndices();
+		// writes the chunk's quads into dst, returns how many
+		uint32_t buildChunk(uint32_t chunk, Vertex* dst) const;
+
+		// called by Renderer: rebuilds the dirty chunks and submits their uploads ahead of the frame.
+		// runs once per frame, tiles set after the first DrawTilemap of a frame show up in the next
+		void update(int flightIndex, uint64_t frame);
+		// appends the chunks overlapping view that have quads
+		void visibleChunks(const Rect& view, std::vector<uint32_t>& out) const;
+		vk::Pipeline pipeline();
+		void draw(vk::CommandBuffer cmd, vk::PipelineLayout layout, const uint32_t* chunks, size_t count, float depth) const;
+	};
+
+}
@@ -15,6 +15,19 @@ struct Color {
     float r, g, b;
 };
 
+// RGBA8 with straight alpha, read as R8G8B8A8Unorm by the shaders
+struct PackedColor {
+    uint8_t r, g, b, a;
+};
+
+struct Rect {
+    float minX, minY, maxX, maxY;
+
+    bool Intersects(const Rect& o) const {
+        return minX <= o.maxX && o.minX <= maxX && minY <= o.maxY && o.minY <= maxY;
+    }
+};
+
 
 template <typename T, typename U>
 void RemoveNosupportedElems(std::vector<T>& elems, const std::vector<U>& supportedElems,
@@ -34,5 +47,7 @@ void RemoveNosupportedElems(std::vector<T>& elems, const std::vector<U>& support
 }
 
 std::string ReadWholeFile(const std::string& filename);
+// full path of a compiled shader (.spv) inside the shader directory
+std::string GetShaderPath(const std::string& filename);
 
 }
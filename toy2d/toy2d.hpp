@@ -5,9 +5,15 @@
 
 namespace toy2d {
 
-	void Init(const std::vector<const char*>& extensions, CreateSurfaceFunc func, int W, int H);
+	// pushDescriptors binds textures with VK_KHR_push_descriptor when the device has it,
+	// textures then own no descriptor set. depthBuffer draws opaque sprites front to back
+	// into a depth buffer ahead of the translucent ones. dynamicRendering draws the frame with
+	// Vulkan 1.3 dynamic rendering when the device has it, without render pass and framebuffers
+	void Init(const std::vector<const char*>& extensions, CreateSurfaceFunc func, int W, int H, bool pushDescriptors = false, bool depthBuffer = false,
+		bool dynamicRendering = false);
 	void Quit();
-	Texture* LoadTexture(const std::string& filename);
+	// textures are shared per file and reference counted, pair every LoadTexture with DestroyTexture
+	Texture* LoadTexture(const std::string& filename, PremultiplyMode mode = PremultiplyMode::Srgb);
 	void DestroyTexture(Texture*);
 	Renderer* GetRenderer();
 
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace toy2d {
+
+	// 2x3 affine, column major like glm: x' = a * x + c * y + tx, y' = b * x + d * y + ty
+	struct Affine2D {
+		float a, b, c, d, tx, ty;
+	};
+
+	// sprite transforms stored one array per component, the layout TransformBatch reads
+	struct TransformList final {
+		std::vector<float> x, y, rotation, scaleX, scaleY;
+
+		void Push(float px, float py, float radians, float sx, float sy) {
+			x.push_back(px);
+			y.push_back(py);
+			rotation.push_back(radians);
+			scaleX.push_back(sx);
+			scaleY.push_back(sy);
+		}
+		void Clear() {
+			x.clear();
+			y.clear();
+			rotation.clear();
+			scaleX.clear();
+			scaleY.clear();
+		}
+		size_t Size() const { return x.size(); }
+	};
+
+	enum class SinCosMode {
+		// error around 1e-7 for |angle| below a few thousand radians
+		Precise,
+		// error around 2e-5, about a quarter of a pixel on a 10000 pixel wide sprite
+		Fast,
+	};
+
+	// out[i] = translate(x, y) * rotate(rotation) * scale(scaleX, scaleY) for every transform,
+	// 8 at a time with AVX2, 4 with SSE2 or NEON, scalar for the tail
+	void TransformBatch(const TransformList& transforms, Affine2D* out, SinCosMode mode = SinCosMode::Precise);
+
+}
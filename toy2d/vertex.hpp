@@ -1,11 +1,16 @@
 #pragma once
 
 #include "vulkan/vulkan.hpp"
+#include "toy2d/tool.hpp"
+#include <cstddef>
 
 namespace toy2d {
+	// 0xFFFF is texture coordinate 1.0
+	constexpr uint16_t UvOne = 0xFFFF;
+
 	struct Vertex final {
 		float x, y;
-		float u, v;
+		uint16_t u, v;	// R16G16Unorm
 
 		static std::vector<vk::VertexInputAttributeDescription> GetAttribute() {
 			std::vector <vk::VertexInputAttributeDescription> descs(2);
@@ -14,9 +19,9 @@ namespace toy2d {
 				.setLocation(0)
 				.setOffset(0);
 			descs[1].setBinding(0)
-				.setFormat(vk::Format::eR32G32Sfloat)
+				.setFormat(vk::Format::eR16G16Unorm)
 				.setLocation(1)
-				.setOffset(sizeof(float) * 2);
+				.setOffset(offsetof(Vertex, u));
 			return descs;
 		}
 
@@ -28,4 +33,136 @@ namespace toy2d {
 			return binding;
 		}
 	};
+
+	// per sprite data, fed through binding 1 at VertexInputRate::eInstance.
+	// a rotate * scale linear part has its second column at 90 degrees to the first, so the 2x3
+	// affine (see Affine2D) needs the first column and a ratio. with tint and depth that is 28
+	// bytes where a mat4 took 64
+	struct SpriteInstance final {
+		float a, b;		// first column of the linear part
+		float tx, ty;
+		float scaleRatio;	// scaleY / scaleX, the second column is scaleRatio * (-b, a)
+		PackedColor tint;
+		float depth;	// clip space z, greater is in front
+
+		static std::vector<vk::VertexInputAttributeDescription> GetAttribute() {
+			std::vector <vk::VertexInputAttributeDescription> descs(4);
+			descs[0].setBinding(1)
+				.setFormat(vk::Format::eR32G32B32A32Sfloat)
+				.setLocation(2)
+				.setOffset(offsetof(SpriteInstance, a));
+			descs[1].setBinding(1)
+				.setFormat(vk::Format::eR32Sfloat)
+				.setLocation(3)
+				.setOffset(offsetof(SpriteInstance, scaleRatio));
+			descs[2].setBinding(1)
+				.setFormat(vk::Format::eR8G8B8A8Unorm)
+				.setLocation(4)
+				.setOffset(offsetof(SpriteInstance, tint));
+			descs[3].setBinding(1)
+				.setFormat(vk::Format::eR32Sfloat)
+				.setLocation(5)
+				.setOffset(offsetof(SpriteInstance, depth));
+			return descs;
+		}
+
+		static vk::VertexInputBindingDescription GetBinding() {
+			vk::VertexInputBindingDescription binding;
+			binding.setBinding(1)
+				.setInputRate(vk::VertexInputRate::eInstance)
+				.setStride(sizeof(SpriteInstance));
+			return binding;
+		}
+	};
+
+	// per glyph data of Renderer::DrawText, fed through binding 1 like SpriteInstance
+	struct GlyphInstance final {
+		float x, y, w, h;		// world rectangle, x, y is the top left corner
+		float u0, v0, u1, v1;	// the glyph's cell in the font atlas
+		PackedColor color;
+		float depth;
+
+		static std::vector<vk::VertexInputAttributeDescription> GetAttribute() {
+			std::vector <vk::VertexInputAttributeDescription> descs(4);
+			descs[0].setBinding(1)
+				.setFormat(vk::Format::eR32G32B32A32Sfloat)
+				.setLocation(2)
+				.setOffset(offsetof(GlyphInstance, x));
+			descs[1].setBinding(1)
+				.setFormat(vk::Format::eR32G32B32A32Sfloat)
+				.setLocation(3)
+				.setOffset(offsetof(GlyphInstance, u0));
+			descs[2].setBinding(1)
+				.setFormat(vk::Format::eR8G8B8A8Unorm)
+				.setLocation(4)
+				.setOffset(offsetof(GlyphInstance, color));
+			descs[3].setBinding(1)
+				.setFormat(vk::Format::eR32Sfloat)
+				.setLocation(5)
+				.setOffset(offsetof(GlyphInstance, depth));
+			return descs;
+		}
+
+		static vk::VertexInputBindingDescription GetBinding() {
+			vk::VertexInputBindingDescription binding;
+			binding.setBinding(1)
+				.setInputRate(vk::VertexInputRate::eInstance)
+				.setStride(sizeof(GlyphInstance));
+			return binding;
+		}
+	};
+
+	// per primitive data of Renderer::DrawLine, DrawRect and DrawCircle, the shape is shaded from
+	// its signed distance in shader/primitives.frag
+	struct PrimitiveInstance final {
+		enum Kind : uint32_t {
+			Line = 0,	// a to b
+			Rect = 1,	// a is the top left, b the bottom right corner
+			Circle = 2,	// a is the center, b.x the radius
+		};
+
+		float ax, ay, bx, by;
+		float width;	// line width or outline width, 0 fills rects and circles
+		PackedColor color;
+		uint32_t kind;
+		float depth;
+
+		static std::vector<vk::VertexInputAttributeDescription> GetAttribute() {
+			std::vector <vk::VertexInputAttributeDescription> descs(5);
+			descs[0].setBinding(1)
+				.setFormat(vk::Format::eR32G32B32A32Sfloat)
+				.setLocation(2)
+				.setOffset(offsetof(PrimitiveInstance, ax));
+			descs[1].setBinding(1)
+				.setFormat(vk::Format::eR32Sfloat)
+				.setLocation(3)
+				.setOffset(offsetof(PrimitiveInstance, width));
+			descs[2].setBinding(1)
+				.setFormat(vk::Format::eR8G8B8A8Unorm)
+				.setLocation(4)
+				.setOffset(offsetof(PrimitiveInstance, color));
+			descs[3].setBinding(1)
+				.setFormat(vk::Format::eR32Uint)
+				.setLocation(5)
+				.setOffset(offsetof(PrimitiveInstance, kind));
+			descs[4].setBinding(1)
+				.setFormat(vk::Format::eR32Sfloat)
+				.setLocation(6)
+				.setOffset(offsetof(PrimitiveInstance, depth));
+			return descs;
+		}
+
+		static vk::VertexInputBindingDescription GetBinding() {
+			vk::VertexInputBindingDescription binding;
+			binding.setBinding(1)
+				.setInputRate(vk::VertexInputRate::eInstance)
+				.setStride(sizeof(PrimitiveInstance));
+			return binding;
+		}
+	};
+
+	static_assert(sizeof(Vertex) == 12, "Vertex must stay tightly packed");
+	static_assert(sizeof(SpriteInstance) == 28, "SpriteInstance must stay tightly packed");
+	static_assert(sizeof(GlyphInstance) == 40, "GlyphInstance must stay tightly packed");
+	static_assert(sizeof(PrimitiveInstance) == 32, "PrimitiveInstance must stay tightly packed");
 }
\ No newline at end of file
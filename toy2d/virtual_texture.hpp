@@ -0,0 +1,176 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+#include "toy2d/buffer.hpp"
+#include "toy2d/tool.hpp"
+#include <memory>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace toy2d {
+
+	// an image stored as fixed size pages. level L is level 0 scaled down by 2^L,
+	// page (x, y) of level L covers level 0 texels [x, x + 1) * pageSize * 2^L
+	class VirtualTextureSource {
+	public:
+		virtual ~VirtualTextureSource() = default;
+
+		virtual uint32_t Width() const = 0;
+		virtual uint32_t Height() const = 0;
+		virtual uint32_t PageSize() const = 0;
+		virtual uint32_t LevelCount() const = 0;
+
+		// writes PageSize() * PageSize() straight alpha RGBA8 pixels, pages on the right/bottom
+		// border are padded with transparent pixels. called from the streaming thread
+		virtual bool LoadPage(uint32_t level, uint32_t x, uint32_t y, std::uint8_t* pixels) = 0;
+	};
+
+	// pre-tiled directory:
+	//   layout.txt         "width height pageSize levelCount"
+	//   <level>/<x>_<y>.png
+	class TiledImageSource final : public VirtualTextureSource {
+	public:
+		TiledImageSource(const std::string& directory);
+
+		uint32_t Width() const override { return width_; }
+		uint32_t Height() const override { return height_; }
+		uint32_t PageSize() const override { return pageSize_; }
+		uint32_t LevelCount() const override { return levelCount_; }
+		bool LoadPage(uint32_t level, uint32_t x, uint32_t y, std::uint8_t* pixels) override;
+
+	private:
+		std::string directory_;
+		uint32_t width_ = 0;
+		uint32_t height_ = 0;
+		uint32_t pageSize_ = 0;
+		uint32_t levelCount_ = 0;
+	};
+
+	// streams the pages of a huge image into a fixed physical cache sized from the screen
+	// resolution. draw it with Renderer::DrawVirtualTexture
+	class VirtualTexture final {
+	public:
+		friend class Renderer;
+
+		VirtualTexture(std::unique_ptr<VirtualTextureSource> source, int maxFlightCount = 2);
+		~VirtualTexture();
+
+		// world space rectangle the image is stretched over
+		void SetRect(float x, float y, float w, float h);
+
+		struct Stats {
+			uint64_t requests = 0;
+			uint64_t uploads = 0;
+			uint64_t evictions = 0;
+			uint32_t residentPages = 0;
+			uint32_t cachePages = 0;
+		};
+		const Stats& GetStats() const { return stats_; }
+
+	private:
+		static constexpr uint32_t MaxUploadsPerFrame = 16;
+		static constexpr uint32_t MaxPendingRequests = 64;
+
+		enum class PageState {
+			Loading,
+			Resident,
+			Missing,	// the source has no such page, never requested again
+		};
+
+		struct Page {
+			PageState state;
+			uint32_t slot;
+		};
+
+		struct Slot {
+			uint64_t page;	// key of the page living here, NoPage if free
+			uint64_t lastUsedFrame;
+			bool pinned;
+		};
+
+		struct LoadedPage {
+			uint64_t key;
+			std::vector<std::uint8_t> pixels;
+			bool ok;
+		};
+
+		static constexpr uint64_t NoPage = ~0ull;
+		static uint64_t pageKey(uint32_t level, uint32_t x, uint32_t y) {
+			return (uint64_t(level) << 48) | (uint64_t(y) << 24) | x;
+		}
+		static uint32_t keyLevel(uint64_t key) { return uint32_t(key >> 48); }
+		static uint32_t keyY(uint64_t key) { return uint32_t((key >> 24) & 0xFFFFFF); }
+		static uint32_t keyX(uint64_t key) { return uint32_t(key & 0xFFFFFF); }
+
+		std::unique_ptr<VirtualTextureSource> source_;
+		Rect rect_;
+		int maxFlightCount_;
+		uint32_t pageSize_;
+		uint32_t levelCount_;
+		uint32_t tableWidth_;	// level 0 pages
+		uint32_t tableHeight_;
+		uint32_t cachePages_;	// pages per side of the physical cache
+
+		vk::Image cacheImage_;
+		vk::DeviceMemory cacheMemory_;
+		vk::ImageView cacheView_;
+		vk::Image tableImage_;
+		vk::DeviceMemory tableMemory_;
+		vk::ImageView tableView_;
+		vk::Sampler cacheSampler_;
+		vk::Sampler tableSampler_;
+
+		vk::DescriptorSetLayout setLayout_;
+		vk::DescriptorPool descriptorPool_;
+		vk::DescriptorSet set_;
+		vk::PipelineLayout pipelineLayout_;
+		vk::Pipeline pipeline_;
+		vk::ShaderModule vertModule_;
+		vk::ShaderModule fragModule_;
+
+		std::vector<vk::CommandBuffer> uploadCmds_;
+		std::vector<std::unique_ptr<Buffer>> stagingBuffers_;
+		uint64_t uploadFrame_ = 0;	// last frame pages were uploaded in
+
+		// cpu copy of the page table, packed RGBA8UI
+		std::vector<uint32_t> table_;
+		uint32_t dirtyMinY_;
+		uint32_t dirtyMaxY_;
+
+		std::unordered_map<uint64_t, Page> pages_;
+		std::vector<Slot> slots_;
+		Stats stats_;
+
+		// streaming thread
+		std::thread worker_;
+		std::mutex mutex_;
+		std::condition_variable cond_;
+		std::deque<uint64_t> requests_;
+		std::vector<LoadedPage> loaded_;
+		bool quit_ = false;
+
+		void createImages();
+		void createDescriptors();
+		void createPipeline();
+		void loadPinnedPage();
+		void workerLoop();
+
+		// called by Renderer inside a frame, before the draw is recorded. every call requests and
+		// keeps the pages of its view, only the first of a frame uploads
+		void update(int flightIndex, uint64_t frame, const Rect& view, float pixelsPerUnit);
+		void draw(vk::CommandBuffer cmd, vk::DescriptorSet globalSet);
+
+		void requestVisiblePages(uint64_t frame, const Rect& view, float pixelsPerUnit);
+		uint32_t acquireSlot(uint64_t frame);
+		void evictSlot(uint32_t slot);
+		void mapPage(uint64_t key, uint32_t slot);
+		void unmapPage(uint64_t key, uint32_t slot);
+		void markDirtyRows(uint32_t y0, uint32_t y1);
+		void recordUploads(vk::CommandBuffer cmd, Buffer& staging, std::vector<LoadedPage>& pages, const std::vector<uint32_t>& slots);
+	};
+
+}